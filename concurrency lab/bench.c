@@ -0,0 +1,1235 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "channel.h"
+#include "buffer.h"
+#include "spsc_buffer.h"
+#include "executor.h"
+#include "stress.h"
+#include "graph.h"
+
+#define NS_PER_SEC 1000000000ull
+
+// Latency histogram in the style of HdrHistogram: values below HIST_SUB are counted exactly and every
+// power of two above that is split into HIST_SUB linear buckets, so each bucket is within 1/HIST_SUB
+// (about 3%) of the values it holds while nanoseconds up to 2^64 fit in a fixed array
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+} histogram_t;
+
+typedef struct {
+    buffer_t* buffer;
+    spsc_buffer_t* spsc;
+    channel_t* channel;
+    channel_t* reply;      // channel messages are passed on to (ping-pong, token ring and fan-out)
+    channel_t** channels;  // one channel per producer for the fan-in benchmarks
+    size_t width;          // number of channels in channels
+    bool use_set;          // fan-in through a select_set instead of channel_select
+    bool use_many;         // fan-in through channel_select_many instead of channel_select
+    bool use_fair;         // fan-in through channel_select_fair instead of channel_select
+    histogram_t* index_hist; // latencies by entry of the fan-in select, width histograms
+    size_t count;          // messages this thread sends or receives
+    size_t batch;
+    histogram_t* hist;     // latencies recorded by this thread
+} bench_args;
+
+// Only the benchmark with this name is run if set (second command line argument)
+static const char* only_bench;
+
+// Where fork_task submits its children: fork_executor if set, otherwise shared_queue
+static executor_t* fork_executor;
+static channel_t* shared_queue;
+static channel_t* fork_results;
+
+// Task of the hand-built pool that shares one channel as its work queue
+typedef struct {
+    void* (*fn)(void*);
+    void* arg;
+    channel_t* results;
+} shared_task_t;
+
+uint64_t get_time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+// Returns the bucket that counts value
+size_t hist_index(uint64_t value)
+{
+    if (value < HIST_SUB) {
+        return (size_t)value;
+    }
+    size_t shift = (size_t)(63 - __builtin_clzll(value)) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (size_t)(value >> shift) - HIST_SUB;
+}
+
+// Returns the highest value counted by the bucket at index
+uint64_t hist_value(size_t index)
+{
+    if (index < 2 * HIST_SUB) {
+        return index;
+    }
+    size_t shift = index / HIST_SUB - 1;
+    uint64_t low = (uint64_t)(index % HIST_SUB + HIST_SUB) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_record(histogram_t* hist, uint64_t value)
+{
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+}
+
+void hist_merge(histogram_t* into, histogram_t* from)
+{
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+}
+
+// Returns the value at or below which the fraction quantile of the recorded values fall
+uint64_t hist_percentile(histogram_t* hist, double quantile)
+{
+    uint64_t rank = (uint64_t)(quantile * (double)hist->total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            return hist_value(i);
+        }
+    }
+    return hist_value(HIST_BUCKETS - 1);
+}
+
+// Returns true if the benchmark called bench should run
+bool bench_enabled(const char* bench)
+{
+    return only_bench == NULL || strcmp(only_bench, bench) == 0;
+}
+
+// Prints one CSV row; the latency columns are left empty when the benchmark does not record latencies, and the
+// bytes column when it doesn't count them (bytes is 0)
+void print_result_bytes(const char* bench, const char* kind, size_t size, size_t producers, size_t consumers, size_t count,
+                        uint64_t elapsed_ns, histogram_t* hist, size_t bytes)
+{
+    double seconds = (double)elapsed_ns / (double)NS_PER_SEC;
+    printf("%s,%s,%zu,%zu,%zu,%zu,%.6f,%.0f", bench, kind, size, producers, consumers, count, seconds, (double)count / seconds);
+    if (hist != NULL && hist->total > 0) {
+        printf(",%lu,%lu,%lu", hist_percentile(hist, 0.50), hist_percentile(hist, 0.99), hist_percentile(hist, 0.999));
+    } else {
+        printf(",,,");
+    }
+    if (bytes > 0) {
+        printf(",%zu\n", bytes);
+    } else {
+        printf(",\n");
+    }
+    fflush(stdout);
+}
+
+void print_result(const char* bench, const char* kind, size_t size, size_t producers, size_t consumers, size_t count,
+                  uint64_t elapsed_ns, histogram_t* hist)
+{
+    print_result_bytes(bench, kind, size, producers, consumers, count, elapsed_ns, hist, 0);
+}
+
+// Moves batch messages per call through buffer_add_batch/buffer_remove_batch
+void* ring_batch_producer(bench_args* args)
+{
+    void* items[args->batch];
+    for (size_t next = 1; next <= args->count;) {
+        size_t n = 0;
+        while (n < args->batch && next + n <= args->count) {
+            items[n] = (void*)(next + n);
+            n++;
+        }
+        size_t sent = 0;
+        while (sent < n) {
+            size_t added = buffer_add_batch(args->buffer, &items[sent], n - sent);
+            if (added == 0) {
+                sched_yield();
+            }
+            sent += added;
+        }
+        next += n;
+    }
+    return NULL;
+}
+
+void* ring_batch_consumer(bench_args* args)
+{
+    void* items[args->batch];
+    for (size_t next = 1; next <= args->count;) {
+        size_t got = buffer_remove_batch(args->buffer, items, args->batch);
+        if (got == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < got; i++) {
+            assert((size_t)items[i] == next + i);
+        }
+        next += got;
+    }
+    return NULL;
+}
+
+void* ring_producer(bench_args* args)
+{
+    for (size_t i = 1; i <= args->count; i++) {
+        if (args->spsc != NULL) {
+            while (spsc_buffer_add(args->spsc, (void*)i) == BUFFER_ERROR) {
+                sched_yield();
+            }
+        } else {
+            while (buffer_add(args->buffer, (void*)i) == BUFFER_ERROR) {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+void* ring_consumer(bench_args* args)
+{
+    for (size_t i = 1; i <= args->count; i++) {
+        void* data = NULL;
+        if (args->spsc != NULL) {
+            while (spsc_buffer_remove(args->spsc, &data) == BUFFER_ERROR) {
+                sched_yield();
+            }
+        } else {
+            while (buffer_remove(args->buffer, &data) == BUFFER_ERROR) {
+                sched_yield();
+            }
+        }
+        assert((size_t)data == i);
+    }
+    return NULL;
+}
+
+// Sends the time each message was sent at, so whoever receives it can record its latency
+void* channel_producer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        enum channel_status status = channel_send(args->channel, (void*)(uintptr_t)get_time_ns());
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+void* channel_consumer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(args->channel, &data);
+        assert(status == SUCCESS);
+        hist_record(args->hist, get_time_ns() - (uint64_t)(uintptr_t)data);
+    }
+    return NULL;
+}
+
+// Receives count messages over one select entry per channel in channels and records their latencies by entry
+// Every message takes 200ns of work, so the consumer is the bottleneck and every channel stays full
+void* fairness_consumer(bench_args* args)
+{
+    select_t* list = malloc(args->width * sizeof(select_t));
+    for (size_t i = 0; i < args->width; i++) {
+        list[i] = (select_t){args->channels[i], RECV, NULL};
+    }
+    size_t cursor = 0;
+    for (size_t i = 0; i < args->count; i++) {
+        size_t index = 0;
+        enum channel_status status = args->use_fair ? channel_select_fair(list, args->width, &index, &cursor)
+                                                    : channel_select(list, args->width, &index);
+        assert(status == SUCCESS);
+        uint64_t now = get_time_ns();
+        uint64_t latency = now - (uint64_t)(uintptr_t)list[index].data;
+        hist_record(args->hist, latency);
+        hist_record(&args->index_hist[index], latency);
+        while (get_time_ns() - now < 200) {
+        }
+    }
+    free(list);
+    return NULL;
+}
+
+// Floods the channel with count data messages (1, which no send time can be)
+void* data_producer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        enum channel_status status = channel_send(args->channel, (void*)1);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Sends count control messages at the highest priority, each the time it was sent at, spaced out so every one of
+// them has to get past a channel that data_producer has filled again
+void* control_producer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        usleep(50);
+        enum channel_status status = channel_send_prio(args->channel, (void*)(uintptr_t)get_time_ns(), PRIORITY_LEVELS - 1);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Receives count messages and records the latency of the control messages among them
+// Every data message takes 200ns of work, so the consumer is the bottleneck and the channel stays full
+void* control_consumer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(args->channel, &data);
+        assert(status == SUCCESS);
+        uint64_t now = get_time_ns();
+        if ((uintptr_t)data != 1) {
+            hist_record(args->hist, now - (uint64_t)(uintptr_t)data);
+            continue;
+        }
+        while (get_time_ns() - now < 200) {
+        }
+    }
+    return NULL;
+}
+
+// Sends a message and waits for it to come back, recording round trip times
+void* pingpong_producer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = (void*)(uintptr_t)get_time_ns();
+        enum channel_status status = channel_send(args->channel, data);
+        assert(status == SUCCESS);
+        status = channel_receive(args->reply, &data);
+        assert(status == SUCCESS);
+        hist_record(args->hist, get_time_ns() - (uint64_t)(uintptr_t)data);
+    }
+    return NULL;
+}
+
+void* pingpong_consumer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(args->channel, &data);
+        assert(status == SUCCESS);
+        status = channel_send(args->reply, data);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Receives from every channel of args->channels through one select
+void* fanin_consumer(bench_args* args)
+{
+    select_t* list = malloc(args->width * sizeof(select_t));
+    for (size_t i = 0; i < args->width; i++) {
+        list[i].channel = args->channels[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+    }
+    select_set_t* set = args->use_set ? select_set_create(list, args->width) : NULL;
+    if (args->use_many) {
+        size_t* indices = malloc(args->width * sizeof(size_t));
+        size_t cursor = 0;
+        for (size_t received = 0; received < args->count;) {
+            size_t max = (args->count - received < args->width) ? args->count - received : args->width;
+            size_t count = 0;
+            enum channel_status status = channel_select_many(list, args->width, indices, max, &count, &cursor);
+            assert(status == SUCCESS);
+            uint64_t now = get_time_ns();
+            for (size_t i = 0; i < count; i++) {
+                hist_record(args->hist, now - (uint64_t)(uintptr_t)list[indices[i]].data);
+            }
+            received += count;
+        }
+        free(indices);
+    }
+    for (size_t i = 0; i < args->count && !args->use_many; i++) {
+        size_t index = 0;
+        enum channel_status status = args->use_set ? select_set_wait(set, &index) : channel_select(list, args->width, &index);
+        assert(status == SUCCESS);
+        hist_record(args->hist, get_time_ns() - (uint64_t)(uintptr_t)list[index].data);
+    }
+    if (set != NULL) {
+        select_set_destroy(set);
+    }
+    free(list);
+    return NULL;
+}
+
+// Sends the time each message was sent at on every channel of args->channels, the way router() sends
+// its distance vector to each neighbour
+void* copies_producer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = (void*)(uintptr_t)get_time_ns();
+        for (size_t c = 0; c < args->width; c++) {
+            enum channel_status status = channel_send(args->channels[c], data);
+            assert(status == SUCCESS);
+        }
+    }
+    return NULL;
+}
+
+// Passes messages from args->channel on to args->reply until args->channel is closed
+void* forward_worker(bench_args* args)
+{
+    void* data = NULL;
+    while (channel_receive(args->channel, &data) == SUCCESS) {
+        enum channel_status status = channel_send(args->reply, data);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Message passed around the token ring
+typedef struct {
+    uint64_t sent_ns;
+    size_t hops; // hops left before the token is handed back on args->channels[0]
+} bench_token_t;
+
+// Records how long each token took to arrive and passes it on to the next thread in the ring
+void* token_worker(bench_args* args)
+{
+    bench_token_t token;
+    while (channel_receive_value(args->channel, &token) == SUCCESS) {
+        uint64_t now = get_time_ns();
+        hist_record(args->hist, now - token.sent_ns);
+        enum channel_status status;
+        if (token.hops == 0) {
+            status = channel_send_value(args->channels[0], &token);
+        } else {
+            token.hops--;
+            token.sent_ns = now;
+            status = channel_send_value(args->reply, &token);
+        }
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Message used to compare typed channels against sending pointers to allocated messages
+typedef struct {
+    size_t id;
+    char payload[56];
+} bench_message_t;
+
+void* malloc_producer(bench_args* args)
+{
+    for (size_t i = 1; i <= args->count; i++) {
+        bench_message_t* message = malloc(sizeof(bench_message_t));
+        message->id = i;
+        enum channel_status status = channel_send(args->channel, message);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+void* malloc_consumer(bench_args* args)
+{
+    for (size_t i = 1; i <= args->count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(args->channel, &data);
+        assert(status == SUCCESS);
+        assert(((bench_message_t*)data)->id == i);
+        free(data);
+    }
+    return NULL;
+}
+
+void* typed_producer(bench_args* args)
+{
+    bench_message_t message;
+    memset(&message, 0, sizeof(message));
+    for (size_t i = 1; i <= args->count; i++) {
+        message.id = i;
+        enum channel_status status = channel_send_value(args->channel, &message);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+void* typed_consumer(bench_args* args)
+{
+    bench_message_t message;
+    for (size_t i = 1; i <= args->count; i++) {
+        enum channel_status status = channel_receive_value(args->channel, &message);
+        assert(status == SUCCESS);
+        assert(message.id == i);
+    }
+    return NULL;
+}
+
+void* batch_producer(bench_args* args)
+{
+    void* items[args->batch];
+    size_t next = 1;
+    while (next <= args->count) {
+        size_t n = 0;
+        while (n < args->batch && next + n <= args->count) {
+            items[n] = (void*)(next + n);
+            n++;
+        }
+        size_t sent = 0;
+        enum channel_status status = channel_send_batch(args->channel, items, n, &sent);
+        assert(status == SUCCESS && sent == n);
+        next += n;
+    }
+    return NULL;
+}
+
+void* batch_consumer(bench_args* args)
+{
+    void* items[args->batch];
+    size_t next = 1;
+    while (next <= args->count) {
+        size_t got = 0;
+        enum channel_status status = channel_receive_batch(args->channel, items, args->batch, &got);
+        assert(status == SUCCESS);
+        for (size_t i = 0; i < got; i++) {
+            assert((size_t)items[i] == next + i);
+        }
+        next += got;
+    }
+    return NULL;
+}
+
+// Returns the share of count messages that thread index out of threads handles
+size_t thread_share(size_t count, size_t threads, size_t index)
+{
+    return count / threads + (index < count % threads ? 1 : 0);
+}
+
+// Receives args->count messages without looking at them
+void* drain_consumer(bench_args* args)
+{
+    for (size_t i = 0; i < args->count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(args->channel, &data);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+// Worker of the shared-queue pool: runs tasks from shared_queue until it is closed
+void* shared_worker(void* arg)
+{
+    void* data = NULL;
+    while (channel_receive(shared_queue, &data) == SUCCESS) {
+        shared_task_t* task = data;
+        void* result = task->fn(task->arg);
+        if (task->results != NULL) {
+            enum channel_status status = channel_send(task->results, result);
+            assert(status == SUCCESS);
+        }
+        free(task);
+    }
+    return NULL;
+}
+
+void shared_submit(void* (*fn)(void*), void* arg, channel_t* results)
+{
+    shared_task_t* task = malloc(sizeof(shared_task_t));
+    *task = (shared_task_t){fn, arg, results};
+    enum channel_status status = channel_send(shared_queue, task);
+    assert(status == SUCCESS);
+}
+
+// Flat workload: returns the send time it was given, so the collector can record the task's latency
+void* identity_task(void* arg)
+{
+    return arg;
+}
+
+// Fork workload: a task of depth arg submits two tasks of depth arg - 1, and tasks of depth 0 report to fork_results
+void* fork_task(void* arg)
+{
+    size_t depth = (size_t)arg;
+    if (depth == 0) {
+        return (void*)1;
+    }
+    channel_t* results = (depth == 1) ? fork_results : NULL;
+    for (size_t i = 0; i < 2; i++) {
+        if (fork_executor != NULL) {
+            enum channel_status status = executor_submit(fork_executor, fork_task, (void*)(depth - 1), results);
+            assert(status == SUCCESS);
+        } else {
+            shared_submit(fork_task, (void*)(depth - 1), results);
+        }
+    }
+    return NULL;
+}
+
+// Times producers threads against consumers threads moving args->count messages between them
+// Each thread gets its own copy of args with its share of the messages and its own histogram, and
+// producer i sends on args->channels[i] when args->channels is set; the histograms are merged into hist
+uint64_t run_group(void* (*producer)(bench_args*), void* (*consumer)(bench_args*), bench_args* args,
+                   size_t producers, size_t consumers, histogram_t* hist)
+{
+    size_t threads = producers + consumers;
+    pthread_t* pids = malloc(threads * sizeof(pthread_t));
+    bench_args* thread_args = malloc(threads * sizeof(bench_args));
+    for (size_t i = 0; i < threads; i++) {
+        thread_args[i] = *args;
+        thread_args[i].hist = calloc(1, sizeof(histogram_t));
+        if (i < consumers) {
+            thread_args[i].count = thread_share(args->count, consumers, i);
+        } else {
+            size_t index = i - consumers;
+            thread_args[i].count = thread_share(args->count, producers, index);
+            if (args->channels != NULL) {
+                thread_args[i].channel = args->channels[index];
+            }
+        }
+    }
+    uint64_t start = get_time_ns();
+    for (size_t i = 0; i < threads; i++) {
+        pthread_create(&pids[i], NULL, (void*)(i < consumers ? consumer : producer), &thread_args[i]);
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(pids[i], NULL);
+    }
+    uint64_t elapsed = get_time_ns() - start;
+    memset(hist, 0, sizeof(histogram_t));
+    for (size_t i = 0; i < threads; i++) {
+        hist_merge(hist, thread_args[i].hist);
+        free(thread_args[i].hist);
+    }
+    free(thread_args);
+    free(pids);
+    return elapsed;
+}
+
+// Times one producer thread against one consumer thread moving count messages
+uint64_t run_pair(void* (*producer)(bench_args*), void* (*consumer)(bench_args*), bench_args* args, histogram_t* hist)
+{
+    return run_group(producer, consumer, args, 1, 1, hist);
+}
+
+// Raw ring throughput: generic MPMC buffer_t, one message and 32 messages per call, against spsc_buffer_t with one
+// producer and one consumer
+void bench_ring(size_t size, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+
+    args.buffer = buffer_create(size);
+    print_result("ring", "mpmc", size, 1, 1, count, run_pair(ring_producer, ring_consumer, &args, hist), hist);
+    buffer_free(args.buffer);
+    args.buffer = buffer_create(size);
+    args.batch = 32;
+    print_result("ring", "mpmc_batch32", size, 1, 1, count, run_pair(ring_batch_producer, ring_batch_consumer, &args, hist), hist);
+    buffer_free(args.buffer);
+    args.buffer = NULL;
+    args.batch = 1;
+
+    args.spsc = spsc_buffer_create(size);
+    print_result("ring", "spsc", size, 1, 1, count, run_pair(ring_producer, ring_consumer, &args, hist), hist);
+    spsc_buffer_free(args.spsc);
+}
+
+// Channel throughput and send-to-receive latency including the blocking paths, with producers threads
+// sending to consumers threads; a size of 0 measures the unbuffered channel
+void bench_channel(size_t size, size_t producers, size_t consumers, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+
+    args.channel = channel_create(size);
+    uint64_t elapsed = run_group(channel_producer, channel_consumer, &args, producers, consumers, hist);
+    print_result("channel", size == 0 ? "sync" : "mpmc", size, producers, consumers, count, elapsed, hist);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+
+    if (size > 0 && producers == 1 && consumers == 1) {
+        args.channel = channel_create_spsc(size);
+        print_result("channel", "spsc", size, 1, 1, count, run_pair(channel_producer, channel_consumer, &args, hist), hist);
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+    }
+}
+
+// Many producers on one channel: a channel_create channel against sharded channels with one lane per CPU, with and
+// without per-producer FIFO order
+void bench_sharded(size_t size, size_t producers, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+    const char* kinds[] = {"mpmc", "sharded", "sharded_fifo"};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        args.channel = (i == 0) ? channel_create(size) : channel_create_sharded(size, 0, 0, i == 2);
+        uint64_t elapsed = run_group(channel_producer, channel_consumer, &args, producers, 1, hist);
+        print_result("sharded", kinds[i], size, producers, 1, count, elapsed, hist);
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+    }
+}
+
+// Control messages under data saturation: one producer keeps the channel full of data while another sends
+// controls count / 1000 control messages at the highest priority; the latency columns are the control messages'
+// alone, through a channel_create channel (where they queue behind the data) and through a priority channel
+void bench_priority(size_t size, size_t count, histogram_t* hist)
+{
+    size_t controls = count / 1000 > 0 ? count / 1000 : 1;
+    const char* kinds[] = {"fifo", "priority"};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        channel_t* channel = (i == 0) ? channel_create(size) : channel_create_priority(size);
+        bench_args data_args = {.channel = channel, .count = count, .batch = 1};
+        bench_args control_args = {.channel = channel, .count = controls, .batch = 1};
+        bench_args consumer_args = {.channel = channel, .count = count + controls, .batch = 1, .hist = hist};
+        pthread_t pids[3];
+        memset(hist, 0, sizeof(histogram_t));
+
+        uint64_t start = get_time_ns();
+        pthread_create(&pids[0], NULL, (void*)control_consumer, &consumer_args);
+        pthread_create(&pids[1], NULL, (void*)data_producer, &data_args);
+        pthread_create(&pids[2], NULL, (void*)control_producer, &control_args);
+        for (size_t t = 0; t < 3; t++) {
+            pthread_join(pids[t], NULL);
+        }
+        uint64_t elapsed = get_time_ns() - start;
+        print_result("priority", kinds[i], size, 2, 1, controls, elapsed, hist);
+        channel_close(channel);
+        channel_destroy(channel);
+    }
+}
+
+// One producer and one consumer through a small and a large channel_create channel and through an elastic channel
+// (channel_create_elastic) that starts small and may grow as large; the bytes column is the size of the ring's slots
+// at the end of the run, after the elastic channel has had the chance to shrink back
+void bench_elastic(size_t size, size_t max_size, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+    const char* kinds[] = {"small", "large", "elastic"};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        args.channel = (i == 0) ? channel_create(size) : (i == 1) ? channel_create(max_size) : channel_create_elastic(size, max_size);
+        uint64_t elapsed = run_pair(channel_producer, channel_consumer, &args, hist);
+        size_t capacity = (i == 2) ? elastic_buffer_capacity(args.channel->elastic) : buffer_capacity(args.channel->buffer);
+        print_result_bytes("elastic", kinds[i], (i == 0) ? size : max_size, 1, 1, count, elapsed, hist,
+                           capacity * (sizeof(buffer_slot_t) + sizeof(void*)));
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+    }
+}
+
+// Round trip latency: one thread sends a message and waits for a second thread to send it back
+void bench_pingpong(size_t size, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+
+    args.channel = channel_create(size);
+    args.reply = channel_create(size);
+    print_result("pingpong", size == 0 ? "sync" : "mpmc", size, 1, 1, count,
+                 run_pair(pingpong_producer, pingpong_consumer, &args, hist), hist);
+    channel_close(args.channel);
+    channel_close(args.reply);
+    channel_destroy(args.channel);
+    channel_destroy(args.reply);
+}
+
+// Fan-in: width producers each send on their own channel and one consumer receives from all of them,
+// through channel_select, through a select_set or through channel_select_many
+void bench_fanin(size_t size, size_t width, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1, .width = width};
+    args.channels = malloc(width * sizeof(channel_t*));
+    for (size_t i = 0; i < width; i++) {
+        args.channels[i] = channel_create(size);
+    }
+
+    args.use_set = false;
+    print_result("fanin", "select", size, width, 1, count,
+                 run_group(channel_producer, fanin_consumer, &args, width, 1, hist), hist);
+    args.use_set = true;
+    print_result("fanin", "select_set", size, width, 1, count,
+                 run_group(channel_producer, fanin_consumer, &args, width, 1, hist), hist);
+    args.use_set = false;
+    args.use_many = true;
+    print_result("fanin", "select_many", size, width, 1, count,
+                 run_group(channel_producer, fanin_consumer, &args, width, 1, hist), hist);
+
+    for (size_t i = 0; i < width; i++) {
+        channel_close(args.channels[i]);
+        channel_destroy(args.channels[i]);
+    }
+    free(args.channels);
+}
+
+// Fairness: width producers keep their own channels full and one consumer selects over all of them, with
+// channel_select and with channel_select_fair; prints one row per select entry (kind select[index] or fair[index])
+// with the latencies of the messages received through it, followed by a row for all of them
+void bench_fairness(size_t size, size_t width, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1, .width = width};
+    args.channels = malloc(width * sizeof(channel_t*));
+    args.index_hist = malloc(width * sizeof(histogram_t));
+    for (int fair = 0; fair <= 1; fair++) {
+        for (size_t i = 0; i < width; i++) {
+            args.channels[i] = channel_create(size);
+        }
+        memset(args.index_hist, 0, width * sizeof(histogram_t));
+        args.use_fair = fair;
+        uint64_t elapsed = run_group(channel_producer, fairness_consumer, &args, width, 1, hist);
+        for (size_t i = 0; i < width; i++) {
+            char kind[32];
+            snprintf(kind, sizeof(kind), "%s[%zu]", fair ? "fair" : "select", i);
+            print_result("fairness", kind, size, width, 1, args.index_hist[i].total, elapsed, &args.index_hist[i]);
+        }
+        print_result("fairness", fair ? "fair" : "select", size, width, 1, count, elapsed, hist);
+        for (size_t i = 0; i < width; i++) {
+            channel_close(args.channels[i]);
+            channel_destroy(args.channels[i]);
+        }
+    }
+    free(args.index_hist);
+    free(args.channels);
+}
+
+// Fan-out/fan-in: one producer hands messages to width workers over a shared channel and the workers
+// pass them on to one collector over a second channel; latency is measured from producer to collector
+void bench_fanout(size_t size, size_t width, size_t count, histogram_t* hist)
+{
+    channel_t* work = channel_create(size);
+    channel_t* results = channel_create(size);
+    bench_args producer_args = {.channel = work, .count = count, .batch = 1};
+    bench_args worker_args = {.channel = work, .reply = results, .batch = 1};
+    pthread_t producer_pid;
+    pthread_t* worker_pids = malloc(width * sizeof(pthread_t));
+    memset(hist, 0, sizeof(histogram_t));
+
+    uint64_t start = get_time_ns();
+    for (size_t i = 0; i < width; i++) {
+        pthread_create(&worker_pids[i], NULL, (void*)forward_worker, &worker_args);
+    }
+    pthread_create(&producer_pid, NULL, (void*)channel_producer, &producer_args);
+    for (size_t i = 0; i < count; i++) {
+        void* data = NULL;
+        enum channel_status status = channel_receive(results, &data);
+        assert(status == SUCCESS);
+        hist_record(hist, get_time_ns() - (uint64_t)(uintptr_t)data);
+    }
+    uint64_t elapsed = get_time_ns() - start;
+    pthread_join(producer_pid, NULL);
+    // every message has been collected, so the workers are all waiting on work
+    channel_close(work);
+    for (size_t i = 0; i < width; i++) {
+        pthread_join(worker_pids[i], NULL);
+    }
+    print_result("fanout", "mpmc", size, 1, width, count, elapsed, hist);
+
+    channel_close(results);
+    channel_destroy(work);
+    channel_destroy(results);
+    free(worker_pids);
+}
+
+// One-to-many: one producer delivers every message to width consumers, either by sending it on each
+// consumer's own channel or with one send on a broadcast channel the consumers subscribe to; latency is
+// from the send to each consumer's receive
+void bench_broadcast(size_t size, size_t width, size_t count, histogram_t* hist)
+{
+    for (size_t broadcast = 0; broadcast < 2; broadcast++) {
+        channel_t* publisher = broadcast ? channel_create_broadcast(size, 0) : NULL;
+        channel_t** channels = malloc(width * sizeof(channel_t*));
+        bench_args* consumer_args = malloc(width * sizeof(bench_args));
+        pthread_t* consumer_pids = malloc(width * sizeof(pthread_t));
+        for (size_t i = 0; i < width; i++) {
+            channels[i] = broadcast ? channel_subscribe(publisher) : channel_create(size);
+            consumer_args[i] = (bench_args){.channel = channels[i], .count = count, .batch = 1};
+            consumer_args[i].hist = calloc(1, sizeof(histogram_t));
+        }
+        bench_args producer_args = {.channel = publisher, .channels = channels, .width = width, .count = count, .batch = 1};
+
+        uint64_t start = get_time_ns();
+        for (size_t i = 0; i < width; i++) {
+            pthread_create(&consumer_pids[i], NULL, (void*)channel_consumer, &consumer_args[i]);
+        }
+        pthread_t producer_pid;
+        pthread_create(&producer_pid, NULL, (void*)(broadcast ? channel_producer : copies_producer), &producer_args);
+        pthread_join(producer_pid, NULL);
+        memset(hist, 0, sizeof(histogram_t));
+        for (size_t i = 0; i < width; i++) {
+            pthread_join(consumer_pids[i], NULL);
+            hist_merge(hist, consumer_args[i].hist);
+            free(consumer_args[i].hist);
+        }
+        uint64_t elapsed = get_time_ns() - start;
+        print_result("broadcast", broadcast ? "broadcast" : "channels", size, 1, width, count, elapsed, hist);
+
+        if (publisher != NULL) {
+            channel_close(publisher);
+        }
+        for (size_t i = 0; i < width; i++) {
+            channel_close(channels[i]);
+            channel_destroy(channels[i]);
+        }
+        if (publisher != NULL) {
+            channel_destroy(publisher);
+        }
+        free(consumer_pids);
+        free(consumer_args);
+        free(channels);
+    }
+}
+
+// Token ring as in stress_send_recv.c: threads pass tokens around a ring of typed channels, half as
+// many tokens as the ring can hold, until count hops have been made; latency is per hop
+void bench_token_ring(size_t size, size_t threads, size_t count, histogram_t* hist)
+{
+    size_t tokens = threads * (size + 1) / 2;
+    if (tokens == 0) {
+        tokens = 1;
+    }
+    size_t hops = count / tokens > 0 ? count / tokens - 1 : 0;
+    channel_t** ring = malloc(threads * sizeof(channel_t*));
+    for (size_t i = 0; i < threads; i++) {
+        ring[i] = channel_create_typed(size, sizeof(bench_token_t));
+    }
+    // tokens that finished their hops come back here; it holds all of them so workers never block on it
+    channel_t* done = channel_create_typed(tokens, sizeof(bench_token_t));
+    pthread_t* pids = malloc(threads * sizeof(pthread_t));
+    bench_args* thread_args = malloc(threads * sizeof(bench_args));
+
+    uint64_t start = get_time_ns();
+    for (size_t i = 0; i < threads; i++) {
+        thread_args[i] = (bench_args){.channel = ring[i], .reply = ring[(i + 1) % threads], .channels = &done, .width = 1};
+        thread_args[i].hist = calloc(1, sizeof(histogram_t));
+        pthread_create(&pids[i], NULL, (void*)token_worker, &thread_args[i]);
+    }
+    for (size_t i = 0; i < tokens; i++) {
+        bench_token_t token = {get_time_ns(), hops};
+        enum channel_status status = channel_send_value(ring[i % threads], &token);
+        assert(status == SUCCESS);
+    }
+    for (size_t i = 0; i < tokens; i++) {
+        bench_token_t token;
+        enum channel_status status = channel_receive_value(done, &token);
+        assert(status == SUCCESS);
+    }
+    uint64_t elapsed = get_time_ns() - start;
+    // no token is left in the ring, so every worker is waiting on its channel
+    memset(hist, 0, sizeof(histogram_t));
+    for (size_t i = 0; i < threads; i++) {
+        channel_close(ring[i]);
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(pids[i], NULL);
+        hist_merge(hist, thread_args[i].hist);
+        free(thread_args[i].hist);
+        channel_destroy(ring[i]);
+    }
+    print_result("token_ring", "typed", size, threads, threads, tokens * (hops + 1), elapsed, hist);
+
+    channel_close(done);
+    channel_destroy(done);
+    free(thread_args);
+    free(pids);
+    free(ring);
+}
+
+// Runs one executor workload with workers threads, either on the work-stealing executor or on a pool that
+// shares one channel as its work queue, with a collector thread receiving the results
+void run_executor(bool stealing, bool fork, size_t workers, size_t size, size_t count, histogram_t* hist)
+{
+    size_t depth = 0;
+    while (((size_t)2 << depth) <= count) {
+        depth++;
+    }
+    size_t tasks = fork ? ((size_t)1 << depth) : count;
+    // forked tasks are submitted from inside the pool, so the shared queue must hold all of them
+    size_t queue_size = fork ? 2 * tasks : size;
+    channel_t* results = channel_create(size);
+    bench_args collector_args = {.channel = results, .count = tasks, .batch = 1};
+    collector_args.hist = calloc(1, sizeof(histogram_t));
+    pthread_t collector;
+    pthread_t* pids = NULL;
+    fork_results = results;
+    fork_executor = NULL;
+
+    uint64_t start = get_time_ns();
+    if (stealing) {
+        fork_executor = executor_create(workers, queue_size);
+    } else {
+        shared_queue = channel_create(queue_size);
+        pids = malloc(workers * sizeof(pthread_t));
+        for (size_t i = 0; i < workers; i++) {
+            pthread_create(&pids[i], NULL, shared_worker, NULL);
+        }
+    }
+    pthread_create(&collector, NULL, (void*)(fork ? drain_consumer : channel_consumer), &collector_args);
+    if (fork) {
+        if (stealing) {
+            executor_submit(fork_executor, fork_task, (void*)depth, depth == 0 ? results : NULL);
+        } else {
+            shared_submit(fork_task, (void*)depth, depth == 0 ? results : NULL);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            void* now = (void*)(uintptr_t)get_time_ns();
+            if (stealing) {
+                executor_submit(fork_executor, identity_task, now, results);
+            } else {
+                shared_submit(identity_task, now, results);
+            }
+        }
+    }
+    pthread_join(collector, NULL);
+    uint64_t elapsed = get_time_ns() - start;
+
+    if (stealing) {
+        executor_destroy(fork_executor);
+        fork_executor = NULL;
+    } else {
+        // every result has been collected, so the workers are all waiting on the queue
+        channel_close(shared_queue);
+        for (size_t i = 0; i < workers; i++) {
+            pthread_join(pids[i], NULL);
+        }
+        channel_destroy(shared_queue);
+        free(pids);
+    }
+    memset(hist, 0, sizeof(histogram_t));
+    hist_merge(hist, collector_args.hist);
+    free(collector_args.hist);
+    char kind[32];
+    snprintf(kind, sizeof(kind), "%s_%s", fork ? "fork" : "flat", stealing ? "stealing" : "shared");
+    print_result("executor", kind, size, 1, workers, tasks, elapsed, hist);
+    channel_close(results);
+    channel_destroy(results);
+}
+
+// Work-stealing executor against one shared channel work queue, for tasks submitted from one thread (flat)
+// and for tasks that submit two more tasks until they reach a depth of 0 (fork)
+void bench_executor(size_t workers, size_t count, histogram_t* hist)
+{
+    for (int fork = 0; fork <= 1; fork++) {
+        run_executor(true, fork, workers, 256, count, hist);
+        run_executor(false, fork, workers, 256, count, hist);
+    }
+}
+
+// 64-byte messages: malloc'd and sent by pointer, against copied into a typed channel
+void bench_typed(size_t size, size_t count, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = 1};
+
+    args.channel = channel_create(size);
+    print_result("message64", "malloc", size, 1, 1, count, run_pair(malloc_producer, malloc_consumer, &args, hist), hist);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+
+    args.channel = channel_create_typed(size, sizeof(bench_message_t));
+    print_result("message64", "typed", size, 1, 1, count, run_pair(typed_producer, typed_consumer, &args, hist), hist);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+
+    // the same typed messages through shared memory to a consumer in a child process
+    char name[SHM_BUFFER_NAME_MAX];
+    snprintf(name, sizeof(name), "/channel_bench_%d", (int)getpid());
+    args.channel = channel_create_shm(name, size, sizeof(bench_message_t));
+    assert(args.channel != NULL);
+    uint64_t start = get_time_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        args.channel = channel_open_shm(name);
+        typed_consumer(&args);
+        channel_close(args.channel);
+        channel_destroy(args.channel);
+        _exit(0);
+    }
+    typed_producer(&args);
+    waitpid(pid, NULL, 0);
+    uint64_t elapsed = get_time_ns() - start;
+    memset(hist, 0, sizeof(histogram_t));
+    print_result("message64", "shm", size, 1, 1, count, elapsed, hist);
+    channel_destroy(args.channel);
+}
+
+// Batch API throughput: channel_send_batch/channel_receive_batch moving batch messages per call
+void bench_batch(size_t size, size_t count, size_t batch, histogram_t* hist)
+{
+    bench_args args = {.count = count, .batch = batch};
+    char kind[32];
+
+    args.channel = channel_create(size);
+    snprintf(kind, sizeof(kind), "mpmc_batch%zu", batch);
+    print_result("channel", kind, size, 1, 1, count, run_pair(batch_producer, batch_consumer, &args, hist), hist);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+
+    args.channel = channel_create_spsc(size);
+    snprintf(kind, sizeof(kind), "spsc_batch%zu", batch);
+    print_result("channel", kind, size, 1, 1, count, run_pair(batch_producer, batch_consumer, &args, hist), hist);
+    channel_close(args.channel);
+    channel_destroy(args.channel);
+}
+
+// Runs the distance-vector routers of the stress test on the topology in filename until they converge, sending whole
+// vectors or only the entries that changed (delta); messages counts the updates the routers sent each other
+void bench_routing(const char* filename, bool delta)
+{
+    stress_report_t report;
+    run_stress_report(1, 1, filename, delta, &report);
+    print_result_bytes("routing", delta ? "delta" : "full", report.nodes, report.nodes, report.nodes, report.updates,
+                       (uint64_t)(report.seconds * (double)NS_PER_SEC), NULL, report.bytes);
+}
+
+// Times loading a topology the way the stress test does: parsing the text matrix of big_graph.txt, generating each
+// kind of graph with nodes nodes, and mapping the generated graph back from a binary file; messages counts edges
+void bench_graph(size_t nodes)
+{
+    uint64_t start = get_time_ns();
+    graph_t* graph = graph_load("big_graph.txt");
+    assert(graph != NULL);
+    print_result("graph", "text", graph->nodes, 1, 1, graph->edges, get_time_ns() - start, NULL);
+    graph_free(graph);
+
+    const char* kinds[] = {"random", "grid", "power_law"};
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        start = get_time_ns();
+        if (i == 0) {
+            graph = graph_generate_random(nodes, 4, 9, 1);
+        } else if (i == 1) {
+            graph = graph_generate_grid(1000, nodes / 1000, 9, 1);
+        } else {
+            graph = graph_generate_power_law(nodes, 2, 9, 1);
+        }
+        print_result("graph", kinds[i], graph->nodes, 1, 1, graph->edges, get_time_ns() - start, NULL);
+        graph_free(graph);
+    }
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/channel_bench_graph_%d.bin", (int)getpid());
+    graph = graph_generate_power_law(nodes, 2, 9, 1);
+    bool saved = graph_save(graph, filename);
+    assert(saved);
+    graph_free(graph);
+    start = get_time_ns();
+    graph = graph_load(filename);
+    assert(graph != NULL);
+    // touch every edge so the time includes faulting the mapping in
+    size_t total = 0;
+    for (size_t edge = 0; edge < graph->edges; edge++) {
+        total += graph->weights[edge];
+    }
+    assert(total >= graph->edges);
+    print_result("graph", "mapped", graph->nodes, 1, 1, graph->edges, get_time_ns() - start, NULL);
+    graph_free(graph);
+    unlink(filename);
+}
+
+// Usage: ./channel_bench [messages] [bench]
+// Runs every benchmark, or only the one named bench, moving messages messages per run
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    if (argc > 1) {
+        count = (size_t)atol(argv[1]);
+    }
+    if (argc > 2) {
+        only_bench = argv[2];
+    }
+    // the patterns that block on every message run a tenth as many
+    size_t pattern_count = count / 10 > 0 ? count / 10 : 1;
+    size_t sizes[] = {1, 16, 256};
+    size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    size_t threads[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+    size_t num_threads = sizeof(threads) / sizeof(threads[0]);
+    size_t widths[] = {1, 4, 16};
+    size_t num_widths = sizeof(widths) / sizeof(widths[0]);
+    histogram_t* hist = malloc(sizeof(histogram_t));
+
+    printf("bench,kind,size,producers,consumers,messages,seconds,msgs_per_sec,p50_ns,p99_ns,p999_ns,bytes\n");
+    if (bench_enabled("ring")) {
+        for (size_t i = 0; i < num_sizes; i++) {
+            bench_ring(sizes[i], count, hist);
+        }
+    }
+    if (bench_enabled("channel")) {
+        for (size_t t = 0; t < num_threads; t++) {
+            bench_channel(0, threads[t][0], threads[t][1], pattern_count, hist);
+            for (size_t i = 0; i < num_sizes; i++) {
+                bench_channel(sizes[i], threads[t][0], threads[t][1], count, hist);
+            }
+        }
+        for (size_t i = 0; i < num_sizes; i++) {
+            bench_batch(sizes[i], count, 32, hist);
+        }
+    }
+    if (bench_enabled("sharded")) {
+        bench_sharded(256, 8, count, hist);
+        bench_sharded(256, 32, count, hist);
+    }
+    if (bench_enabled("priority")) {
+        bench_priority(256, count, hist);
+        bench_priority(4096, count, hist);
+    }
+    if (bench_enabled("elastic")) {
+        bench_elastic(16, 4096, count, hist);
+    }
+    if (bench_enabled("message64")) {
+        for (size_t i = 0; i < num_sizes; i++) {
+            bench_typed(sizes[i], count, hist);
+        }
+    }
+    if (bench_enabled("pingpong")) {
+        bench_pingpong(0, pattern_count, hist);
+        bench_pingpong(1, pattern_count, hist);
+    }
+    if (bench_enabled("fanin")) {
+        for (size_t w = 0; w < num_widths; w++) {
+            bench_fanin(16, widths[w], count, hist);
+        }
+    }
+    if (bench_enabled("fairness")) {
+        bench_fairness(16, 8, count, hist);
+    }
+    if (bench_enabled("fanout")) {
+        for (size_t w = 0; w < num_widths; w++) {
+            bench_fanout(16, widths[w], count, hist);
+        }
+    }
+    if (bench_enabled("broadcast")) {
+        for (size_t w = 0; w < num_widths; w++) {
+            bench_broadcast(16, widths[w], pattern_count, hist);
+        }
+    }
+    if (bench_enabled("executor")) {
+        bench_executor(1, count, hist);
+        bench_executor(4, count, hist);
+    }
+    if (bench_enabled("token_ring")) {
+        bench_token_ring(0, 4, pattern_count, hist);
+        bench_token_ring(16, 4, pattern_count, hist);
+        bench_token_ring(16, 16, pattern_count, hist);
+    }
+    if (bench_enabled("routing")) {
+        const char* topologies[] = {"topology.txt", "random_topology_1.txt", "big_graph.txt"};
+        for (size_t i = 0; i < sizeof(topologies) / sizeof(topologies[0]); i++) {
+            bench_routing(topologies[i], false);
+            bench_routing(topologies[i], true);
+        }
+    }
+    if (bench_enabled("graph")) {
+        bench_graph(1000000);
+    }
+    free(hist);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <string.h>
+#include "broadcast_buffer.h"
+
+// Creates a ring with the given capacity (at least 1) that stores messages of elem_size bytes inline,
+// or pointers if elem_size is 0
+broadcast_buffer_t* broadcast_buffer_create(size_t capacity, size_t elem_size)
+{
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    broadcast_buffer_t* buffer = (broadcast_buffer_t*) aligned_alloc(BUFFER_CACHE_LINE, sizeof(broadcast_buffer_t));
+    buffer->capacity = capacity;
+    buffer->elem_size = elem_size;
+    buffer->data = (elem_size > 0) ? NULL : (void**) malloc(capacity * sizeof(void*));
+    buffer->values = (elem_size > 0) ? (unsigned char*) malloc(capacity * elem_size) : NULL;
+    pthread_mutex_init(&buffer->mutex, NULL);
+    buffer->cursors = list_create();
+    buffer->floor = 0;
+    atomic_init(&buffer->tail, 0);
+    return buffer;
+}
+
+// Starts reading the ring with cursor from the next message published
+void broadcast_buffer_subscribe(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void* owner)
+{
+    pthread_mutex_lock(&buffer->mutex);
+    // tail only moves under the mutex, and floor never passes it, so floor stays a lower bound
+    atomic_init(&cursor->head, atomic_load_explicit(&buffer->tail, memory_order_relaxed));
+    cursor->owner = owner;
+    list_insert(buffer->cursors, cursor);
+    pthread_mutex_unlock(&buffer->mutex);
+}
+
+// Stops reading the ring with cursor, releasing the slots it was holding back
+// Returns false if cursor wasn't subscribed
+bool broadcast_buffer_unsubscribe(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor)
+{
+    pthread_mutex_lock(&buffer->mutex);
+    bool subscribed = (list_find(buffer->cursors, cursor) != NULL);
+    if (subscribed) {
+        list_remove(buffer->cursors, cursor);
+    }
+    pthread_mutex_unlock(&buffer->mutex);
+    return subscribed;
+}
+
+// Returns the position of the slowest cursor, or tail if nobody is subscribed
+// Must be called with the mutex held
+size_t slowest_head(broadcast_buffer_t* buffer, size_t tail)
+{
+    size_t slowest = tail;
+    for (list_node_t* node = list_head(buffer->cursors); node != NULL; node = list_next(node)) {
+        broadcast_cursor_t* cursor = (broadcast_cursor_t*) list_data(node);
+        size_t head = atomic_load_explicit(&cursor->head, memory_order_acquire);
+        if (tail - head > tail - slowest) {
+            slowest = head;
+        }
+    }
+    return slowest;
+}
+
+// Returns the position the next message goes to, or false if the slowest cursor is a full ring behind
+// Must be called with the mutex held
+bool claim_publish(broadcast_buffer_t* buffer, size_t* pos)
+{
+    *pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    if (*pos - buffer->floor >= buffer->capacity) {
+        // looks full from our cached copy, refresh it before giving up
+        buffer->floor = slowest_head(buffer, *pos);
+        if (*pos - buffer->floor >= buffer->capacity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Adds the value into the buffer for every subscribed cursor
+// Safe to call concurrently with every other broadcast_buffer call
+// Returns BUFFER_SUCCESS if no cursor is a full ring behind and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_add(broadcast_buffer_t* buffer, void* data)
+{
+    size_t pos;
+    pthread_mutex_lock(&buffer->mutex);
+    if (!claim_publish(buffer, &pos)) {
+        pthread_mutex_unlock(&buffer->mutex);
+        return BUFFER_ERROR;
+    }
+    buffer->data[pos % buffer->capacity] = data;
+    atomic_store_explicit(&buffer->tail, pos + 1, memory_order_release);
+    pthread_mutex_unlock(&buffer->mutex);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the elem_size bytes at value into a typed buffer for every subscribed cursor
+// Safe to call concurrently with every other broadcast_buffer call
+// Returns BUFFER_SUCCESS if no cursor is a full ring behind and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_add_value(broadcast_buffer_t* buffer, const void* value)
+{
+    size_t pos;
+    pthread_mutex_lock(&buffer->mutex);
+    if (!claim_publish(buffer, &pos)) {
+        pthread_mutex_unlock(&buffer->mutex);
+        return BUFFER_ERROR;
+    }
+    memcpy(&buffer->values[(pos % buffer->capacity) * buffer->elem_size], value, buffer->elem_size);
+    atomic_store_explicit(&buffer->tail, pos + 1, memory_order_release);
+    pthread_mutex_unlock(&buffer->mutex);
+    return BUFFER_SUCCESS;
+}
+
+// Returns the position of the next message for cursor, or false if it has read everything published
+bool claim_read(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, size_t* pos)
+{
+    *pos = atomic_load_explicit(&cursor->head, memory_order_relaxed);
+    return *pos != atomic_load_explicit(&buffer->tail, memory_order_acquire);
+}
+
+// Reads the next value for cursor in FIFO order and stores it in data
+// Must only be called by one thread at a time per cursor
+// Returns BUFFER_SUCCESS if the cursor had an unread value
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_remove(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void** data)
+{
+    size_t pos;
+    if (!claim_read(buffer, cursor, &pos)) {
+        return BUFFER_ERROR;
+    }
+    *data = buffer->data[pos % buffer->capacity];
+    // the slot can be overwritten as soon as every cursor has stored a position past it
+    atomic_store_explicit(&cursor->head, pos + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the next message for cursor of a typed buffer into the elem_size bytes at value
+// Must only be called by one thread at a time per cursor
+// Returns BUFFER_SUCCESS if the cursor had an unread message
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_remove_value(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void* value)
+{
+    size_t pos;
+    if (!claim_read(buffer, cursor, &pos)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(value, &buffer->values[(pos % buffer->capacity) * buffer->elem_size], buffer->elem_size);
+    atomic_store_explicit(&cursor->head, pos + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+// Returns the number of messages published that cursor hasn't read yet
+// Only a snapshot when the publishers are running at the same time
+size_t broadcast_buffer_lag(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor)
+{
+    // head is read first so the difference can never be negative
+    size_t head = atomic_load(&cursor->head);
+    return atomic_load(&buffer->tail) - head;
+}
+
+// Returns the lag of the slowest subscribed cursor, 0 if there is none
+size_t broadcast_buffer_current_size(broadcast_buffer_t* buffer)
+{
+    pthread_mutex_lock(&buffer->mutex);
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t size = tail - slowest_head(buffer, tail);
+    pthread_mutex_unlock(&buffer->mutex);
+    return size;
+}
+
+// Frees the memory allocated to the buffer; the cursors belong to their subscribers
+void broadcast_buffer_free(broadcast_buffer_t* buffer)
+{
+    pthread_mutex_destroy(&buffer->mutex);
+    list_destroy(buffer->cursors);
+    free(buffer->values);
+    free(buffer->data);
+    free(buffer);
+}
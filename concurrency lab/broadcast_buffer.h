@@ -0,0 +1,80 @@
+#ifndef BROADCAST_BUFFER_H
+#define BROADCAST_BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "buffer.h"
+#include "linked_list.h"
+
+// A subscriber's read position in a broadcast ring
+// head is only written by the subscriber; owner is whatever the caller attached to the subscription
+typedef struct {
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t head;
+    void* owner;
+} broadcast_cursor_t;
+
+// Bounded single-write/many-read ring
+// Every message is written once, at tail, and every subscribed cursor reads it on its own, so a
+// message is only overwritten once the slowest cursor has moved past it. Subscribers never take
+// mutex: it serializes publishers and guards the cursor list. floor is the publishers' last seen
+// position of the slowest cursor, refreshed only when the ring looks full
+// A typed ring stores elem_size bytes per message in values instead of a pointer in data
+typedef struct {
+    size_t capacity;
+    void** data;
+    size_t elem_size;      // 0 for rings of pointers
+    unsigned char* values; // capacity * elem_size bytes, NULL for rings of pointers
+    pthread_mutex_t mutex;
+    list_t* cursors;
+    size_t floor;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t tail;
+} broadcast_buffer_t;
+
+// Creates a ring with the given capacity (at least 1) that stores messages of elem_size bytes inline,
+// or pointers if elem_size is 0
+broadcast_buffer_t* broadcast_buffer_create(size_t capacity, size_t elem_size);
+
+// Starts reading the ring with cursor from the next message published
+void broadcast_buffer_subscribe(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void* owner);
+
+// Stops reading the ring with cursor, releasing the slots it was holding back
+// Returns false if cursor wasn't subscribed
+bool broadcast_buffer_unsubscribe(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor);
+
+// Adds the value into the buffer for every subscribed cursor
+// Safe to call concurrently with every other broadcast_buffer call
+// Returns BUFFER_SUCCESS if no cursor is a full ring behind and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_add(broadcast_buffer_t* buffer, void* data);
+
+// Copies the elem_size bytes at value into a typed buffer for every subscribed cursor
+// Safe to call concurrently with every other broadcast_buffer call
+// Returns BUFFER_SUCCESS if no cursor is a full ring behind and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_add_value(broadcast_buffer_t* buffer, const void* value);
+
+// Reads the next value for cursor in FIFO order and stores it in data
+// Must only be called by one thread at a time per cursor
+// Returns BUFFER_SUCCESS if the cursor had an unread value
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_remove(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void** data);
+
+// Copies the next message for cursor of a typed buffer into the elem_size bytes at value
+// Must only be called by one thread at a time per cursor
+// Returns BUFFER_SUCCESS if the cursor had an unread message
+// Returns BUFFER_ERROR otherwise
+enum buffer_status broadcast_buffer_remove_value(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor, void* value);
+
+// Returns the number of messages published that cursor hasn't read yet
+// Only a snapshot when the publishers are running at the same time
+size_t broadcast_buffer_lag(broadcast_buffer_t* buffer, broadcast_cursor_t* cursor);
+
+// Returns the lag of the slowest subscribed cursor, 0 if there is none
+size_t broadcast_buffer_current_size(broadcast_buffer_t* buffer);
+
+// Frees the memory allocated to the buffer; the cursors belong to their subscribers
+void broadcast_buffer_free(broadcast_buffer_t* buffer);
+
+#endif // BROADCAST_BUFFER_H
@@ -1,55 +1,278 @@
 #include "buffer.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity)
 {
-    buffer_t* buffer = (buffer_t*) malloc(sizeof(buffer_t));
-    void** data  = (void**) malloc(capacity * sizeof(void*));
-    buffer->size = 0;
-    buffer->next = 0;
+    return buffer_create_typed(capacity, 0);
+}
+
+// Creates a buffer with the given capacity that stores messages of elem_size bytes inline
+buffer_t* buffer_create_typed(size_t capacity, size_t elem_size)
+{
+    buffer_t* buffer = (buffer_t*) aligned_alloc(BUFFER_CACHE_LINE, sizeof(buffer_t));
+    buffer_slot_t* slots = (buffer_slot_t*) malloc(capacity * sizeof(buffer_slot_t));
+    for (size_t i = 0; i < capacity; i++) {
+        // slot i is free for the producer that claims position i
+        atomic_init(&slots[i].seq, 2 * i);
+    }
     buffer->capacity = capacity;
-    buffer->data = data;
+    buffer->slots = slots;
+    buffer->items = (elem_size == 0) ? (void**) calloc(capacity, sizeof(void*)) : NULL;
+    buffer->elem_size = elem_size;
+    buffer->values = (elem_size > 0) ? (unsigned char*) malloc(capacity * elem_size) : NULL;
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
     return buffer;
 }
 
+// Claims the next position for a producer and stores it in pos
+// The producer must fill the slot and then call publish_add
+// Returns false if the buffer is full
+bool claim_add(buffer_t* buffer, size_t* pos)
+{
+    if (buffer->capacity == 0) {
+        return false;
+    }
+    *pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    while (true) {
+        buffer_slot_t* slot = &buffer->slots[*pos % buffer->capacity];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(2 * *pos);
+        if (diff == 0) {
+            // slot is free for this lap, try to claim the position
+            if (atomic_compare_exchange_weak_explicit(&buffer->tail, pos, *pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                return true;
+            }
+        } else if (diff < 0) {
+            // slot still holds the value from the previous lap
+            return false;
+        } else {
+            // another producer claimed the position first
+            *pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Hands a filled position over to consumers
+void publish_add(buffer_t* buffer, size_t pos)
+{
+    atomic_store_explicit(&buffer->slots[pos % buffer->capacity].seq, 2 * pos + 1, memory_order_release);
+}
+
+// Claims the oldest filled position for a consumer and stores it in pos
+// The consumer must read the slot and then call publish_remove
+// Returns false if the buffer is empty
+bool claim_remove(buffer_t* buffer, size_t* pos)
+{
+    if (buffer->capacity == 0) {
+        return false;
+    }
+    *pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    while (true) {
+        buffer_slot_t* slot = &buffer->slots[*pos % buffer->capacity];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(2 * *pos + 1);
+        if (diff == 0) {
+            // slot holds a value for this lap, try to claim the position
+            if (atomic_compare_exchange_weak_explicit(&buffer->head, pos, *pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                return true;
+            }
+        } else if (diff < 0) {
+            // slot has not been filled yet
+            return false;
+        } else {
+            // another consumer claimed the position first
+            *pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Frees a read position for the producer one lap ahead
+void publish_remove(buffer_t* buffer, size_t pos)
+{
+    atomic_store_explicit(&buffer->slots[pos % buffer->capacity].seq, 2 * (pos + buffer->capacity), memory_order_release);
+}
+
 // Adds the value into the buffer
+// Safe to call concurrently with other buffer_add/buffer_remove calls
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_add(buffer_t* buffer, void* data)
 {
-    if (buffer->size >= buffer->capacity) {
+    size_t pos;
+    if (!claim_add(buffer, &pos)) {
         return BUFFER_ERROR;
     }
-    size_t pos = buffer->next + buffer->size;
-    if (pos >= buffer->capacity) {
-        pos -= buffer->capacity;
-    }
-    buffer->data[pos] = data;
-    buffer->size++;
+    buffer->items[pos % buffer->capacity] = data;
+    publish_add(buffer, pos);
     return BUFFER_SUCCESS;
 }
 
 // Removes the value from the buffer in FIFO order and stores it in data
+// Safe to call concurrently with other buffer_add/buffer_remove calls
 // Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void **data)
 {
-    if (buffer->size > 0) {
-        *data = buffer->data[buffer->next];
-        buffer->size--;
-        buffer->next++;
-        if (buffer->next >= buffer->capacity) {
-            buffer->next -= buffer->capacity;
+    size_t pos;
+    if (!claim_remove(buffer, &pos)) {
+        return BUFFER_ERROR;
+    }
+    *data = buffer->items[pos % buffer->capacity];
+    publish_remove(buffer, pos);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the elem_size bytes at value into a typed buffer
+// Safe to call concurrently with other buffer_add_value/buffer_remove_value calls
+// Returns BUFFER_SUCCESS if the buffer is not full and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_add_value(buffer_t* buffer, const void* value)
+{
+    size_t pos;
+    if (!claim_add(buffer, &pos)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(&buffer->values[(pos % buffer->capacity) * buffer->elem_size], value, buffer->elem_size);
+    publish_add(buffer, pos);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the oldest message of a typed buffer into the elem_size bytes at value and removes it
+// Safe to call concurrently with other buffer_add_value/buffer_remove_value calls
+// Returns BUFFER_SUCCESS if the buffer is not empty and a message was copied out
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_remove_value(buffer_t* buffer, void* value)
+{
+    size_t pos;
+    if (!claim_remove(buffer, &pos)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(value, &buffer->values[(pos % buffer->capacity) * buffer->elem_size], buffer->elem_size);
+    publish_remove(buffer, pos);
+    return BUFFER_SUCCESS;
+}
+
+// Counts the consecutive slots starting at position pos whose seq matches the state we want
+// (2 * pos for free slots, 2 * pos + 1 for filled ones), up to max
+size_t count_ready_slots(buffer_t* buffer, size_t pos, size_t max, size_t filled)
+{
+    size_t count = 0;
+    if (max > buffer->capacity) {
+        max = buffer->capacity;
+    }
+    // walk the slot index alongside pos instead of dividing for every slot
+    size_t index = pos % buffer->capacity;
+    while (count < max) {
+        if (atomic_load_explicit(&buffer->slots[index].seq, memory_order_acquire) != 2 * (pos + count) + filled) {
+            break;
+        }
+        count++;
+        if (++index == buffer->capacity) {
+            index = 0;
+        }
+    }
+    return count;
+}
+
+// Stores seq values for the count slots starting at position pos, seq of position p being 2 * (p + offset) + filled,
+// so a run is handed over with one division instead of one per slot
+void publish_run(buffer_t* buffer, size_t pos, size_t count, size_t offset, size_t filled)
+{
+    size_t index = pos % buffer->capacity;
+    for (size_t i = 0; i < count; i++) {
+        atomic_store_explicit(&buffer->slots[index].seq, 2 * (pos + i + offset) + filled, memory_order_release);
+        if (++index == buffer->capacity) {
+            index = 0;
+        }
+    }
+}
+
+// Copies count items between the ring starting at position pos and data, splitting the copy where the run
+// wraps past the end of the ring
+void copy_run(buffer_t* buffer, size_t pos, void** data, size_t count, bool into_ring)
+{
+    size_t first = pos % buffer->capacity;
+    size_t run = buffer->capacity - first;
+    if (run > count) {
+        run = count;
+    }
+    if (into_ring) {
+        memcpy(&buffer->items[first], data, run * sizeof(void*));
+        memcpy(buffer->items, &data[run], (count - run) * sizeof(void*));
+    } else {
+        memcpy(data, &buffer->items[first], run * sizeof(void*));
+        memcpy(&data[run], buffer->items, (count - run) * sizeof(void*));
+    }
+}
+
+// Adds up to count values from data into the buffer in order, claiming all of their slots at once
+// Safe to call concurrently with other buffer_add/buffer_remove calls
+// Returns the number of values added, which is 0 if the buffer is full
+size_t buffer_add_batch(buffer_t* buffer, void** data, size_t count)
+{
+    if (buffer->capacity == 0 || count == 0) {
+        return 0;
+    }
+    size_t pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    while (true) {
+        size_t ready = count_ready_slots(buffer, pos, count, 0);
+        if (ready == 0) {
+            buffer_slot_t* slot = &buffer->slots[pos % buffer->capacity];
+            intptr_t diff = (intptr_t)atomic_load_explicit(&slot->seq, memory_order_acquire) - (intptr_t)(2 * pos);
+            if (diff < 0) {
+                return 0;
+            }
+            pos = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+            continue;
+        }
+        // one CAS claims the whole run of free slots
+        if (atomic_compare_exchange_weak_explicit(&buffer->tail, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed)) {
+            copy_run(buffer, pos, data, ready, true);
+            publish_run(buffer, pos, ready, 0, 1);
+            return ready;
+        }
+    }
+}
+
+// Removes up to max values from the buffer in FIFO order into data, claiming all of their slots at once
+// Safe to call concurrently with other buffer_add/buffer_remove calls
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t buffer_remove_batch(buffer_t* buffer, void** data, size_t max)
+{
+    if (buffer->capacity == 0 || max == 0) {
+        return 0;
+    }
+    size_t pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    while (true) {
+        size_t ready = count_ready_slots(buffer, pos, max, 1);
+        if (ready == 0) {
+            buffer_slot_t* slot = &buffer->slots[pos % buffer->capacity];
+            intptr_t diff = (intptr_t)atomic_load_explicit(&slot->seq, memory_order_acquire) - (intptr_t)(2 * pos + 1);
+            if (diff < 0) {
+                return 0;
+            }
+            pos = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+            continue;
+        }
+        // one CAS claims the whole run of filled slots
+        if (atomic_compare_exchange_weak_explicit(&buffer->head, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed)) {
+            copy_run(buffer, pos, data, ready, false);
+            publish_run(buffer, pos, ready, buffer->capacity, 0);
+            return ready;
         }
-        return BUFFER_SUCCESS;
     }
-    return BUFFER_ERROR;
 }
 
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t *buffer)
 {
-    free(buffer->data);
+    free(buffer->values);
+    free(buffer->items);
+    free(buffer->slots);
     free(buffer);
 }
 
@@ -60,14 +283,19 @@ size_t buffer_capacity(buffer_t* buffer)
 }
 
 // Returns the current number of elements in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
 size_t buffer_current_size(buffer_t* buffer)
 {
-    return buffer->size;
+    // head is read first so the difference can never be negative
+    size_t head = atomic_load(&buffer->head);
+    size_t tail = atomic_load(&buffer->tail);
+    size_t size = tail - head;
+    return size > buffer->capacity ? buffer->capacity : size;
 }
 
 // Peeks at a value in the buffer
 // Only used for testing code; you should NOT use this
 void* peek_buffer(buffer_t* buffer, size_t index)
 {
-    return buffer->data[index];
+    return buffer->items[index];
 }
@@ -2,12 +2,33 @@
 #define BUFFER_H
 
 #include <stdlib.h>
+#include <stdatomic.h>
 
+#define BUFFER_CACHE_LINE 64
+
+// A slot in the ring; seq tells producers and consumers whose turn it is to use the slot
+// seq is 2 * pos while the slot is free for the producer of position pos and 2 * pos + 1 once
+// it holds that producer's value, so a full slot is never mistaken for a free one even when
+// the capacity is 1
+typedef struct {
+    atomic_size_t seq;
+} buffer_slot_t;
+
+// Bounded lock-free multi-producer/multi-consumer ring
+// Producers claim positions from tail and consumers claim positions from head; the two
+// counters live on separate cache lines so producers and consumers don't bounce each other
+// Pointers live in items, apart from the slot seqs, so a batch of consecutive positions is one contiguous
+// run of items that can be copied with memcpy
+// A typed buffer (buffer_create_typed) copies elem_size bytes per message into values instead of
+// storing a pointer in items
 typedef struct {
-    size_t size;
-    size_t next;
     size_t capacity;
-    void** data;
+    buffer_slot_t* slots;
+    void** items;          // capacity pointers, NULL for typed buffers
+    size_t elem_size;      // 0 for buffers of pointers
+    unsigned char* values; // capacity * elem_size bytes, NULL for buffers of pointers
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t head;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t tail;
 } buffer_t;
 
 enum buffer_status {
@@ -18,16 +39,43 @@ enum buffer_status {
 // Creates a buffer with the given capacity
 buffer_t* buffer_create(size_t capacity);
 
+// Creates a buffer with the given capacity that stores messages of elem_size bytes inline
+buffer_t* buffer_create_typed(size_t capacity, size_t elem_size);
+
 // Adds the value into the buffer
+// Safe to call concurrently with other buffer_add/buffer_remove calls
 // Returns BUFFER_SUCCESS if the buffer is not full and value was added
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_add(buffer_t* buffer, void* data);
 
 // Removes the value from the buffer in FIFO order and stores it in data
+// Safe to call concurrently with other buffer_add/buffer_remove calls
 // Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
 // Returns BUFFER_ERROR otherwise
 enum buffer_status buffer_remove(buffer_t* buffer, void** data);
 
+// Copies the elem_size bytes at value into a typed buffer
+// Safe to call concurrently with other buffer_add_value/buffer_remove_value calls
+// Returns BUFFER_SUCCESS if the buffer is not full and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_add_value(buffer_t* buffer, const void* value);
+
+// Copies the oldest message of a typed buffer into the elem_size bytes at value and removes it
+// Safe to call concurrently with other buffer_add_value/buffer_remove_value calls
+// Returns BUFFER_SUCCESS if the buffer is not empty and a message was copied out
+// Returns BUFFER_ERROR otherwise
+enum buffer_status buffer_remove_value(buffer_t* buffer, void* value);
+
+// Adds up to count values from data into the buffer in order, claiming all of their slots at once
+// Safe to call concurrently with other buffer_add/buffer_remove calls
+// Returns the number of values added, which is 0 if the buffer is full
+size_t buffer_add_batch(buffer_t* buffer, void** data, size_t count);
+
+// Removes up to max values from the buffer in FIFO order into data, claiming all of their slots at once
+// Safe to call concurrently with other buffer_add/buffer_remove calls
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t buffer_remove_batch(buffer_t* buffer, void** data, size_t max);
+
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t* buffer);
 
@@ -35,6 +83,7 @@ void buffer_free(buffer_t* buffer);
 size_t buffer_capacity(buffer_t* buffer);
 
 // Returns the current number of elements in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
 size_t buffer_current_size(buffer_t* buffer);
 
 // Peeks at a value in the buffer
@@ -1,398 +1,2208 @@
 #include "channel.h"
+#include "channel_stats.h"
+#include <stdint.h>
+#include <time.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
 
-bool is_buffer_full(buffer_t* buffer)
+bool is_channel_open(channel_t* channel)
 {
-    if (buffer->size >= buffer->capacity)
+    if (channel->kind == CHANNEL_SHM)
     {
-        return true;
+        return shm_buffer_is_open(channel->shm);
     }
+    return atomic_load(&channel->open);
+}
 
-    else 
-    {
-        return false;
-    }
+// Returns a monotonic timestamp in nanoseconds
+uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Returns the calling thread's shard of the channel's counters
+channel_stats_shard_t* stats_shard(channel_t* channel)
+{
+    uint64_t hash = (uint64_t)pthread_self() * 0x9E3779B97F4A7C15ull;
+    return &channel->stats[hash >> (64 - CHANNEL_STATS_SHARD_BITS)];
 }
 
-bool is_buffer_empty(buffer_t* buffer)
+// Returns the number of messages currently queued in the channel
+size_t channel_depth(channel_t* channel)
 {
-    if (buffer->size == 0)
+    if (channel->kind == CHANNEL_SPSC)
     {
-        return true;
+        return spsc_buffer_current_size(channel->spsc);
     }
-    
-    else 
+    if (channel->kind == CHANNEL_BROADCAST)
     {
-        return false;
+        return broadcast_buffer_current_size(channel->broadcast);
+    }
+    if (channel->kind == CHANNEL_SUBSCRIBER)
+    {
+        return broadcast_buffer_lag(channel->broadcast, channel->cursor);
+    }
+    if (channel->kind == CHANNEL_SHM)
+    {
+        return shm_buffer_current_size(channel->shm);
     }
+    if (channel->kind == CHANNEL_SHARDED)
+    {
+        return sharded_buffer_current_size(channel->sharded);
+    }
+    if (channel->kind == CHANNEL_PRIORITY)
+    {
+        return priority_buffer_current_size(channel->priority);
+    }
+    if (channel->kind == CHANNEL_ELASTIC)
+    {
+        return elastic_buffer_current_size(channel->elastic);
+    }
+    return buffer_current_size(channel->buffer);
 }
 
-bool is_channel_open(channel_t* channel)
+// Counts count completed operations in the given direction and samples the queue depth they left
+void stats_record(channel_t* channel, enum direction dir, size_t count)
 {
-    return channel->open;
-}
+    if (channel->stats == NULL)
+    {
+        return;
+    }
+    channel_stats_shard_t* shard = stats_shard(channel);
+    atomic_fetch_add_explicit((dir == SEND) ? &shard->sends : &shard->receives, count, memory_order_relaxed);
 
-void wake_up_send(channel_t* channel)
-{
-    list_node_t* node = list_head(channel->send_list);
-    while (node != NULL)
+    size_t depth = channel_depth(channel);
+    size_t bucket = (depth == 0) ? 0 : (size_t)(64 - __builtin_clzll((unsigned long long)depth));
+    if (bucket >= CHANNEL_STATS_BUCKETS)
     {
-        sem_post((sem_t*)list_data(node));
-        node = list_next(node);
+        bucket = CHANNEL_STATS_BUCKETS - 1;
     }
+    atomic_fetch_add_explicit(&shard->depth[bucket], 1, memory_order_relaxed);
 }
 
-void wake_up_recv(channel_t* channel)
+// Counts an operation in the given direction that had to park for blocked_ns
+void stats_record_blocked(channel_t* channel, enum direction dir, uint64_t blocked_ns)
 {
-    list_node_t* node = list_head(channel->recv_list);
-    while (node != NULL)
+    if (channel->stats == NULL)
     {
-        sem_post((sem_t*)list_data(node));
-        node = list_next(node);
+        return;
     }
+    channel_stats_shard_t* shard = stats_shard(channel);
+    atomic_fetch_add_explicit((dir == SEND) ? &shard->blocked_sends : &shard->blocked_receives, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->blocked_ns, blocked_ns, memory_order_relaxed);
 }
 
-void wake_one(list_t* list)
+// Counts a readiness token from the channel that woke a select which then found nothing to do
+void stats_record_spurious(channel_t* channel)
 {
-    list_node_t* node = list_head(list);
-    if (node != NULL)
+    if (channel->stats == NULL)
     {
-        sem_post((sem_t*)list_data(node));
+        return;
     }
+    atomic_fetch_add_explicit(&stats_shard(channel)->spurious_wakeups, 1, memory_order_relaxed);
 }
 
-
-// Creates a new channel with the provided size and returns it to the caller
-channel_t* channel_create(size_t size)
+// Adds data to whichever ring backs the channel, at the given priority if it is a priority channel
+enum buffer_status channel_buffer_add(channel_t* channel, void* data, unsigned priority)
 {
-    channel_t* channel = (channel_t*)malloc(sizeof(channel_t));
-
-    channel->send_list = list_create();
-    channel->recv_list = list_create();
-
-    channel->open = true;
-    channel->buffer = buffer_create(size);
-    channel->send_count = 0;
-    channel->receive_count = 0;
-
-    sem_init(&channel->sem_send, 0, (unsigned int)size); 
-    sem_init(&channel->sem_receive, 0, 0); // Value of 0 indicates locked, can't receive initially
-    
-    pthread_mutex_init(&channel->mutex, NULL);
-
-    return channel;
-}
-
-// Writes data to the given channel
-// This is a blocking call i.e., the function only returns on a successful completion of send
-// In case the channel is full, the function waits till the channel has space to write the new data
-// Returns SUCCESS for successfully writing data to the channel,
-// CLOSED_ERROR if the channel is closed, and
-// GENERIC_ERROR on encountering any other generic error of any sort
-enum channel_status channel_send(channel_t *channel, void* data)
-{    
-    pthread_mutex_lock(&channel->mutex);
-
-    if (is_channel_open(channel) == false) 
+    enum buffer_status status;
+    if (channel->kind == CHANNEL_BROADCAST)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CLOSED_ERROR;
+        status = (channel->elem_size > 0) ? broadcast_buffer_add_value(channel->broadcast, data)
+                                          : broadcast_buffer_add(channel->broadcast, data);
     }
-
-    while (is_buffer_full(channel->buffer))
+    else if (channel->kind == CHANNEL_SHM)
     {
-        channel->send_count++;
-        pthread_mutex_unlock(&channel->mutex);
-        sem_wait(&channel->sem_send);
-        pthread_mutex_lock(&channel->mutex);
-        channel->send_count--;
-
-        if (is_channel_open(channel) == false) 
-        {
-            pthread_mutex_unlock(&channel->mutex);
-            return CLOSED_ERROR;
-        }
+        status = shm_buffer_add_value(channel->shm, data);
     }
-
-    //if adding data to buffer fails
-    if (buffer_add(channel->buffer, data) == BUFFER_ERROR)
+    else if (channel->kind == CHANNEL_SHARDED)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return GENERIC_ERROR;
+        status = sharded_buffer_add(channel->sharded, data);
+    }
+    else if (channel->kind == CHANNEL_PRIORITY)
+    {
+        status = priority_buffer_add(channel->priority, data, priority);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        status = elastic_buffer_add(channel->elastic, data);
+    }
+    else if (channel->elem_size > 0)
+    {
+        status = buffer_add_value(channel->buffer, data);
+    }
+    else if (channel->kind == CHANNEL_SPSC)
+    {
+        status = spsc_buffer_add(channel->spsc, data);
     }
-
-    //if adding data to buffer succeeds
     else
     {
-        wake_up_recv(channel);
-        sem_post(&channel->sem_receive); //increment sem_receive
-        pthread_mutex_unlock(&channel->mutex);
-        return SUCCESS;
+        status = buffer_add(channel->buffer, data);
+    }
+    if (status == BUFFER_SUCCESS)
+    {
+        stats_record(channel, SEND, 1);
     }
+    return status;
 }
 
-// Reads data from the given channel and stores it in the function's input parameter, data (Note that it is a double pointer)
-// This is a blocking call i.e., the function only returns on a successful completion of receive
-// In case the channel is empty, the function waits till the channel has some data to read
-// Returns SUCCESS for successful retrieval of data,
-// CLOSED_ERROR if the channel is closed, and
-// GENERIC_ERROR on encountering any other generic error of any sort
-enum channel_status channel_receive(channel_t* channel, void** data)
+// Removes data from whichever ring backs the channel
+enum buffer_status channel_buffer_remove(channel_t* channel, void** data)
 {
-    pthread_mutex_lock(&channel->mutex);
-
-    if (is_channel_open(channel) == false) 
+    enum buffer_status status;
+    if (channel->kind == CHANNEL_SUBSCRIBER)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CLOSED_ERROR;
+        status = (channel->elem_size > 0) ? broadcast_buffer_remove_value(channel->broadcast, channel->cursor, *data)
+                                          : broadcast_buffer_remove(channel->broadcast, channel->cursor, data);
     }
-    
-    while (is_buffer_empty(channel->buffer))
+    else if (channel->kind == CHANNEL_SHM)
     {
-        channel->receive_count++;
-        pthread_mutex_unlock(&channel->mutex);
-        sem_wait(&channel->sem_receive);
-        pthread_mutex_lock(&channel->mutex);
-        channel->receive_count--;
-
-        if (is_channel_open(channel) == false) 
-        {
-            pthread_mutex_unlock(&channel->mutex);
-            return CLOSED_ERROR;
-        }
+        status = shm_buffer_remove_value(channel->shm, *data);
     }
-    
-    //if removing data from buffer fails
-    if (buffer_remove(channel->buffer, data) == BUFFER_ERROR)
+    else if (channel->kind == CHANNEL_SHARDED)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return GENERIC_ERROR;
+        status = sharded_buffer_remove(channel->sharded, data);
+    }
+    else if (channel->kind == CHANNEL_PRIORITY)
+    {
+        status = priority_buffer_remove(channel->priority, data);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        status = elastic_buffer_remove(channel->elastic, data);
+    }
+    else if (channel->elem_size > 0)
+    {
+        //data points to where the caller wants the value copied
+        status = buffer_remove_value(channel->buffer, *data);
+    }
+    else if (channel->kind == CHANNEL_SPSC)
+    {
+        status = spsc_buffer_remove(channel->spsc, data);
     }
-
-    //if removing data from buffer succeeds
     else
     {
-        wake_up_send(channel);
-        sem_post(&channel->sem_send); //increment sem_send
-        pthread_mutex_unlock(&channel->mutex);
-        return SUCCESS;
+        status = buffer_remove(channel->buffer, data);
     }
+    if (status == BUFFER_SUCCESS)
+    {
+        stats_record(channel, RECV, 1);
+    }
+    return status;
 }
 
-// Writes data to the given channel
-// This is a non-blocking call i.e., the function simply returns if the channel is full
-// Returns SUCCESS for successfully writing data to the channel,
-// CHANNEL_FULL if the channel is full and the data was not added to the buffer,
-// CLOSED_ERROR if the channel is closed, and
-// GENERIC_ERROR on encountering any other generic error of any sort
-enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
+// Adds up to count values to whichever ring backs the channel
+size_t channel_buffer_add_batch(channel_t* channel, void** data, size_t count)
 {
-    pthread_mutex_lock(&channel->mutex);
-
-    if (is_channel_open(channel) == false)
+    size_t added;
+    if (channel->kind == CHANNEL_SPSC)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CLOSED_ERROR;
+        added = spsc_buffer_add_batch(channel->spsc, data, count);
     }
-
-    if (is_buffer_full(channel->buffer))
+    else if (channel->kind == CHANNEL_SHARDED)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CHANNEL_FULL;
+        added = sharded_buffer_add_batch(channel->sharded, data, count);
     }
-
-    if (buffer_add(channel->buffer, data) == BUFFER_ERROR)
+    else if (channel->kind == CHANNEL_PRIORITY)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return GENERIC_ERROR;
+        added = priority_buffer_add_batch(channel->priority, data, count, 0);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        added = elastic_buffer_add_batch(channel->elastic, data, count);
     }
     else
     {
-        wake_up_recv(channel);
-        sem_post(&channel->sem_receive); //increment sem_receive
-        pthread_mutex_unlock(&channel->mutex);
-        return SUCCESS;
+        added = buffer_add_batch(channel->buffer, data, count);
+    }
+    if (added > 0)
+    {
+        stats_record(channel, SEND, added);
     }
-    
+    return added;
 }
 
-// Reads data from the given channel and stores it in the function's input parameter data (Note that it is a double pointer)
-// This is a non-blocking call i.e., the function simply returns if the channel is empty
-// Returns SUCCESS for successful retrieval of data,
-// CHANNEL_EMPTY if the channel is empty and nothing was stored in data,
-// CLOSED_ERROR if the channel is closed, and
-// GENERIC_ERROR on encountering any other generic error of any sort
-enum channel_status channel_non_blocking_receive(channel_t* channel, void** data)
+// Removes up to max values from whichever ring backs the channel
+size_t channel_buffer_remove_batch(channel_t* channel, void** data, size_t max)
 {
-    pthread_mutex_lock(&channel->mutex);
-
-    if (is_channel_open(channel) == false)
+    size_t removed;
+    if (channel->kind == CHANNEL_SPSC)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CLOSED_ERROR;
+        removed = spsc_buffer_remove_batch(channel->spsc, data, max);
     }
-
-    if (is_buffer_empty(channel->buffer))
+    else if (channel->kind == CHANNEL_SHARDED)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return CHANNEL_EMPTY;
+        removed = sharded_buffer_remove_batch(channel->sharded, data, max);
     }
-
-    if (buffer_remove(channel->buffer, data) == BUFFER_ERROR)
+    else if (channel->kind == CHANNEL_PRIORITY)
     {
-        pthread_mutex_unlock(&channel->mutex);
-        return GENERIC_ERROR;
+        removed = priority_buffer_remove_batch(channel->priority, data, max);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        removed = elastic_buffer_remove_batch(channel->elastic, data, max);
     }
     else
     {
-        wake_up_send(channel);
-        sem_post(&channel->sem_send); //increment sem_send
-        pthread_mutex_unlock(&channel->mutex);
-        return SUCCESS;
+        removed = buffer_remove_batch(channel->buffer, data, max);
+    }
+    if (removed > 0)
+    {
+        stats_record(channel, RECV, removed);
     }
+    return removed;
 }
 
-// Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
-// Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
-// Returns SUCCESS if close is successful,
-// CLOSED_ERROR if the channel is already closed, and
-// GENERIC_ERROR in any other error case
-enum channel_status channel_close(channel_t* channel)
+// Relaxes the CPU inside a spin loop
+void cpu_relax()
 {
-    pthread_mutex_lock(&channel->mutex);
-
-    if (is_channel_open(channel) == false)
-    {
-        pthread_mutex_unlock(&channel->mutex);
-        return CLOSED_ERROR;
-    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
 
-    else 
+// Takes one posted token from the parker, if there is one
+bool parker_try_take(channel_parker_t* parker)
+{
+    unsigned value = atomic_load(&parker->value);
+    while (value > 0)
     {
-        //close the channel
-        channel->open = false; 
-
-        //unlock both semaphores by calling sem_post until they are unlocked
-                
-        wake_up_recv(channel);
-        wake_up_send(channel);
-        
-        for (int x = 0; x < channel->send_count; x++)
-        {
-            sem_post(&channel->sem_send);
-        }
-
-        for (int x = 0; x < channel->receive_count; x++)
+        if (atomic_compare_exchange_weak(&parker->value, &value, value - 1))
         {
-            sem_post(&channel->sem_receive);
+            return true;
         }
-                
-        pthread_mutex_unlock(&channel->mutex);
-        return SUCCESS;
     }
+    return false;
 }
 
-// Frees all the memory allocated to the channel
-// The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
-// Returns SUCCESS if destroy is successful,
-// DESTROY_ERROR if channel_destroy is called on an open channel, and
-// GENERIC_ERROR in any other error case
-enum channel_status channel_destroy(channel_t* channel)
+// Posts a token to the parker and wakes its owner if it may be asleep
+// Callers hold the mutex of the channel the owner is queued on, so the owner (which takes that
+// mutex before its select returns) can't have released the parker yet
+void parker_post(channel_parker_t* parker)
 {
-    //make sure the channel is closed before it gets destroyed
-    if (is_channel_open(channel) == true)
+    if (parker->fd >= 0)
     {
-        return DESTROY_ERROR;
+        //a readiness fd: whoever polls it reads the token back out of the eventfd
+        uint64_t token = 1;
+        ssize_t written = write(parker->fd, &token, sizeof(token));
+        (void)written;
+        return;
     }
-
-    pthread_mutex_destroy(&channel->mutex);
-    
-    sem_destroy(&channel->sem_receive);
-    sem_destroy(&channel->sem_send);
-    
-    buffer_free(channel->buffer);
-
-    list_destroy(channel->send_list);
-    list_destroy(channel->recv_list);
-    free(channel);
-    
-    return SUCCESS;
+    atomic_fetch_add(&parker->value, 1);
+    if (atomic_load(&parker->sleepers) > 0)
+    {
+        syscall(SYS_futex, &parker->value, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    fiber_unpark(&parker->fiber);
 }
 
-void insert_sem(select_t* channel_list, size_t channel_count, void* data)
+// Waits for a token on the parker: spins for up to budget nanoseconds while open stays true,
+// then yields CHANNEL_YIELDS times, then sleeps on the futex until a token is posted
+// A fiber parks straight away so its thread can run other fibers, and open is only read while spinning
+// Returns how many nanoseconds it took for the token to arrive, or 0 if budget is 0 (the wait isn't timed)
+uint64_t parker_wait(channel_parker_t* parker, unsigned budget, atomic_bool* open)
 {
-    for (size_t index = 0; index < channel_count; index++)
+    if (fiber_current() != NULL)
     {
-        pthread_mutex_lock(&channel_list[index].channel->mutex);
+        while (parker_try_take(parker) == false)
+        {
+            fiber_park(&parker->fiber, &parker->value);
+        }
+        return 0;
+    }
 
-        if (channel_list[index].dir == SEND)
+    uint64_t start = (budget > 0) ? now_ns() : 0;
+    while (budget > 0 && atomic_load_explicit(open, memory_order_relaxed))
+    {
+        if (atomic_load_explicit(&parker->value, memory_order_relaxed) > 0 && parker_try_take(parker))
+        {
+            return now_ns() - start;
+        }
+        cpu_relax();
+        if (now_ns() - start >= budget)
         {
-            list_insert(channel_list[index].channel->send_list, data);
+            break;
         }
-        else if (channel_list[index].dir == RECV)
+    }
+    for (unsigned yield = 0; yield < CHANNEL_YIELDS; yield++)
+    {
+        if (parker_try_take(parker))
         {
-            list_insert(channel_list[index].channel->recv_list, data);
+            return (budget > 0) ? now_ns() - start : 0;
         }
-        pthread_mutex_unlock(&channel_list[index].channel->mutex);
+        sched_yield();
+    }
+
+    //the fetch_add pairs with the load in parker_post: either it sees us or we see its token
+    atomic_fetch_add(&parker->sleepers, 1);
+    while (parker_try_take(parker) == false)
+    {
+        syscall(SYS_futex, &parker->value, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
     }
+    atomic_fetch_sub(&parker->sleepers, 1);
+    return (budget > 0) ? now_ns() - start : 0;
 }
 
-void remove_sem(select_t* channel_list, size_t channel_count, void* data)
+// Feeds how long a wait took back into the channel's spin budget: a wait that ended within the spin limit
+// pulls the budget towards twice its length, so the next wait like it ends while spinning, and a longer
+// wait (one that spinning could not have saved) halves it
+void tune_spin(channel_t* channel, uint64_t waited)
 {
-    for (size_t index = 0; index < channel_count; index++)
+    unsigned budget = atomic_load_explicit(&channel->spin_budget, memory_order_relaxed);
+    uint64_t next = (waited > channel->spin_limit) ? budget / 2 : (budget + 2 * waited) / 2;
+    if (next < CHANNEL_SPIN_MIN)
     {
-        pthread_mutex_lock(&channel_list[index].channel->mutex);
-
-        list_remove(channel_list[index].channel->send_list, data);
-        list_remove(channel_list[index].channel->recv_list, data);
-
-        pthread_mutex_unlock(&channel_list[index].channel->mutex);
+        next = CHANNEL_SPIN_MIN;
+    }
+    if (next > channel->spin_limit)
+    {
+        next = channel->spin_limit;
     }
+    atomic_store_explicit(&channel->spin_budget, (unsigned)next, memory_order_relaxed);
 }
 
-// Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
-// This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
-// If multiple options are available, it selects the first option and performs its corresponding action
-// If no channel is available, the call is blocked and waits till it finds a channel which supports its required operation
-// Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
-// In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
-// Additionally, selected_index is set to the index of the channel that generated the error
-enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index)
+// Returns the wait queue and its length counter for the given direction
+channel_waiter_queue_t* waiter_list(channel_t* channel, enum direction dir)
 {
-    /*
-    first we go through the channel_list and see if any channel can perform an operation
-    if a channel does an operation then return
-    */
-
-    int val = SUCCESS;
-    sem_t sem;
-    sem_init(&sem, 0, 0);
+    return (dir == SEND) ? &channel->send_list : &channel->recv_list;
+}
 
-    insert_sem(channel_list, channel_count, &sem);
+atomic_size_t* waiter_count(channel_t* channel, enum direction dir)
+{
+    return (dir == SEND) ? &channel->send_waiters : &channel->recv_waiters;
+}
 
-    //insert sem into the list of all channels
-    while (true)
+// Appends a waiter to the tail of a wait queue
+void waiter_queue_push(channel_waiter_queue_t* queue, channel_waiter_t* waiter)
+{
+    waiter->prev = queue->tail;
+    waiter->next = NULL;
+    if (queue->tail != NULL)
     {
-        for (size_t index = 0; index < channel_count; index++)
-        {
-            if (channel_list[index].dir == SEND)
-            {
-                val = channel_non_blocking_send(channel_list[index].channel, channel_list[index].data);
-            }
-            else if (channel_list[index].dir == RECV)
-            {
-                val = channel_non_blocking_receive(channel_list[index].channel, &channel_list[index].data);
-            }
+        queue->tail->next = waiter;
+    }
+    else
+    {
+        queue->head = waiter;
+    }
+    queue->tail = waiter;
+}
 
-            if (val == SUCCESS || val == CLOSED_ERROR || val == GENERIC_ERROR)
-            {
-                //need to remove sem from every channel's select, send, and recv list
-                remove_sem(channel_list, channel_count, &sem);
-                sem_destroy(&sem);
+// Unlinks a waiter from anywhere in the wait queue it is in
+void waiter_queue_unlink(channel_waiter_queue_t* queue, channel_waiter_t* waiter)
+{
+    if (waiter->prev != NULL)
+    {
+        waiter->prev->next = waiter->next;
+    }
+    else
+    {
+        queue->head = waiter->next;
+    }
+    if (waiter->next != NULL)
+    {
+        waiter->next->prev = waiter->prev;
+    }
+    else
+    {
+        queue->tail = waiter->prev;
+    }
+    waiter->prev = NULL;
+    waiter->next = NULL;
+}
 
-                *selected_index = index;
-                return val;
-            }
-        }  
-        sem_wait(&sem);
+// Counts a waiter joining (queued) or leaving the given wait queue
+// A subscriber's receivers also count towards its broadcast channel, so a send only looks at its
+// subscribers when one of them may have a receiver asleep
+void count_waiter(channel_t* channel, enum direction dir, bool queued)
+{
+    if (queued)
+    {
+        atomic_fetch_add(waiter_count(channel, dir), 1);
     }
-}
\ No newline at end of file
+    else
+    {
+        atomic_fetch_sub(waiter_count(channel, dir), 1);
+    }
+    if (channel->kind == CHANNEL_SUBSCRIBER && dir == RECV)
+    {
+        count_waiter(channel->publisher, RECV, queued);
+    }
+}
+
+// Appends an entry to the set's ready queue unless it is already there
+// Must be called with the set's mutex held
+void ready_push(select_set_t* set, size_t index)
+{
+    if (set->queued[index])
+    {
+        return;
+    }
+    set->ready[(set->ready_head + set->ready_count) % set->channel_count] = index;
+    set->ready_count++;
+    set->queued[index] = true;
+    if (set->sleeping)
+    {
+        set->sleeping = false;
+        parker_post(&set->parker);
+    }
+}
+
+// Reports a possibly ready entry to its select set
+// Returns true if the set took the readiness token, which it only does while its owner is waiting
+// and doesn't hold a token for the entry yet
+bool select_set_notify(select_set_t* set, size_t index)
+{
+    pthread_mutex_lock(&set->mutex);
+    bool took = false;
+    if (set->waiting && set->enabled[index] && set->token[index] == false)
+    {
+        set->token[index] = true;
+        took = true;
+    }
+    ready_push(set, index);
+    pthread_mutex_unlock(&set->mutex);
+    return took;
+}
+
+// Hands readiness tokens to up to count of the oldest waiters in the given direction, one token each
+// Only takes the mutex when the queue is non-empty; the fence pairs with the one in add_waiter so
+// either the waiter's re-check sees our buffer change or we see the waiter in the queue
+void wake_many(channel_t* channel, enum direction dir, size_t count)
+{
+    if (channel->kind == CHANNEL_SUBSCRIBER && dir == SEND)
+    {
+        //a receive on a subscriber frees room for the senders of its broadcast channel
+        channel = channel->publisher;
+    }
+    if (channel->kind == CHANNEL_SHARDED && channel->sharded->fifo && channel->sharded->lanes > 1 && dir == SEND)
+    {
+        //the freed slots may be in any lane, and a blocked sender can only use its own, so every
+        //sender has to look; it only costs anything once some producer's lane has filled up
+        count = SIZE_MAX;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiter_count(channel, dir), memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    if (channel->kind == CHANNEL_BROADCAST && dir == RECV)
+    {
+        //every subscriber got its own copy of the messages, so each of them gets count tokens
+        //(the ring's mutex keeps subscribers from leaving while we walk them)
+        pthread_mutex_lock(&channel->broadcast->mutex);
+        for (list_node_t* node = list_head(channel->broadcast->cursors); node != NULL; node = list_next(node))
+        {
+            broadcast_cursor_t* cursor = (broadcast_cursor_t*)list_data(node);
+            wake_many((channel_t*)cursor->owner, RECV, count);
+        }
+        pthread_mutex_unlock(&channel->broadcast->mutex);
+        return;
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    channel_waiter_queue_t* list = waiter_list(channel, dir);
+    channel_waiter_t* waiter = list->head;
+    while (waiter != NULL && count > 0)
+    {
+        channel_waiter_t* next = waiter->next;
+        if (waiter->set != NULL)
+        {
+            //select sets stay queued and only use up a token while their owner is waiting
+            if (select_set_notify(waiter->set, waiter->index))
+            {
+                atomic_fetch_add_explicit(&channel->wakeups, 1, memory_order_relaxed);
+                count--;
+            }
+        }
+        else
+        {
+            //a readiness fd only tells its poller to look, the token stays for the next waiter
+            bool event = (waiter->parker->fd >= 0);
+            waiter_queue_unlink(list, waiter);
+            count_waiter(channel, dir, false);
+            waiter->notified = true;
+            parker_post(waiter->parker);
+            if (event == false)
+            {
+                atomic_fetch_add_explicit(&channel->wakeups, 1, memory_order_relaxed);
+                count--;
+            }
+        }
+        waiter = next;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+// Hands a readiness token to the oldest waiter in the given direction, if there is one
+void wake_one(channel_t* channel, enum direction dir)
+{
+    wake_many(channel, dir, 1);
+}
+
+// Wakes one waiting sender after a slot was freed
+void wake_up_send(channel_t* channel)
+{
+    wake_one(channel, SEND);
+}
+
+// Wakes one waiting receiver after a value was added
+void wake_up_recv(channel_t* channel)
+{
+    wake_one(channel, RECV);
+}
+
+// Hands a token to every waiter in the given direction
+// Must be called with the mutex held
+void wake_all(channel_t* channel, enum direction dir)
+{
+    channel_waiter_queue_t* list = waiter_list(channel, dir);
+    channel_waiter_t* waiter = list->head;
+    while (waiter != NULL)
+    {
+        channel_waiter_t* next = waiter->next;
+        if (waiter->set != NULL)
+        {
+            select_set_notify(waiter->set, waiter->index);
+        }
+        else
+        {
+            waiter_queue_unlink(list, waiter);
+            count_waiter(channel, dir, false);
+            waiter->notified = true;
+            parker_post(waiter->parker);
+        }
+        waiter = next;
+    }
+}
+
+// Reports every select set entry (except those of the set skip) and readiness fd in the given direction as possibly ready
+// Used when a partner parks on a rendezvous channel, since the set may have polled before the partner could be completed
+// and a readiness fd is never handed a message
+// Must be called with the mutex held
+void wake_sets(channel_t* channel, enum direction dir, select_set_t* skip)
+{
+    channel_waiter_queue_t* list = waiter_list(channel, dir);
+    channel_waiter_t* waiter = list->head;
+    while (waiter != NULL)
+    {
+        channel_waiter_t* next = waiter->next;
+        if (waiter->set != NULL)
+        {
+            if (waiter->set != skip)
+            {
+                select_set_notify(waiter->set, waiter->index);
+            }
+        }
+        else if (waiter->parker->fd >= 0)
+        {
+            waiter_queue_unlink(list, waiter);
+            count_waiter(channel, dir, false);
+            waiter->notified = true;
+            parker_post(waiter->parker);
+        }
+        waiter = next;
+    }
+}
+
+// Appends a waiter to the FIFO queue before its owner re-checks the buffer
+// Must be called with the mutex held
+void add_waiter_locked(channel_t* channel, enum direction dir, channel_waiter_t* waiter)
+{
+    waiter->notified = false;
+    waiter_queue_push(waiter_list(channel, dir), waiter);
+    count_waiter(channel, dir, true);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void add_waiter(channel_t* channel, enum direction dir, channel_waiter_t* waiter)
+{
+    pthread_mutex_lock(&channel->mutex);
+    add_waiter_locked(channel, dir, waiter);
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+// Takes a waiter back out of the queue unless a channel already did so to wake it
+// Returns true if the waiter was handed a token
+bool remove_waiter(channel_t* channel, enum direction dir, channel_waiter_t* waiter)
+{
+    pthread_mutex_lock(&channel->mutex);
+    bool notified = waiter->notified;
+    if (notified == false)
+    {
+        waiter_queue_unlink(waiter_list(channel, dir), waiter);
+        count_waiter(channel, dir, false);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return notified;
+}
+
+// Wins the claim of a select set entry, which is only open while the set's owner sleeps in select_set_wait
+// Returns true with the set's mutex still held, so the owner can't see the claim before complete_partner
+// reports the entry, or false if the set is awake or the entry is disabled
+bool claim_set_entry(channel_waiter_t* waiter)
+{
+    select_set_t* set = waiter->set;
+    if (atomic_load(&set->claim) != CLAIM_OPEN)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&set->mutex);
+    int expected = CLAIM_OPEN;
+    if (set->enabled[waiter->index] && atomic_compare_exchange_strong(&set->claim, &expected, CLAIM_PARTNER))
+    {
+        return true;
+    }
+    pthread_mutex_unlock(&set->mutex);
+    return false;
+}
+
+// Finds the oldest waiter in the given direction of a rendezvous channel that isn't an entry of
+// the select owning claim (NULL if the caller isn't parked) and wins its claim
+// Waiters whose select already completed stay queued until their owner removes them; a select set
+// entry is returned with its set's mutex held (see claim_set_entry)
+// Must be called with the mutex held
+channel_waiter_t* claim_partner(channel_t* channel, enum direction dir, atomic_int* claim)
+{
+    for (channel_waiter_t* waiter = waiter_list(channel, dir)->head; waiter != NULL; waiter = waiter->next)
+    {
+        if (waiter->claim == claim)
+        {
+            continue;
+        }
+        if (waiter->set != NULL)
+        {
+            if (claim_set_entry(waiter))
+            {
+                return waiter;
+            }
+            continue;
+        }
+        int expected = CLAIM_OPEN;
+        if (atomic_compare_exchange_strong(waiter->claim, &expected, CLAIM_PARTNER))
+        {
+            return waiter;
+        }
+    }
+    return NULL;
+}
+
+// Dequeues a claimed partner and wakes it with the message already moved
+// A select set entry stays queued: it is reported to its set instead, and the set's mutex is released
+// Must be called with the mutex held
+void complete_partner(channel_t* channel, enum direction dir, channel_waiter_t* waiter)
+{
+    atomic_fetch_add_explicit(&channel->handoffs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&channel->wakeups, 1, memory_order_relaxed);
+    //a handoff completes a send and a receive at once
+    stats_record(channel, SEND, 1);
+    stats_record(channel, RECV, 1);
+    waiter->handed_off = true;
+    if (waiter->set != NULL)
+    {
+        ready_push(waiter->set, waiter->index);
+        pthread_mutex_unlock(&waiter->set->mutex);
+        return;
+    }
+    waiter_queue_unlink(waiter_list(channel, dir), waiter);
+    atomic_fetch_sub(waiter_count(channel, dir), 1);
+    waiter->notified = true;
+    parker_post(waiter->parker);
+}
+
+// Hands data straight to a receiver parked on a rendezvous channel
+// Must be called with the mutex held; claim is the caller's own select claim while it is parked
+// Returns SUCCESS if a receiver took data, CHANNEL_FULL if none is waiting and CLOSED_ERROR if the
+// channel is closed
+enum channel_status rendezvous_send(channel_t* channel, void* data, atomic_int* claim)
+{
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    channel_waiter_t* waiter = claim_partner(channel, RECV, claim);
+    if (waiter == NULL)
+    {
+        return CHANNEL_FULL;
+    }
+    if (channel->elem_size > 0)
+    {
+        memcpy(waiter->data, data, channel->elem_size);
+    }
+    else
+    {
+        waiter->data = data;
+    }
+    complete_partner(channel, RECV, waiter);
+    return SUCCESS;
+}
+
+// Takes the message of a sender parked on a rendezvous channel
+// Must be called with the mutex held; claim is the caller's own select claim while it is parked
+// Returns SUCCESS if a sender's message was stored in data, CHANNEL_EMPTY if none is waiting and
+// CLOSED_ERROR if the channel is closed
+enum channel_status rendezvous_receive(channel_t* channel, void** data, atomic_int* claim)
+{
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    channel_waiter_t* waiter = claim_partner(channel, SEND, claim);
+    if (waiter == NULL)
+    {
+        return CHANNEL_EMPTY;
+    }
+    if (channel->elem_size > 0)
+    {
+        memcpy(*data, waiter->data, channel->elem_size);
+    }
+    else
+    {
+        *data = waiter->data;
+    }
+    complete_partner(channel, SEND, waiter);
+    return SUCCESS;
+}
+
+// Allocates a channel with its waiting machinery but without a ring
+channel_t* channel_alloc(enum channel_kind kind)
+{
+    channel_t* channel = (channel_t*)malloc(sizeof(channel_t));
+
+    channel->kind = kind;
+    channel->elem_size = 0;
+    channel->buffer = NULL;
+    channel->spsc = NULL;
+    channel->broadcast = NULL;
+    channel->cursor = NULL;
+    channel->publisher = NULL;
+    channel->shm = NULL;
+    channel->sharded = NULL;
+    channel->priority = NULL;
+    channel->elastic = NULL;
+    channel->send_list = (channel_waiter_queue_t){NULL, NULL};
+    channel->recv_list = (channel_waiter_queue_t){NULL, NULL};
+
+    atomic_init(&channel->open, true);
+    atomic_init(&channel->send_waiters, 0);
+    atomic_init(&channel->recv_waiters, 0);
+    atomic_init(&channel->wakeups, 0);
+    atomic_init(&channel->handoffs, 0);
+
+    //spinning only pays off when the other side can run at the same time
+    channel->spin_limit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? CHANNEL_SPIN_MAX : 0;
+    atomic_init(&channel->spin_budget, (channel->spin_limit > 0) ? CHANNEL_SPIN_MIN : 0);
+    channel->stats = NULL;
+    atomic_init(&channel->events[SEND], NULL);
+    atomic_init(&channel->events[RECV], NULL);
+
+    pthread_mutex_init(&channel->mutex, NULL);
+
+    return channel;
+}
+
+// Creates a new channel with the provided size and returns it to the caller
+channel_t* channel_create(size_t size)
+{
+    //an unbuffered channel keeps an empty ring so buffer_capacity/buffer_current_size still report 0
+    channel_t* channel = channel_alloc(size == 0 ? CHANNEL_SYNC : CHANNEL_MPMC);
+    channel->buffer = buffer_create(size);
+    return channel;
+}
+
+// Creates a new single-producer/single-consumer channel with the provided size and returns it to the caller
+// A size of 0 has no ring to share, so it creates the same unbuffered channel as channel_create(0)
+channel_t* channel_create_spsc(size_t size)
+{
+    if (size == 0)
+    {
+        return channel_create(0);
+    }
+    channel_t* channel = channel_alloc(CHANNEL_SPSC);
+    channel->spsc = spsc_buffer_create(size);
+    return channel;
+}
+
+// Creates a new channel with the provided capacity whose messages are elem_size bytes copied into the channel
+channel_t* channel_create_typed(size_t capacity, size_t elem_size)
+{
+    channel_t* channel = channel_alloc(capacity == 0 ? CHANNEL_SYNC : CHANNEL_MPMC);
+    channel->elem_size = elem_size;
+    channel->buffer = buffer_create_typed(capacity, elem_size);
+    return channel;
+}
+
+// Creates a new channel for many producers whose messages (elem_size bytes each, or pointers if elem_size is 0) go into
+// lanes separate rings (0 for one per CPU) holding capacity messages (at least 1 per lane) between them
+channel_t* channel_create_sharded(size_t capacity, size_t elem_size, size_t lanes, bool fifo)
+{
+    if (lanes == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        lanes = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    channel_t* channel = channel_alloc(CHANNEL_SHARDED);
+    channel->elem_size = elem_size;
+    channel->sharded = sharded_buffer_create(capacity, elem_size, lanes, fifo);
+    return channel;
+}
+
+// Creates a new channel of pointers holding capacity messages (at least 1) that are received highest priority first
+// and in the order they were sent within a priority
+channel_t* channel_create_priority(size_t capacity)
+{
+    channel_t* channel = channel_alloc(CHANNEL_PRIORITY);
+    channel->priority = priority_buffer_create(capacity);
+    return channel;
+}
+
+// Creates a new channel of pointers whose ring starts at capacity messages (at least 1), doubles when a send finds it
+// full, up to max_capacity messages, and halves again, down to capacity, once it has stayed mostly empty
+channel_t* channel_create_elastic(size_t capacity, size_t max_capacity)
+{
+    channel_t* channel = channel_alloc(CHANNEL_ELASTIC);
+    channel->elastic = elastic_buffer_create(capacity, max_capacity);
+    return channel;
+}
+
+// Creates a new broadcast channel whose ring holds capacity messages (at least 1) of elem_size bytes, or
+// pointers if elem_size is 0
+// A message sent on it is written to the ring once and received by every subscriber (see channel_subscribe)
+// that was subscribed when it was sent; receiving from the broadcast channel itself is a GENERIC_ERROR
+// A send blocks (and a non-blocking send returns CHANNEL_FULL) while some subscriber is capacity messages
+// behind; the publisher can check channel_lag and close subscribers it would rather drop than wait for
+// Closing the broadcast channel closes every subscriber; it may then be destroyed before them
+channel_t* channel_create_broadcast(size_t capacity, size_t elem_size)
+{
+    channel_t* channel = channel_alloc(CHANNEL_BROADCAST);
+    channel->elem_size = elem_size;
+    channel->broadcast = broadcast_buffer_create(capacity, elem_size);
+    return channel;
+}
+
+// Creates a new channel that receives every message sent on the given broadcast channel from now on,
+// in order, through the same calls as any other channel (typed if the broadcast channel is)
+// At most one thread may receive from a subscriber at a time (including select RECV entries); sending
+// on it is a GENERIC_ERROR. Closing a subscriber unsubscribes it, releasing the messages it held back
+// Returns NULL if channel is not an open broadcast channel
+channel_t* channel_subscribe(channel_t* channel)
+{
+    if (channel->kind != CHANNEL_BROADCAST || is_channel_open(channel) == false)
+    {
+        return NULL;
+    }
+    channel_t* subscriber = channel_alloc(CHANNEL_SUBSCRIBER);
+    subscriber->elem_size = channel->elem_size;
+    subscriber->broadcast = channel->broadcast;
+    subscriber->publisher = channel;
+    subscriber->cursor = (broadcast_cursor_t*)aligned_alloc(BUFFER_CACHE_LINE, sizeof(broadcast_cursor_t));
+    broadcast_buffer_subscribe(channel->broadcast, subscriber->cursor, subscriber);
+    if (is_channel_open(channel) == false)
+    {
+        //lost a race with channel_close, which may have missed the new cursor
+        channel_close(subscriber);
+        channel_destroy(subscriber);
+        return NULL;
+    }
+    return subscriber;
+}
+
+// Returns the number of messages sent on a subscriber's broadcast channel that it hasn't received yet,
+// or for a broadcast channel the largest such number among its subscribers
+// Only a snapshot when other threads are sending or receiving at the same time
+size_t channel_lag(channel_t* channel)
+{
+    if (channel->kind == CHANNEL_SUBSCRIBER || channel->kind == CHANNEL_BROADCAST)
+    {
+        return channel_depth(channel);
+    }
+    return 0;
+}
+
+// Wraps a handle on a shared-memory ring in a channel, or returns NULL if there is none
+channel_t* channel_wrap_shm(shm_buffer_t* shm)
+{
+    if (shm == NULL)
+    {
+        return NULL;
+    }
+    channel_t* channel = channel_alloc(CHANNEL_SHM);
+    channel->elem_size = shm->ring->elem_size;
+    channel->shm = shm;
+    return channel;
+}
+
+// Creates a new typed channel whose ring of capacity messages of elem_size bytes lives in the shared memory
+// object name (a / followed by up to 62 characters), so that other processes can open it with channel_open_shm
+// Messages are copied straight into the shared ring, and a send or receive that doesn't have to wait makes
+// no system call. Blocking calls sleep on futex words in the ring and never spin, so a fiber calling them
+// blocks its whole thread; select and select_set return GENERIC_ERROR for entries on such channels
+// Closing the channel in any process closes it in all of them, and so does a process that had it open
+// exiting without channel_destroy (noticed within SHM_BUFFER_LIVENESS_MS by the calls blocked on it)
+// channel_destroy only releases this process's handle; the object is removed once every process has done so
+// Returns NULL if name is taken or the object can't be created
+channel_t* channel_create_shm(const char* name, size_t capacity, size_t elem_size)
+{
+    return channel_wrap_shm(shm_buffer_create(name, capacity, elem_size));
+}
+
+// Opens the channel another process created with channel_create_shm (see there)
+// Returns NULL if there is no such channel or SHM_BUFFER_PEERS processes already have it open
+channel_t* channel_open_shm(const char* name)
+{
+    return channel_wrap_shm(shm_buffer_open(name));
+}
+
+// Returns false for the direction a broadcast channel (RECV) or a subscriber (SEND) can't be used in
+bool channel_supports(channel_t* channel, enum direction dir)
+{
+    return (dir == SEND) ? (channel->kind != CHANNEL_SUBSCRIBER) : (channel->kind != CHANNEL_BROADCAST);
+}
+
+// Returns an eventfd that becomes readable once an operation in the given direction may be possible on the channel
+// (a message to receive for RECV, room to send for SEND) or the channel is closed, so a channel can be waited on in
+// poll or epoll next to sockets; the fd belongs to the channel and is closed by channel_destroy
+// The fd starts out readable; it is drained and armed again whenever a non-blocking call in that direction returns
+// CHANNEL_EMPTY or CHANNEL_FULL, so an event loop calls the non-blocking calls until they report that and then waits
+// Readiness is only a hint: another thread may take the message or the slot first
+// Returns -1 for the direction a broadcast channel or subscriber can't be used in, for shared-memory channels, and if
+// the eventfd can't be created
+int channel_event_fd(channel_t* channel, enum direction dir)
+{
+    if (channel_supports(channel, dir) == false || channel->kind == CHANNEL_SHM)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    channel_event_t* event = atomic_load_explicit(&channel->events[dir], memory_order_relaxed);
+    if (event == NULL)
+    {
+        //starting out readable (and not queued) sends the caller straight to the non-blocking calls
+        int fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+        {
+            pthread_mutex_unlock(&channel->mutex);
+            return -1;
+        }
+        event = (channel_event_t*)malloc(sizeof(channel_event_t));
+        atomic_init(&event->parker.value, 0);
+        atomic_init(&event->parker.sleepers, 0);
+        atomic_init(&event->parker.fiber, NULL);
+        event->parker.fd = fd;
+        atomic_init(&event->claim, CLAIM_OWNER);
+        event->waiter.parker = &event->parker;
+        event->waiter.notified = true;
+        event->waiter.claim = &event->claim;
+        event->waiter.data = NULL;
+        event->waiter.handed_off = false;
+        event->waiter.set = NULL;
+        event->waiter.index = 0;
+        atomic_store_explicit(&channel->events[dir], event, memory_order_release);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return event->parker.fd;
+}
+
+// Drains and re-arms the readiness fd in the given direction after a non-blocking call found nothing to do
+// Returns true if the fd wasn't armed, in which case the caller must try once more: the operation may have
+// become possible between its attempt and the arming, and nothing would report it
+bool event_rearm(channel_t* channel, enum direction dir)
+{
+    channel_event_t* event = atomic_load_explicit(&channel->events[dir], memory_order_acquire);
+    if (event == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&channel->mutex);
+    bool armed = (event->waiter.notified == false);
+    if (armed == false)
+    {
+        //nothing posts to the fd while its waiter is out of the queue, so this can't lose a token
+        uint64_t tokens;
+        ssize_t got = read(event->parker.fd, &tokens, sizeof(tokens));
+        (void)got;
+        add_waiter_locked(channel, dir, &event->waiter);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return armed == false;
+}
+
+// Copies the elem_size bytes at value into the given typed channel
+// This is a blocking call i.e., the function only returns on a successful completion of send
+// Returns SUCCESS for successfully writing the value to the channel,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_value(channel_t* channel, const void* value)
+{
+    return channel_send(channel, (void*)value);
+}
+
+// Copies the oldest message of the given typed channel into the elem_size bytes at value
+// This is a blocking call i.e., the function only returns on a successful completion of receive
+// Returns SUCCESS for successful retrieval of a message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_value(channel_t* channel, void* value)
+{
+    return channel_receive(channel, &value);
+}
+
+// Writes data to the given channel
+// This is a blocking call i.e., the function only returns on a successful completion of send
+// In case the channel is full, the function waits till the channel has space to write the new data
+// Returns SUCCESS for successfully writing data to the channel,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send(channel_t *channel, void* data)
+{
+    return channel_send_prio(channel, data, 0);
+}
+
+// Writes data to the given channel at the given priority, like channel_send
+// Only a priority channel (see channel_create_priority) orders messages by priority; other channels ignore it
+// Returns the same as channel_send
+enum channel_status channel_send_prio(channel_t* channel, void* data, unsigned priority)
+{
+    if (channel_supports(channel, SEND) == false)
+    {
+        return GENERIC_ERROR;
+    }
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    if (channel->kind == CHANNEL_SHM)
+    {
+        //other processes can't see our wait queues, the ring has its own futex words
+        return (shm_buffer_send(channel->shm, data) == BUFFER_SUCCESS) ? SUCCESS : CLOSED_ERROR;
+    }
+
+    //fast path: there is room in the buffer
+    if (channel_buffer_add(channel, data, priority) == BUFFER_SUCCESS)
+    {
+        wake_up_recv(channel);
+        return SUCCESS;
+    }
+
+    //slow path: park in the send queue until a receiver frees a slot
+    select_t entry = {channel, SEND, data, priority};
+    size_t index;
+    return channel_select(&entry, 1, &index);
+}
+
+// Reads data from the given channel and stores it in the function's input parameter, data (Note that it is a double pointer)
+// This is a blocking call i.e., the function only returns on a successful completion of receive
+// In case the channel is empty, the function waits till the channel has some data to read
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive(channel_t* channel, void** data)
+{
+    if (channel_supports(channel, RECV) == false)
+    {
+        return GENERIC_ERROR;
+    }
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    if (channel->kind == CHANNEL_SHM)
+    {
+        return (shm_buffer_receive(channel->shm, *data) == BUFFER_SUCCESS) ? SUCCESS : CLOSED_ERROR;
+    }
+
+    //fast path: there is data in the buffer
+    if (channel_buffer_remove(channel, data) == BUFFER_SUCCESS)
+    {
+        wake_up_send(channel);
+        return SUCCESS;
+    }
+
+    //slow path: park in the receive queue until a sender adds data
+    //(a typed channel copies into the destination the caller passed in data)
+    select_t entry = {channel, RECV, (channel->elem_size > 0) ? *data : NULL};
+    size_t index;
+    enum channel_status status = channel_select(&entry, 1, &index);
+    if (status == SUCCESS)
+    {
+        *data = entry.data;
+    }
+    return status;
+}
+
+// Writes data to the given channel at the given priority if there is room right away, without touching its readiness fd
+// Returns the same as channel_non_blocking_send
+enum channel_status try_send(channel_t* channel, void* data, unsigned priority)
+{
+    if (channel_supports(channel, SEND) == false)
+    {
+        return GENERIC_ERROR;
+    }
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    if (channel->kind == CHANNEL_SYNC)
+    {
+        pthread_mutex_lock(&channel->mutex);
+        enum channel_status status = rendezvous_send(channel, data, NULL);
+        pthread_mutex_unlock(&channel->mutex);
+        return status;
+    }
+
+    if (channel_buffer_add(channel, data, priority) == BUFFER_ERROR)
+    {
+        return CHANNEL_FULL;
+    }
+
+    wake_up_recv(channel);
+    return SUCCESS;
+}
+
+// Writes data to the given channel
+// This is a non-blocking call i.e., the function simply returns if the channel is full
+// Returns SUCCESS for successfully writing data to the channel,
+// CHANNEL_FULL if the channel is full and the data was not added to the buffer,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_send(channel_t* channel, void* data)
+{
+    enum channel_status status = try_send(channel, data, 0);
+    if (status == CHANNEL_FULL && event_rearm(channel, SEND))
+    {
+        status = try_send(channel, data, 0);
+    }
+    return status;
+}
+
+// Reads data from the given channel if there is any right away, without touching its readiness fd
+// Returns the same as channel_non_blocking_receive
+enum channel_status try_receive(channel_t* channel, void** data)
+{
+    if (channel_supports(channel, RECV) == false)
+    {
+        return GENERIC_ERROR;
+    }
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    if (channel->kind == CHANNEL_SYNC)
+    {
+        pthread_mutex_lock(&channel->mutex);
+        enum channel_status status = rendezvous_receive(channel, data, NULL);
+        pthread_mutex_unlock(&channel->mutex);
+        return status;
+    }
+
+    if (channel_buffer_remove(channel, data) == BUFFER_ERROR)
+    {
+        return CHANNEL_EMPTY;
+    }
+
+    wake_up_send(channel);
+    return SUCCESS;
+}
+
+// Reads data from the given channel and stores it in the function's input parameter data (Note that it is a double pointer)
+// This is a non-blocking call i.e., the function simply returns if the channel is empty
+// Returns SUCCESS for successful retrieval of data,
+// CHANNEL_EMPTY if the channel is empty and nothing was stored in data,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive(channel_t* channel, void** data)
+{
+    enum channel_status status = try_receive(channel, data);
+    if (status == CHANNEL_EMPTY && event_rearm(channel, RECV))
+    {
+        status = try_receive(channel, data);
+    }
+    return status;
+}
+
+// Writes the n messages in items to the given channel in order, moving as many as fit under one synchronization at a time
+// This is a blocking call i.e., the function only returns once all n messages are sent
+// The number of messages actually sent is stored in sent, even on error
+// Returns SUCCESS for successfully writing all the messages,
+// CLOSED_ERROR if the channel is closed before all of them were written, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_batch(channel_t* channel, void** items, size_t n, size_t* sent)
+{
+    *sent = 0;
+    while (*sent < n)
+    {
+        size_t count = 0;
+        enum channel_status status = channel_non_blocking_send_batch(channel, &items[*sent], n - *sent, &count);
+        if (status == CHANNEL_FULL)
+        {
+            //no room at all: park for one slot through the regular blocking path, then batch again
+            status = channel_send(channel, items[*sent]);
+            count = 1;
+        }
+        if (status != SUCCESS)
+        {
+            return status;
+        }
+        *sent += count;
+    }
+    return SUCCESS;
+}
+
+// Reads up to max messages from the given channel into out in FIFO order, taking every message already buffered under one synchronization
+// This is a blocking call i.e., the function waits till the channel has at least one message to read
+// The number of messages read is stored in got
+// Returns SUCCESS for successful retrieval of at least one message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_batch(channel_t* channel, void** out, size_t max, size_t* got)
+{
+    enum channel_status status = channel_non_blocking_receive_batch(channel, out, max, got);
+    if (status != CHANNEL_EMPTY)
+    {
+        return status;
+    }
+
+    //nothing buffered: park for one message, then take whatever else arrived with it
+    status = channel_receive(channel, &out[0]);
+    if (status != SUCCESS)
+    {
+        return status;
+    }
+    size_t more = 0;
+    channel_non_blocking_receive_batch(channel, &out[1], max - 1, &more);
+    *got = 1 + more;
+    return SUCCESS;
+}
+
+// Writes as many of the n messages in items as fit to the given channel under one synchronization
+// This is a non-blocking call i.e., the function simply returns if the channel is full
+// The number of messages actually sent is stored in sent
+// Returns SUCCESS if at least one message was written (or n is 0),
+// CHANNEL_FULL if the channel is full and nothing was added to the buffer,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_send_batch(channel_t* channel, void** items, size_t n, size_t* sent)
+{
+    *sent = 0;
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+    if (n == 0)
+    {
+        return SUCCESS;
+    }
+
+    if (channel->kind == CHANNEL_SYNC || channel->kind == CHANNEL_BROADCAST || channel->kind == CHANNEL_SUBSCRIBER || channel->elem_size > 0)
+    {
+        //no ring of pointers to claim slots in, move the messages one at a time
+        enum channel_status status;
+        while (*sent < n && (status = channel_non_blocking_send(channel, items[*sent])) == SUCCESS)
+        {
+            (*sent)++;
+        }
+        return (*sent > 0) ? SUCCESS : status;
+    }
+
+    *sent = channel_buffer_add_batch(channel, items, n);
+    if (*sent == 0 && event_rearm(channel, SEND))
+    {
+        *sent = channel_buffer_add_batch(channel, items, n);
+    }
+    if (*sent == 0)
+    {
+        return CHANNEL_FULL;
+    }
+
+    //one token per message, handed out under a single lock
+    wake_many(channel, RECV, *sent);
+    return SUCCESS;
+}
+
+// Reads up to max messages that are already in the given channel into out under one synchronization
+// This is a non-blocking call i.e., the function simply returns if the channel is empty
+// The number of messages read is stored in got
+// Returns SUCCESS if at least one message was read (or max is 0),
+// CHANNEL_EMPTY if the channel is empty and nothing was stored in out,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive_batch(channel_t* channel, void** out, size_t max, size_t* got)
+{
+    *got = 0;
+    if (is_channel_open(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+    if (max == 0)
+    {
+        return SUCCESS;
+    }
+
+    if (channel->kind == CHANNEL_SYNC || channel->kind == CHANNEL_BROADCAST || channel->kind == CHANNEL_SUBSCRIBER || channel->elem_size > 0)
+    {
+        enum channel_status status;
+        while (*got < max && (status = channel_non_blocking_receive(channel, &out[*got])) == SUCCESS)
+        {
+            (*got)++;
+        }
+        return (*got > 0) ? SUCCESS : status;
+    }
+
+    *got = channel_buffer_remove_batch(channel, out, max);
+    if (*got == 0 && event_rearm(channel, RECV))
+    {
+        *got = channel_buffer_remove_batch(channel, out, max);
+    }
+    if (*got == 0)
+    {
+        return CHANNEL_EMPTY;
+    }
+
+    wake_many(channel, SEND, *got);
+    return SUCCESS;
+}
+
+// Marks the channel closed and wakes every blocked send/receive and every registered select so they see it
+// Returns false if the channel was already closed
+bool mark_closed(channel_t* channel)
+{
+    pthread_mutex_lock(&channel->mutex);
+
+    if (is_channel_open(channel) == false)
+    {
+        pthread_mutex_unlock(&channel->mutex);
+        return false;
+    }
+
+    //close the channel
+    atomic_store(&channel->open, false);
+
+    wake_all(channel, SEND);
+    wake_all(channel, RECV);
+
+    pthread_mutex_unlock(&channel->mutex);
+    return true;
+}
+
+// Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
+// Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
+// Returns SUCCESS if close is successful,
+// CLOSED_ERROR if the channel is already closed, and
+// GENERIC_ERROR in any other error case
+enum channel_status channel_close(channel_t* channel)
+{
+    if (channel->kind == CHANNEL_SHM)
+    {
+        return shm_buffer_close(channel->shm) ? SUCCESS : CLOSED_ERROR;
+    }
+    if (mark_closed(channel) == false)
+    {
+        return CLOSED_ERROR;
+    }
+
+    if (channel->kind == CHANNEL_BROADCAST)
+    {
+        //close and unsubscribe every subscriber; a subscriber closing itself at the same time finds
+        //itself already closed, and none of them touches the ring again
+        broadcast_buffer_t* broadcast = channel->broadcast;
+        pthread_mutex_lock(&broadcast->mutex);
+        list_node_t* node;
+        while ((node = list_head(broadcast->cursors)) != NULL)
+        {
+            broadcast_cursor_t* cursor = (broadcast_cursor_t*)list_data(node);
+            list_remove(broadcast->cursors, cursor);
+            mark_closed((channel_t*)cursor->owner);
+        }
+        pthread_mutex_unlock(&broadcast->mutex);
+    }
+    else if (channel->kind == CHANNEL_SUBSCRIBER)
+    {
+        //the messages we held back are free now, any blocked sender may be able to go ahead
+        if (broadcast_buffer_unsubscribe(channel->broadcast, channel->cursor))
+        {
+            wake_many(channel->publisher, SEND, channel->broadcast->capacity);
+        }
+    }
+    return SUCCESS;
+}
+
+// Frees all the memory allocated to the channel
+// The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
+// Returns SUCCESS if destroy is successful,
+// DESTROY_ERROR if channel_destroy is called on an open channel, and
+// GENERIC_ERROR in any other error case
+enum channel_status channel_destroy(channel_t* channel)
+{
+    //make sure the channel is closed before it gets destroyed
+    if (is_channel_open(channel) == true)
+    {
+        return DESTROY_ERROR;
+    }
+
+    pthread_mutex_destroy(&channel->mutex);
+
+    if (channel->kind == CHANNEL_SPSC)
+    {
+        spsc_buffer_free(channel->spsc);
+    }
+    else if (channel->kind == CHANNEL_BROADCAST)
+    {
+        broadcast_buffer_free(channel->broadcast);
+    }
+    else if (channel->kind == CHANNEL_SUBSCRIBER)
+    {
+        //closing unsubscribed the cursor, the ring belongs to the broadcast channel
+        free(channel->cursor);
+    }
+    else if (channel->kind == CHANNEL_SHM)
+    {
+        shm_buffer_detach(channel->shm);
+    }
+    else if (channel->kind == CHANNEL_SHARDED)
+    {
+        sharded_buffer_free(channel->sharded);
+    }
+    else if (channel->kind == CHANNEL_PRIORITY)
+    {
+        priority_buffer_free(channel->priority);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        elastic_buffer_free(channel->elastic);
+    }
+    else
+    {
+        buffer_free(channel->buffer);
+    }
+
+    if (channel->stats != NULL)
+    {
+        stats_unregister(channel);
+        free(channel->stats);
+    }
+    for (int dir = SEND; dir <= RECV; dir++)
+    {
+        channel_event_t* event = atomic_load(&channel->events[dir]);
+        if (event != NULL)
+        {
+            close(event->parker.fd);
+            free(event);
+        }
+    }
+
+    free(channel);
+
+    return SUCCESS;
+}
+
+// Returns the number of times the channel woke a parked sender, receiver or select divided by the
+// number of messages sent on it so far; a value close to 1 means no thundering herds
+double channel_wakeups_per_message(channel_t* channel)
+{
+    // the rings count every message that went through them, so the hot path pays nothing extra
+    size_t messages;
+    if (channel->kind == CHANNEL_SPSC)
+    {
+        messages = atomic_load(&channel->spsc->tail);
+    }
+    else if (channel->kind == CHANNEL_SYNC)
+    {
+        messages = atomic_load(&channel->handoffs);
+    }
+    else if (channel->kind == CHANNEL_BROADCAST || channel->kind == CHANNEL_SUBSCRIBER)
+    {
+        messages = atomic_load(&channel->broadcast->tail);
+    }
+    else if (channel->kind == CHANNEL_SHM)
+    {
+        messages = atomic_load(&channel->shm->ring->tail);
+    }
+    else if (channel->kind == CHANNEL_SHARDED)
+    {
+        messages = sharded_buffer_added(channel->sharded);
+    }
+    else if (channel->kind == CHANNEL_PRIORITY)
+    {
+        messages = priority_buffer_added(channel->priority);
+    }
+    else if (channel->kind == CHANNEL_ELASTIC)
+    {
+        messages = elastic_buffer_added(channel->elastic);
+    }
+    else
+    {
+        messages = atomic_load(&channel->buffer->tail);
+    }
+
+    if (messages == 0)
+    {
+        return 0.0;
+    }
+    return (double)atomic_load(&channel->wakeups) / (double)messages;
+}
+
+// Sets the longest time in nanoseconds that a blocked call on the given channel spins before it yields and parks,
+// and restarts the channel's spin budget from CHANNEL_SPIN_MIN (0 turns spinning off)
+// Must be called before the channel is shared with other threads
+void channel_set_spin_limit(channel_t* channel, unsigned limit)
+{
+    channel->spin_limit = limit;
+    atomic_store_explicit(&channel->spin_budget, (limit < CHANNEL_SPIN_MIN) ? limit : CHANNEL_SPIN_MIN, memory_order_relaxed);
+}
+
+// Starts counting operations on the given channel (see channel_stats_t)
+// Must be called before the channel is shared with other threads; channels without counters pay a single branch per operation
+void channel_enable_stats(channel_t* channel)
+{
+    if (channel->stats != NULL)
+    {
+        return;
+    }
+    size_t shards = (size_t)1 << CHANNEL_STATS_SHARD_BITS;
+    channel_stats_shard_t* stats = (channel_stats_shard_t*)aligned_alloc(BUFFER_CACHE_LINE, sizeof(channel_stats_shard_t) * shards);
+    for (size_t shard = 0; shard < shards; shard++)
+    {
+        atomic_init(&stats[shard].sends, 0);
+        atomic_init(&stats[shard].receives, 0);
+        atomic_init(&stats[shard].blocked_sends, 0);
+        atomic_init(&stats[shard].blocked_receives, 0);
+        atomic_init(&stats[shard].blocked_ns, 0);
+        atomic_init(&stats[shard].spurious_wakeups, 0);
+        for (size_t bucket = 0; bucket < CHANNEL_STATS_BUCKETS; bucket++)
+        {
+            atomic_init(&stats[shard].depth[bucket], 0);
+        }
+    }
+    channel->stats = stats;
+    stats_register(channel);
+}
+
+// Stores a snapshot of the channel's counters in stats
+// Returns SUCCESS if the counters were copied, and
+// GENERIC_ERROR if channel_enable_stats was never called on the channel
+enum channel_status channel_stats(channel_t* channel, channel_stats_t* stats)
+{
+    if (channel->stats == NULL)
+    {
+        return GENERIC_ERROR;
+    }
+
+    memset(stats, 0, sizeof(channel_stats_t));
+    for (size_t index = 0; index < ((size_t)1 << CHANNEL_STATS_SHARD_BITS); index++)
+    {
+        channel_stats_shard_t* shard = &channel->stats[index];
+        stats->sends += atomic_load_explicit(&shard->sends, memory_order_relaxed);
+        stats->receives += atomic_load_explicit(&shard->receives, memory_order_relaxed);
+        stats->blocked_sends += atomic_load_explicit(&shard->blocked_sends, memory_order_relaxed);
+        stats->blocked_receives += atomic_load_explicit(&shard->blocked_receives, memory_order_relaxed);
+        stats->blocked_ns += atomic_load_explicit(&shard->blocked_ns, memory_order_relaxed);
+        stats->spurious_wakeups += atomic_load_explicit(&shard->spurious_wakeups, memory_order_relaxed);
+        for (size_t bucket = 0; bucket < CHANNEL_STATS_BUCKETS; bucket++)
+        {
+            stats->depth[bucket] += atomic_load_explicit(&shard->depth[bucket], memory_order_relaxed);
+        }
+    }
+    return SUCCESS;
+}
+
+// Returns the entry a pass that rotates with the caller's cursor starts at, and moves the cursor one entry on
+// A NULL cursor always starts at the first entry
+size_t select_cursor_next(size_t* cursor, size_t channel_count)
+{
+    if (cursor == NULL)
+    {
+        return 0;
+    }
+    size_t start = *cursor % channel_count;
+    *cursor = start + 1;
+    return start;
+}
+
+// Performs the operation of one select entry if it is possible right now
+// Returns CHANNEL_EMPTY (which is also CHANNEL_FULL) if it isn't, and otherwise the status of the operation
+enum channel_status select_try(select_t* entry, atomic_int* claim)
+{
+    channel_t* channel = entry->channel;
+    if (channel->kind == CHANNEL_SHM)
+    {
+        //nothing would wake the select when another process makes the entry ready
+        return GENERIC_ERROR;
+    }
+    if (claim != NULL && channel->kind == CHANNEL_SYNC)
+    {
+        return (entry->dir == SEND) ? rendezvous_send(channel, entry->data, claim)
+                                    : rendezvous_receive(channel, &entry->data, claim);
+    }
+    return (entry->dir == SEND) ? try_send(channel, entry->data, entry->priority) : try_receive(channel, &entry->data);
+}
+
+// Tries every entry once without blocking, in order
+// claim is NULL before the select is parked; once it is, the caller holds the mutex of every
+// rendezvous channel in the list and passes its claim so it never pairs up with its own entries
+// Returns CHANNEL_EMPTY if no entry could complete, otherwise the status of the first entry that
+// completed or failed and stores its index in selected_index
+enum channel_status select_poll(select_t* channel_list, size_t channel_count, size_t start, size_t* selected_index,
+                                atomic_int* claim)
+{
+    for (size_t i = 0; i < channel_count; i++)
+    {
+        size_t index = (start + i) % channel_count;
+        enum channel_status val = select_try(&channel_list[index], claim);
+        if (val != CHANNEL_EMPTY)
+        {
+            *selected_index = index;
+            return val;
+        }
+    }
+    return CHANNEL_EMPTY;
+}
+
+// Collects the distinct rendezvous channels of a select in address order, so that every select
+// locks them in the same order
+size_t rendezvous_channels(select_t* channel_list, size_t channel_count, channel_t** channels)
+{
+    size_t count = 0;
+    for (size_t index = 0; index < channel_count; index++)
+    {
+        channel_t* channel = channel_list[index].channel;
+        if (channel->kind != CHANNEL_SYNC)
+        {
+            continue;
+        }
+        size_t pos = 0;
+        while (pos < count && channels[pos] < channel)
+        {
+            pos++;
+        }
+        if (pos < count && channels[pos] == channel)
+        {
+            continue;
+        }
+        memmove(&channels[pos + 1], &channels[pos], (count - pos) * sizeof(channel_t*));
+        channels[pos] = channel;
+        count++;
+    }
+    return count;
+}
+
+// Behaves like channel_select, but polls the entries in order from the one at start, wrapping around
+enum channel_status select_from(select_t* channel_list, size_t channel_count, size_t start, size_t* selected_index)
+{
+    //first go through the channel_list and see if any channel can perform an operation
+    enum channel_status val = select_poll(channel_list, channel_count, start, selected_index, NULL);
+    if (val != CHANNEL_EMPTY)
+    {
+        return val;
+    }
+
+    channel_parker_t parker;
+    atomic_init(&parker.value, 0);
+    atomic_init(&parker.sleepers, 0);
+    atomic_init(&parker.fiber, NULL);
+    parker.fd = -1;
+    atomic_int claim;
+    //the waiters are linked into the channels' queues in place, so small selects need no heap at all; a select can't
+    //keep storage between calls, so larger ones allocate here and callers that block on them in a loop use a select_set_t
+    channel_waiter_t stack_waiters[CHANNEL_SELECT_STACK];
+    channel_t* stack_rendezvous[CHANNEL_SELECT_STACK];
+    channel_waiter_t* waiters = stack_waiters;
+    channel_t** rendezvous = stack_rendezvous;
+    if (channel_count > CHANNEL_SELECT_STACK)
+    {
+        waiters = (channel_waiter_t*)malloc(sizeof(channel_waiter_t) * channel_count);
+        rendezvous = (channel_t**)malloc(sizeof(channel_t*) * channel_count);
+    }
+    size_t rendezvous_count = rendezvous_channels(channel_list, channel_count, rendezvous);
+
+    //only read the clock if one of the channels counts blocked time
+    bool timed = false;
+    for (size_t index = 0; index < channel_count; index++)
+    {
+        timed = timed || (channel_list[index].channel->stats != NULL);
+    }
+    uint64_t blocked_since = 0;
+
+    while (true)
+    {
+        //queue up on every channel, then re-check so a change that raced with queueing isn't missed
+        //rendezvous partners need our channels' mutexes to complete an entry, so holding them keeps
+        //the re-check from racing with a handoff to us
+        atomic_store(&claim, CLAIM_OPEN);
+        for (size_t index = 0; index < rendezvous_count; index++)
+        {
+            pthread_mutex_lock(&rendezvous[index]->mutex);
+        }
+        for (size_t index = 0; index < channel_count; index++)
+        {
+            waiters[index].parker = &parker;
+            waiters[index].claim = &claim;
+            waiters[index].data = channel_list[index].data;
+            waiters[index].handed_off = false;
+            waiters[index].set = NULL;
+            waiters[index].index = index;
+            if (channel_list[index].channel->kind == CHANNEL_SYNC)
+            {
+                add_waiter_locked(channel_list[index].channel, channel_list[index].dir, &waiters[index]);
+                wake_sets(channel_list[index].channel, (channel_list[index].dir == SEND) ? RECV : SEND, NULL);
+            }
+            else
+            {
+                add_waiter(channel_list[index].channel, channel_list[index].dir, &waiters[index]);
+            }
+        }
+
+        val = select_poll(channel_list, channel_count, start, selected_index, &claim);
+        if (val != CHANNEL_EMPTY)
+        {
+            atomic_store(&claim, CLAIM_OWNER);
+        }
+        for (size_t index = 0; index < rendezvous_count; index++)
+        {
+            pthread_mutex_unlock(&rendezvous[index]->mutex);
+        }
+
+        bool handed_off = false;
+        if (val == CHANNEL_EMPTY)
+        {
+            //spin with the largest budget among our channels, and tune that channel by how it went
+            channel_t* spin_channel = channel_list[0].channel;
+            for (size_t index = 1; index < channel_count; index++)
+            {
+                if (atomic_load_explicit(&channel_list[index].channel->spin_budget, memory_order_relaxed) >
+                    atomic_load_explicit(&spin_channel->spin_budget, memory_order_relaxed))
+                {
+                    spin_channel = channel_list[index].channel;
+                }
+            }
+            //fibers don't spin, their thread has other fibers to run
+            unsigned budget = (fiber_current() != NULL) ? 0 : atomic_load_explicit(&spin_channel->spin_budget, memory_order_relaxed);
+            if (timed && blocked_since == 0)
+            {
+                blocked_since = now_ns();
+            }
+            uint64_t waited = parker_wait(&parker, budget, &spin_channel->open);
+            if (budget > 0)
+            {
+                tune_spin(spin_channel, waited);
+            }
+            //stop partners from completing any more entries; losing means one already did
+            int expected = CLAIM_OPEN;
+            handed_off = !atomic_compare_exchange_strong(&claim, &expected, CLAIM_OWNER);
+        }
+
+        //leave every queue we weren't woken from and consume the remaining tokens on parker
+        size_t tokens = 0;
+        for (size_t index = 0; index < channel_count; index++)
+        {
+            if (remove_waiter(channel_list[index].channel, channel_list[index].dir, &waiters[index]))
+            {
+                tokens++;
+            }
+        }
+        //every token was posted before its notified flag was set, so none of these can block
+        for (size_t token = (val == CHANNEL_EMPTY) ? 1 : 0; token < tokens; token++)
+        {
+            parker_try_take(&parker);
+        }
+
+        bool slept = (val == CHANNEL_EMPTY);
+        if (handed_off)
+        {
+            for (size_t index = 0; index < channel_count; index++)
+            {
+                if (waiters[index].handed_off)
+                {
+                    *selected_index = index;
+                    channel_list[index].data = waiters[index].data;
+                    val = SUCCESS;
+                }
+            }
+        }
+        else if (slept)
+        {
+            val = select_poll(channel_list, channel_count, start, selected_index, NULL);
+        }
+
+        if (val != CHANNEL_EMPTY)
+        {
+            //if we slept, one token on the selected channel paid for our operation; pass on every
+            //other token so the next waiter on that channel isn't stranded
+            channel_t* selected = channel_list[*selected_index].channel;
+            enum direction selected_dir = channel_list[*selected_index].dir;
+            bool used = !slept;
+            for (size_t index = 0; index < channel_count; index++)
+            {
+                //a rendezvous channel's tokens are handoffs or its close, neither of which can be passed on
+                if (waiters[index].notified == false || channel_list[index].channel->kind == CHANNEL_SYNC)
+                {
+                    continue;
+                }
+                if (!used && channel_list[index].channel == selected && channel_list[index].dir == selected_dir)
+                {
+                    used = true;
+                    continue;
+                }
+                wake_one(channel_list[index].channel, channel_list[index].dir);
+            }
+            break;
+        }
+        //lost the race for every token we were handed, queue up again
+        for (size_t index = 0; index < channel_count; index++)
+        {
+            if (waiters[index].notified)
+            {
+                stats_record_spurious(channel_list[index].channel);
+            }
+        }
+    }
+
+    if (blocked_since != 0)
+    {
+        stats_record_blocked(channel_list[*selected_index].channel, channel_list[*selected_index].dir, now_ns() - blocked_since);
+    }
+    if (waiters != stack_waiters)
+    {
+        free(rendezvous);
+        free(waiters);
+    }
+    return val;
+}
+
+// Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
+// This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
+// If multiple options are available, it selects the first option and performs its corresponding action
+// If no channel is available, the call is blocked and waits till it finds a channel which supports its required operation
+// Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
+// In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
+// Additionally, selected_index is set to the index of the channel that generated the error
+enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index)
+{
+    return select_from(channel_list, channel_count, 0, selected_index);
+}
+
+// Behaves like channel_select, but starts looking at the entry the caller's cursor points at (wrapping around) and
+// moves the cursor one entry on, so an entry that is always ready can't keep the entries after it waiting
+enum channel_status channel_select_fair(select_t* channel_list, size_t channel_count, size_t* selected_index, size_t* cursor)
+{
+    if (channel_count == 0)
+    {
+        return GENERIC_ERROR;
+    }
+    return select_from(channel_list, channel_count, select_cursor_next(cursor, channel_count), selected_index);
+}
+
+// Performs the possible operations of the entries of channel_list from start on, wrapping around and skipping the
+// entry at skip, until count reaches max, appending the index of every entry it performed to completed_indices
+// Returns SUCCESS, or the error of the entry it stopped at (whose index it appends as well)
+enum channel_status select_sweep(select_t* channel_list, size_t channel_count, size_t start, size_t skip,
+                                 size_t* completed_indices, size_t max, size_t* count)
+{
+    for (size_t i = 0; i < channel_count && *count < max; i++)
+    {
+        size_t index = (start + i) % channel_count;
+        if (index == skip)
+        {
+            continue;
+        }
+        enum channel_status val = select_try(&channel_list[index], NULL);
+        if (val == CHANNEL_EMPTY)
+        {
+            continue;
+        }
+        completed_indices[(*count)++] = index;
+        if (val != SUCCESS)
+        {
+            return val;
+        }
+    }
+    return SUCCESS;
+}
+
+// Performs every operation of the channel_count entries of channel_list that is possible right now, up to max of them,
+// and stores the indices of the entries it performed, in the order it performed them, in completed_indices and their
+// number in count
+// The pass starts at the entry the caller's cursor points at and moves it one entry on (see select_cursor_next)
+// Only blocks, like channel_select, when none of the operations is possible, and then goes on with the rest of them
+enum channel_status channel_select_many(select_t* channel_list, size_t channel_count, size_t* completed_indices, size_t max,
+                                        size_t* count, size_t* cursor)
+{
+    *count = 0;
+    if (channel_count == 0 || max == 0)
+    {
+        return GENERIC_ERROR;
+    }
+
+    //every call starts one entry further on, so an entry that is ready on every call isn't always the one cut off by max
+    size_t start = select_cursor_next(cursor, channel_count);
+    enum channel_status val = select_sweep(channel_list, channel_count, start, channel_count, completed_indices, max, count);
+    if (val != SUCCESS || *count > 0)
+    {
+        return val;
+    }
+
+    //nothing was possible: wait for the first operation, then take whatever else has become possible meanwhile
+    size_t index;
+    val = select_from(channel_list, channel_count, start, &index);
+    completed_indices[(*count)++] = index;
+    if (val != SUCCESS)
+    {
+        return val;
+    }
+    return select_sweep(channel_list, channel_count, index + 1, index, completed_indices, max, count);
+}
+
+// Creates a reusable select over the channel_count entries of channel_list and registers every entry with its channel
+// The set keeps using channel_list: update the data of SEND entries in place between waits and read received messages from it
+// Returns the new set, with every entry enabled
+select_set_t* select_set_create(select_t* channel_list, size_t channel_count)
+{
+    select_set_t* set = (select_set_t*)malloc(sizeof(select_set_t));
+
+    set->channel_list = channel_list;
+    set->channel_count = channel_count;
+    set->waiters = (channel_waiter_t*)malloc(sizeof(channel_waiter_t) * channel_count);
+    set->ready = (size_t*)malloc(sizeof(size_t) * channel_count);
+    set->ready_head = 0;
+    set->ready_count = 0;
+    set->queued = (bool*)malloc(sizeof(bool) * channel_count);
+    set->token = (bool*)malloc(sizeof(bool) * channel_count);
+    set->enabled = (bool*)malloc(sizeof(bool) * channel_count);
+    set->forward = (size_t*)malloc(sizeof(size_t) * channel_count);
+    set->rendezvous = (size_t*)malloc(sizeof(size_t) * channel_count);
+    set->rendezvous_count = 0;
+    atomic_init(&set->claim, CLAIM_OWNER);
+    set->waiting = false;
+    set->sleeping = false;
+    pthread_mutex_init(&set->mutex, NULL);
+    atomic_init(&set->parker.value, 0);
+    atomic_init(&set->parker.sleepers, 0);
+    atomic_init(&set->parker.fiber, NULL);
+    set->parker.fd = -1;
+
+    //report every entry once so the first wait polls them all after they are registered
+    for (size_t index = 0; index < channel_count; index++)
+    {
+        set->queued[index] = false;
+        set->token[index] = false;
+        set->enabled[index] = true;
+        ready_push(set, index);
+    }
+
+    for (size_t index = 0; index < channel_count; index++)
+    {
+        channel_waiter_t* waiter = &set->waiters[index];
+        waiter->parker = NULL;
+        waiter->claim = &set->claim;
+        waiter->data = NULL;
+        waiter->handed_off = false;
+        waiter->set = set;
+        waiter->index = index;
+        add_waiter(channel_list[index].channel, channel_list[index].dir, waiter);
+        if (channel_list[index].channel->kind == CHANNEL_SYNC)
+        {
+            set->rendezvous[set->rendezvous_count++] = index;
+        }
+    }
+
+    return set;
+}
+
+// Lets a rendezvous partner complete one enabled entry of the set while its owner sleeps, and tells the sets and
+// readiness fds on the other side of those entries, which may have polled while the claim was closed
+// Must be called with the set's mutex held; the caller releases it before the others are told (see select_set_announce)
+void select_set_open(select_set_t* set)
+{
+    for (size_t i = 0; i < set->rendezvous_count; i++)
+    {
+        //SEND entries may have new data since the last wait
+        size_t index = set->rendezvous[i];
+        set->waiters[index].data = set->channel_list[index].data;
+    }
+    atomic_store(&set->claim, CLAIM_OPEN);
+}
+
+// Reports the enabled rendezvous entries of the set to the waiters on the other side of their channels
+// Must be called without the set's mutex, after select_set_open
+void select_set_announce(select_set_t* set)
+{
+    for (size_t i = 0; i < set->rendezvous_count; i++)
+    {
+        select_t* entry = &set->channel_list[set->rendezvous[i]];
+        if (set->enabled[set->rendezvous[i]])
+        {
+            pthread_mutex_lock(&entry->channel->mutex);
+            wake_sets(entry->channel, (entry->dir == SEND) ? RECV : SEND, set);
+            pthread_mutex_unlock(&entry->channel->mutex);
+        }
+    }
+}
+
+// Stops rendezvous partners from completing entries of the set while its owner polls
+// Returns true and stores the entry's index in selected_index if one already completed an entry since select_set_open
+// Must be called with the set's mutex held
+bool select_set_close(select_set_t* set, size_t* selected_index)
+{
+    int expected = CLAIM_OPEN;
+    if (atomic_compare_exchange_strong(&set->claim, &expected, CLAIM_OWNER) || expected == CLAIM_OWNER)
+    {
+        return false;
+    }
+
+    //the partner reported the entry under our mutex, so the message has already been moved
+    atomic_store(&set->claim, CLAIM_OWNER);
+    for (size_t i = 0; i < set->rendezvous_count; i++)
+    {
+        channel_waiter_t* waiter = &set->waiters[set->rendezvous[i]];
+        if (waiter->handed_off)
+        {
+            waiter->handed_off = false;
+            set->channel_list[waiter->index].data = waiter->data;
+            *selected_index = waiter->index;
+        }
+    }
+    return true;
+}
+
+// Behaves like channel_select on the enabled entries of the set, but only polls the entries their channels reported as
+// possibly ready since the previous wait, in the order they were reported
+// Returns SUCCESS and sets selected_index once an operation has been performed,
+// or the error of the entry that failed (such as CLOSED_ERROR) with selected_index set to its index
+enum channel_status select_set_wait(select_set_t* set, size_t* selected_index)
+{
+    enum channel_status val = CHANNEL_EMPTY;
+
+    pthread_mutex_lock(&set->mutex);
+    set->waiting = true;
+    while (val == CHANNEL_EMPTY)
+    {
+        while (set->ready_count == 0)
+        {
+            //ready_push posts exactly one token per sleep, so parking can't miss it or leave one behind
+            set->sleeping = true;
+            bool rendezvous = (set->rendezvous_count > 0);
+            if (rendezvous)
+            {
+                select_set_open(set);
+            }
+            pthread_mutex_unlock(&set->mutex);
+            if (rendezvous)
+            {
+                select_set_announce(set);
+            }
+            parker_wait(&set->parker, 0, NULL);
+            pthread_mutex_lock(&set->mutex);
+        }
+        size_t index = set->ready[set->ready_head];
+        set->ready_head = (set->ready_head + 1) % set->channel_count;
+        set->ready_count--;
+        bool token = set->token[index];
+        set->queued[index] = false;
+        set->token[index] = false;
+        if (select_set_close(set, selected_index))
+        {
+            //a partner completed an entry while we slept; the one we took stays reported for the next wait
+            ready_push(set, index);
+            set->token[index] = token;
+            val = SUCCESS;
+            break;
+        }
+        if (set->enabled[index] == false)
+        {
+            //select_set_enable reports it again
+            continue;
+        }
+
+        //entries stay registered, so anything that changes after this poll is reported again
+        pthread_mutex_unlock(&set->mutex);
+        size_t unused;
+        val = select_poll(&set->channel_list[index], 1, 0, &unused, NULL);
+        *selected_index = index;
+        if (val == CHANNEL_EMPTY && token)
+        {
+            stats_record_spurious(set->channel_list[index].channel);
+        }
+        pthread_mutex_lock(&set->mutex);
+    }
+    set->waiting = false;
+    if (val == SUCCESS)
+    {
+        //the channel may still be ready for more (a buffer with several messages), and nothing else would report it
+        ready_push(set, *selected_index);
+    }
+
+    //pass on the tokens we took but won't use; their entries stay reported so the next wait polls them
+    size_t forward_count = 0;
+    for (size_t i = 0; i < set->ready_count; i++)
+    {
+        size_t index = set->ready[(set->ready_head + i) % set->channel_count];
+        if (set->token[index])
+        {
+            set->token[index] = false;
+            set->forward[forward_count++] = index;
+        }
+    }
+    pthread_mutex_unlock(&set->mutex);
+
+    for (size_t i = 0; i < forward_count; i++)
+    {
+        select_t* entry = &set->channel_list[set->forward[i]];
+        if (entry->channel->kind != CHANNEL_SYNC)
+        {
+            wake_one(entry->channel, entry->dir);
+        }
+    }
+    return val;
+}
+
+// Enables or disables the entry at index; a disabled entry stays registered but is skipped by select_set_wait
+// Must not be called concurrently with select_set_wait on the same set
+void select_set_enable(select_set_t* set, size_t index, bool enabled)
+{
+    pthread_mutex_lock(&set->mutex);
+    if (enabled && set->enabled[index] == false)
+    {
+        //it may have become ready while nobody was looking
+        ready_push(set, index);
+    }
+    set->enabled[index] = enabled;
+    pthread_mutex_unlock(&set->mutex);
+}
+
+// Unregisters every entry and frees the set
+// Must be called before any channel of the set is destroyed and not concurrently with select_set_wait
+void select_set_destroy(select_set_t* set)
+{
+    for (size_t index = 0; index < set->channel_count; index++)
+    {
+        remove_waiter(set->channel_list[index].channel, set->channel_list[index].dir, &set->waiters[index]);
+    }
+
+    pthread_mutex_destroy(&set->mutex);
+    free(set->rendezvous);
+    free(set->forward);
+    free(set->enabled);
+    free(set->token);
+    free(set->queued);
+    free(set->ready);
+    free(set->waiters);
+    free(set);
+}
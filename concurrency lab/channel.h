@@ -6,10 +6,18 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include "buffer.h"
+#include "spsc_buffer.h"
+#include "broadcast_buffer.h"
+#include "shm_buffer.h"
+#include "sharded_buffer.h"
+#include "priority_buffer.h"
+#include "elastic_buffer.h"
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "linked_list.h"
+#include "fiber.h"
 
 // Defines possible return values from channel functions
 enum channel_status {
@@ -22,17 +30,154 @@ enum channel_status {
     DESTROY_ERROR = -3  // Error during destroy
 };
 
-// Defines channel object
+// Defines which ring a channel stores its messages in
+enum channel_kind {
+    CHANNEL_MPMC, // any number of senders and receivers (channel_create)
+    CHANNEL_SPSC, // at most one sender and one receiver at a time (channel_create_spsc)
+    CHANNEL_SYNC, // no buffer, every send is handed straight to a receiver (channel_create(0))
+    CHANNEL_BROADCAST,  // send-only, every message goes to each of its subscribers (channel_create_broadcast)
+    CHANNEL_SUBSCRIBER, // receive-only, one subscriber's view of a broadcast channel (channel_subscribe)
+    CHANNEL_SHM,        // typed ring in shared memory, usable from several processes (channel_create_shm)
+    CHANNEL_SHARDED,    // one ring per producer lane behind a single channel (channel_create_sharded)
+    CHANNEL_PRIORITY,   // one ring per priority level, highest priority received first (channel_create_priority)
+    CHANNEL_ELASTIC,    // ring that grows under backpressure and shrinks when idle (channel_create_elastic)
+};
+
+// Values of the claim word shared by every entry of one select call
+// A rendezvous partner completes a parked entry only by moving claim from CLAIM_OPEN to
+// CLAIM_PARTNER, so at most one entry of a select is ever completed on its behalf
+enum channel_claim {
+    CLAIM_OPEN = 0,    // parked, any entry may be completed by a partner
+    CLAIM_PARTNER = 1, // a partner completed one of the entries
+    CLAIM_OWNER = 2,   // the owner is awake and completes (or retries) the select itself
+};
+
+// Bounds in nanoseconds for how long a blocked call spins before it yields and then parks
+// Each channel tunes its budget between them from how long recent waits took
+#define CHANNEL_SPIN_MIN 1000
+#define CHANNEL_SPIN_MAX 50000
+// Number of sched_yield calls between spinning and parking
+#define CHANNEL_YIELDS 2
+
+// Defines the word a blocked send/receive/select parks on
+// value counts the readiness tokens posted to the owner; sleepers is set while the owner may be
+// asleep in futex wait, so posting only makes a system call when someone needs waking
+// An owner running as a fiber parks the fiber instead of its thread and leaves itself in fiber
+// The parker of a readiness fd (see channel_event_fd) has no owner to wake: posting writes to fd instead
+typedef struct {
+    atomic_uint value;
+    atomic_uint sleepers;
+    _Atomic(fiber_t*) fiber;
+    int fd; // eventfd to post to, -1 for the parkers of blocked calls
+} channel_parker_t;
+
+// Number of queue-depth buckets in the channel counters: bucket 0 counts operations that left the
+// queue empty and bucket i those that left between 2^(i-1) and 2^i - 1 messages; the last bucket
+// has no upper bound
+#define CHANNEL_STATS_BUCKETS 16
+// Channel counters are split into 2^CHANNEL_STATS_SHARD_BITS shards picked by a hash of the thread
+#define CHANNEL_STATS_SHARD_BITS 4
+
+// Defines one shard of a channel's counters; each shard starts on its own cache line so threads
+// that hash to different shards never write to the same line
 typedef struct {
-    buffer_t* buffer;
-    sem_t sem_send;
-    sem_t sem_receive;
-    list_t* send_list;
-    list_t* recv_list;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t sends;
+    atomic_size_t receives;
+    atomic_size_t blocked_sends;
+    atomic_size_t blocked_receives;
+    atomic_size_t blocked_ns;
+    atomic_size_t spurious_wakeups;
+    atomic_size_t depth[CHANNEL_STATS_BUCKETS];
+} channel_stats_shard_t;
+
+// Defines a snapshot of a channel's counters, summed over every shard (see channel_stats)
+typedef struct {
+    size_t sends;            // messages sent, by any API
+    size_t receives;         // messages received, by any API
+    size_t blocked_sends;    // sends (and SEND select entries) that had to park before completing
+    size_t blocked_receives; // receives (and RECV select entries) that had to park before completing
+    size_t blocked_ns;       // total time those calls spent parked
+    size_t spurious_wakeups; // selects woken by this channel that then found nothing to do
+    size_t depth[CHANNEL_STATS_BUCKETS]; // queue depth left behind by each operation
+} channel_stats_t;
+
+struct select_set;
+
+// Defines a parked send/receive/select entry waiting in a channel's send_list or recv_list
+// Every entry of one select call shares that call's parker; a channel hands a readiness
+// token to one waiter at a time by removing it from its list, setting notified and posting parker
+// On a CHANNEL_SYNC channel the token is the message itself: the partner wins claim, moves data
+// and sets handed_off before posting parker
+// Entries of a select_set_t (set != NULL) stay queued for the life of the set; instead of being
+// dequeued they report entry index to the set's ready queue, also when a partner completed them
+// The queue is linked through prev and next, so a select can keep its waiters on its own stack
+typedef struct channel_waiter {
+    channel_parker_t* parker;
+    bool notified;
+    atomic_int* claim; // enum channel_claim, shared by every entry of one select call
+    void* data;        // value offered by a parked sender, or handed to a parked receiver
+    bool handed_off;
+    struct select_set* set;
+    size_t index;
+    struct channel_waiter* prev; // neighbours in the channel's queue while queued
+    struct channel_waiter* next;
+} channel_waiter_t;
+
+// Defines a FIFO queue of waiters linked through the waiters themselves, so queueing and dequeueing
+// a waiter never allocates and unlinking one from the middle is O(1)
+typedef struct {
+    channel_waiter_t* head;
+    channel_waiter_t* tail;
+} channel_waiter_queue_t;
+
+// Number of entries whose waiters a blocking channel_select (and channel_select_fair/channel_select_many) keeps on
+// its stack; a select over more entries mallocs them every time it blocks and frees them before it returns
+// A select_set_t allocates its waiters once when it is created, so a loop that waits on more channels than this
+// should use one
+#define CHANNEL_SELECT_STACK 16
+
+// Defines the readiness fd of one direction of a channel (see channel_event_fd)
+// waiter is queued like a blocked call's while the fd is armed, and is woken through the same path,
+// except that posting its parker writes to the eventfd and it never uses up a readiness token
+// claim never holds CLAIM_OPEN, so rendezvous partners skip the waiter
+typedef struct {
+    channel_parker_t parker;
+    channel_waiter_t waiter;
+    atomic_int claim;
+} channel_event_t;
+
+// Defines channel object
+// Sends and receives go straight to the lock-free buffer; mutex only guards the wait queues
+// (send_list/recv_list hold channel_waiter_t in FIFO order), and is only taken by a completed
+// operation when send_waiters/recv_waiters says someone on the other side may be asleep
+// A CHANNEL_SYNC channel has an empty buffer and moves every message between a caller and a
+// waiter parked on the other side under mutex
+// A CHANNEL_BROADCAST channel has no receivers of its own: its subscribers are channels that each read
+// the shared broadcast ring through their own cursor, and park in their own recv_list
+typedef struct channel {
+    enum channel_kind kind;
+    size_t elem_size;     // bytes copied per message, 0 for channels of pointers (see channel_create_typed)
+    buffer_t* buffer;     // used by CHANNEL_MPMC
+    spsc_buffer_t* spsc;  // used by CHANNEL_SPSC
+    broadcast_buffer_t* broadcast; // used by CHANNEL_BROADCAST and shared with its subscribers
+    broadcast_cursor_t* cursor;    // used by CHANNEL_SUBSCRIBER
+    struct channel* publisher;     // the CHANNEL_BROADCAST channel a CHANNEL_SUBSCRIBER reads from
+    shm_buffer_t* shm;             // used by CHANNEL_SHM, whose open flag and waiters live in the shared ring
+    sharded_buffer_t* sharded;     // used by CHANNEL_SHARDED
+    priority_buffer_t* priority;   // used by CHANNEL_PRIORITY
+    elastic_buffer_t* elastic;     // used by CHANNEL_ELASTIC
+    channel_waiter_queue_t send_list;
+    channel_waiter_queue_t recv_list;
     pthread_mutex_t mutex;
-    bool open;
-    int send_count;
-    int receive_count;    
+    atomic_bool open;
+    atomic_size_t send_waiters; // length of send_list
+    atomic_size_t recv_waiters; // length of recv_list; for CHANNEL_BROADCAST, the sum over its subscribers
+    atomic_size_t wakeups;      // readiness tokens handed to waiters, excluding close
+    atomic_size_t handoffs;     // messages moved directly between partners on a CHANNEL_SYNC channel
+    atomic_uint spin_budget;    // nanoseconds a blocked call spins before yielding, tuned by how long recent waits took
+    unsigned spin_limit;        // CHANNEL_SPIN_MAX, or 0 on a single CPU where spinning can't help (see channel_set_spin_limit)
+    channel_stats_shard_t* stats; // NULL unless channel_enable_stats was called
+    _Atomic(channel_event_t*) events[2]; // readiness fds by direction, NULL until channel_event_fd asks for one
 } channel_t;
 
 // Defines channel list structure for channel_select function
@@ -47,12 +192,148 @@ typedef struct {
     enum direction dir;
     // If dir is RECV, then the message received from the channel is stored as an output in this parameter, data
     // If dir is SEND, then the message that needs to be sent is given as input in this parameter, data
+    // On a typed channel data always points to an elem_size value: the message to copy in for SEND, and where
+    // to copy the received message for RECV
     void* data;
+    // Priority of a SEND on a priority channel (see channel_send_prio); ignored everywhere else, so entries
+    // that leave it out send at the lowest priority
+    unsigned priority;
 } select_t;
 
+// Defines a reusable select over a fixed list of channels
+// Every entry is registered with its channel once, when the set is created; a channel that may have
+// made an entry ready pushes its index onto ready (each index at most once), so a wait only polls
+// the entries that were reported instead of the whole list
+// While the owner is inside select_set_wait a report also takes the readiness token (token[index]),
+// which is passed on to the next waiter of that channel if the wait completes on another entry
+// Entries on CHANNEL_SYNC channels (listed in rendezvous) share claim like the entries of one
+// channel_select: it is only CLAIM_OPEN while the owner sleeps, so a partner completes at most one
+// entry per wait, and it does so under mutex before reporting the entry
+// mutex guards everything below channel_list/channel_count/waiters
+typedef struct select_set {
+    select_t* channel_list;
+    size_t channel_count;
+    channel_waiter_t* waiters;
+    size_t* ready;      // FIFO ring of reported entry indices, channel_count long
+    size_t ready_head;
+    size_t ready_count;
+    bool* queued;       // entry is in ready
+    bool* token;        // entry holds a readiness token
+    bool* enabled;      // entry takes part in waits
+    size_t* forward;    // scratch space for the tokens handed back when a wait completes
+    size_t* rendezvous; // indices of the entries on CHANNEL_SYNC channels
+    size_t rendezvous_count;
+    atomic_int claim;   // enum channel_claim, shared by every entry of the set
+    bool waiting;       // owner is inside select_set_wait
+    bool sleeping;      // owner is waiting for ready to become non-empty
+    pthread_mutex_t mutex;
+    channel_parker_t parker;
+} select_set_t;
+
 // Creates a new channel with the provided size and returns it to the caller
+// A size of 0 creates an unbuffered channel: a send only completes once a receiver takes the message
+// straight from the sender (and vice versa), including when either side is waiting in channel_select
 channel_t* channel_create(size_t size);
 
+// Creates a new single-producer/single-consumer channel with the provided size and returns it to the caller
+// The caller guarantees that at most one thread sends (including select SEND entries) and at most one
+// thread receives (including select RECV entries) at any time; close, destroy and select behave as for
+// channel_create
+// A size of 0 creates an unbuffered channel, exactly like channel_create(0)
+channel_t* channel_create_spsc(size_t size);
+
+// Creates a new channel with the provided capacity whose messages are elem_size bytes copied into the channel
+// instead of pointers, so producers don't need to allocate each message; a capacity of 0 creates an unbuffered channel
+// channel_send/channel_non_blocking_send and SEND select entries take a pointer to the value to copy in, and
+// channel_receive/channel_non_blocking_receive and RECV select entries take a pointer to where the value is copied out;
+// the batch calls take arrays of such pointers
+channel_t* channel_create_typed(size_t capacity, size_t elem_size);
+
+// Creates a new broadcast channel whose ring holds capacity messages (at least 1) of elem_size bytes, or
+// pointers if elem_size is 0
+// A message sent on it is written to the ring once and received by every subscriber (see channel_subscribe)
+// that was subscribed when it was sent; receiving from the broadcast channel itself is a GENERIC_ERROR
+// A send blocks (and a non-blocking send returns CHANNEL_FULL) while some subscriber is capacity messages
+// behind; the publisher can check channel_lag and close subscribers it would rather drop than wait for
+// Closing the broadcast channel closes every subscriber; it may then be destroyed before them
+channel_t* channel_create_broadcast(size_t capacity, size_t elem_size);
+
+// Creates a new channel that receives every message sent on the given broadcast channel from now on,
+// in order, through the same calls as any other channel (typed if the broadcast channel is)
+// At most one thread may receive from a subscriber at a time (including select RECV entries); sending
+// on it is a GENERIC_ERROR. Closing a subscriber unsubscribes it, releasing the messages it held back
+// Returns NULL if channel is not an open broadcast channel
+channel_t* channel_subscribe(channel_t* channel);
+
+// Returns the number of messages sent on a subscriber's broadcast channel that it hasn't received yet,
+// or for a broadcast channel the largest such number among its subscribers
+// Only a snapshot when other threads are sending or receiving at the same time
+size_t channel_lag(channel_t* channel);
+
+// Creates a new typed channel whose ring of capacity messages of elem_size bytes lives in the shared memory
+// object name (a / followed by up to 62 characters), so that other processes can open it with channel_open_shm
+// Messages are copied straight into the shared ring, and a send or receive that doesn't have to wait makes
+// no system call. Blocking calls sleep on futex words in the ring and never spin, so a fiber calling them
+// blocks its whole thread; select and select_set return GENERIC_ERROR for entries on such channels
+// Closing the channel in any process closes it in all of them, and so does a process that had it open
+// exiting without channel_destroy (noticed within SHM_BUFFER_LIVENESS_MS by the calls blocked on it)
+// channel_destroy only releases this process's handle; the object is removed once every process has done so
+// Returns NULL if name is taken or the object can't be created
+channel_t* channel_create_shm(const char* name, size_t capacity, size_t elem_size);
+
+// Opens the channel another process created with channel_create_shm (see there)
+// Returns NULL if there is no such channel or SHM_BUFFER_PEERS processes already have it open
+channel_t* channel_open_shm(const char* name);
+
+// Creates a new channel for many producers whose messages (elem_size bytes each, or pointers if elem_size is 0) go into
+// lanes separate rings (0 for one per CPU) holding capacity messages (at least 1 per lane) between them
+// Each sending thread has a home lane, so producers on different lanes don't contend on the same cache lines, and
+// receivers take messages from the lanes in round-robin order. Without fifo a send spills into another lane when its
+// home lane is full, so it only waits while the whole channel is full, and messages from one producer may be received
+// out of order; with fifo every producer only uses its home lane, so its messages are received in the order it sent
+// them, but its sends wait while that lane is full
+// The channel works with every call and with select, select sets and close like a channel_create channel
+channel_t* channel_create_sharded(size_t capacity, size_t elem_size, size_t lanes, bool fifo);
+
+// Creates a new channel of pointers holding capacity messages (at least 1) that are received highest priority first
+// and in the order they were sent within a priority, so urgent messages overtake the ones already queued
+// channel_send_prio and SEND select entries give the priority, from 0 (the lowest, which every other send uses) to
+// PRIORITY_LEVELS - 1; higher priorities count as the highest
+// The channel works with every call and with select, select sets and close like a channel_create channel
+channel_t* channel_create_priority(size_t capacity);
+
+// Creates a new channel of pointers whose ring starts at capacity messages (at least 1) and adapts to the load:
+// a send that finds it full doubles it, up to max_capacity messages, instead of blocking, and once receives have
+// kept it at most a quarter full for as many receives as it holds, it is halved again, down to capacity
+// Sends only block while the channel holds max_capacity messages. A resize holds up the channel's other sends and
+// receives for one copy of the messages in it at most, and keeps them in order
+// The channel works with every call and with select, select sets and close like a channel_create channel
+channel_t* channel_create_elastic(size_t capacity, size_t max_capacity);
+
+// Returns an eventfd that becomes readable once an operation in the given direction may be possible on the channel
+// (a message to receive for RECV, room to send for SEND) or the channel is closed, so a channel can be waited on in
+// poll or epoll next to sockets; the fd belongs to the channel and is closed by channel_destroy
+// The fd starts out readable; it is drained and armed again whenever a non-blocking call in that direction returns
+// CHANNEL_EMPTY or CHANNEL_FULL, so an event loop calls the non-blocking calls until they report that and then waits
+// Readiness is only a hint: another thread may take the message or the slot first
+// Returns -1 for the direction a broadcast channel or subscriber can't be used in, for shared-memory channels, and if
+// the eventfd can't be created
+int channel_event_fd(channel_t* channel, enum direction dir);
+
+// Copies the elem_size bytes at value into the given typed channel
+// This is a blocking call i.e., the function only returns on a successful completion of send
+// Returns SUCCESS for successfully writing the value to the channel,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_value(channel_t* channel, const void* value);
+
+// Copies the oldest message of the given typed channel into the elem_size bytes at value
+// This is a blocking call i.e., the function only returns on a successful completion of receive
+// Returns SUCCESS for successful retrieval of a message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_value(channel_t* channel, void* value);
+
 // Writes data to the given channel
 // This is a blocking call i.e., the function only returns on a successful completion of send
 // In case the channel is full, the function waits till the channel has space to write the new data
@@ -61,6 +342,11 @@ channel_t* channel_create(size_t size);
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_send(channel_t* channel, void* data);
 
+// Writes data to the given channel at the given priority, like channel_send
+// Only a priority channel (see channel_create_priority) orders messages by priority; other channels ignore it
+// Returns the same as channel_send
+enum channel_status channel_send_prio(channel_t* channel, void* data, unsigned priority);
+
 // Reads data from the given channel and stores it in the function's input parameter, data (Note that it is a double pointer)
 // This is a blocking call i.e., the function only returns on a successful completion of receive
 // In case the channel is empty, the function waits till the channel has some data to read
@@ -85,6 +371,40 @@ enum channel_status channel_non_blocking_send(channel_t* channel, void* data);
 // GENERIC_ERROR on encountering any other generic error of any sort
 enum channel_status channel_non_blocking_receive(channel_t* channel, void** data);
 
+// Writes the n messages in items to the given channel in order, moving as many as fit under one synchronization at a time
+// This is a blocking call i.e., the function only returns once all n messages are sent
+// The number of messages actually sent is stored in sent, even on error
+// Returns SUCCESS for successfully writing all the messages,
+// CLOSED_ERROR if the channel is closed before all of them were written, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_send_batch(channel_t* channel, void** items, size_t n, size_t* sent);
+
+// Reads up to max messages from the given channel into out in FIFO order, taking every message already buffered under one synchronization
+// This is a blocking call i.e., the function waits till the channel has at least one message to read
+// The number of messages read is stored in got
+// Returns SUCCESS for successful retrieval of at least one message,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_receive_batch(channel_t* channel, void** out, size_t max, size_t* got);
+
+// Writes as many of the n messages in items as fit to the given channel under one synchronization
+// This is a non-blocking call i.e., the function simply returns if the channel is full
+// The number of messages actually sent is stored in sent
+// Returns SUCCESS if at least one message was written (or n is 0),
+// CHANNEL_FULL if the channel is full and nothing was added to the buffer,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_send_batch(channel_t* channel, void** items, size_t n, size_t* sent);
+
+// Reads up to max messages that are already in the given channel into out under one synchronization
+// This is a non-blocking call i.e., the function simply returns if the channel is empty
+// The number of messages read is stored in got
+// Returns SUCCESS if at least one message was read (or max is 0),
+// CHANNEL_EMPTY if the channel is empty and nothing was stored in out,
+// CLOSED_ERROR if the channel is closed, and
+// GENERIC_ERROR on encountering any other generic error of any sort
+enum channel_status channel_non_blocking_receive_batch(channel_t* channel, void** out, size_t max, size_t* got);
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -99,6 +419,27 @@ enum channel_status channel_close(channel_t* channel);
 // GENERIC_ERROR in any other error case
 enum channel_status channel_destroy(channel_t* channel);
 
+// Returns the number of times the channel woke a parked sender, receiver or select divided by the
+// number of messages sent on it so far; a value close to 1 means no thundering herds
+double channel_wakeups_per_message(channel_t* channel);
+
+// Sets the longest time in nanoseconds that a blocked call on the given channel spins before it yields and parks,
+// and restarts the channel's spin budget from CHANNEL_SPIN_MIN (0 turns spinning off)
+// Must be called before the channel is shared with other threads
+void channel_set_spin_limit(channel_t* channel, unsigned limit);
+
+// Starts counting operations on the given channel (see channel_stats_t)
+// Must be called before the channel is shared with other threads; channels without counters pay a single branch per operation
+void channel_enable_stats(channel_t* channel);
+
+// Stores a snapshot of the channel's counters in stats
+// Returns SUCCESS if the counters were copied, and
+// GENERIC_ERROR if channel_enable_stats was never called on the channel
+enum channel_status channel_stats(channel_t* channel, channel_stats_t* stats);
+
+// Writes one line of counters for every live channel with counters enabled to out
+void channel_stats_dump(FILE* out);
+
 // Takes an array of channels (channel_list) of type select_t and the array length (channel_count) as inputs
 // This API iterates over the provided list and finds the set of possible channels which can be used to invoke the required operation (send or receive) specified in select_t
 // If multiple options are available, it selects the first option and performs its corresponding action
@@ -106,6 +447,50 @@ enum channel_status channel_destroy(channel_t* channel);
 // Once an operation has been successfully performed, select should set selected_index to the index of the channel that performed the operation and then return SUCCESS
 // In the event that a channel is closed or encounters any error, the error should be propagated and returned through select
 // Additionally, selected_index is set to the index of the channel that generated the error
+// Never allocates when channel_count is at most CHANNEL_SELECT_STACK
 enum channel_status channel_select(select_t* channel_list, size_t channel_count, size_t* selected_index);
 
+// Behaves like channel_select, except that when several entries are possible it doesn't always take the first: every
+// call starts looking at entry *cursor % channel_count, wraps around, and leaves *cursor one entry further on, so under
+// load every entry gets its turn instead of the low indices winning every time
+// cursor belongs to the caller like channel_select_many's: start it at 0 and keep one per select site, without sharing
+// it between threads that select at the same time; a NULL cursor behaves like channel_select
+// Returns the same as channel_select, and GENERIC_ERROR if channel_count is 0
+enum channel_status channel_select_fair(select_t* channel_list, size_t channel_count, size_t* selected_index, size_t* cursor);
+
+// Performs every operation of the channel_count entries of channel_list that is possible right now, up to max of them,
+// and stores the indices of the entries it performed, in the order it performed them, in completed_indices and their
+// number in count
+// Each entry is performed at most once. The pass starts at entry *cursor % channel_count, wraps around, and leaves
+// *cursor one entry further on, so when max cuts passes short no entry is always left for last
+// cursor belongs to the caller: start it at 0 and keep one per select site, without sharing it between threads that
+// select at the same time; a NULL cursor starts every pass at the first entry
+// Only blocks, like channel_select, when none of the operations is possible, and then goes on with the rest of them
+// Returns SUCCESS once at least one operation has been performed
+// In the event that a channel is closed or encounters any error, stops and returns the error; the index of the entry
+// that generated it is then the last of the count indices, after the ones of the operations that did complete
+// Returns GENERIC_ERROR with count 0 if channel_count or max is 0
+enum channel_status channel_select_many(select_t* channel_list, size_t channel_count, size_t* completed_indices, size_t max,
+                                        size_t* count, size_t* cursor);
+
+// Creates a reusable select over the channel_count entries of channel_list and registers every entry with its channel
+// The set keeps using channel_list: update the data of SEND entries in place between waits and read received messages from it
+// An entry on an unbuffered channel pairs up with plain sends/receives, channel_select calls and the entries of other sets
+// Returns the new set, with every entry enabled
+select_set_t* select_set_create(select_t* channel_list, size_t channel_count);
+
+// Behaves like channel_select on the enabled entries of the set, but only polls the entries their channels reported as
+// possibly ready since the previous wait, in the order they were reported
+// Returns SUCCESS and sets selected_index once an operation has been performed,
+// or the error of the entry that failed (such as CLOSED_ERROR) with selected_index set to its index
+enum channel_status select_set_wait(select_set_t* set, size_t* selected_index);
+
+// Enables or disables the entry at index; a disabled entry stays registered but is skipped by select_set_wait
+// Must not be called concurrently with select_set_wait on the same set
+void select_set_enable(select_set_t* set, size_t index, bool enabled);
+
+// Unregisters every entry and frees the set
+// Must be called before any channel of the set is destroyed and not concurrently with select_set_wait
+void select_set_destroy(select_set_t* set);
+
 #endif // CHANNEL_H
\ No newline at end of file
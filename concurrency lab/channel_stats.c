@@ -0,0 +1,50 @@
+#include "channel_stats.h"
+
+// Every live channel with counters enabled
+// Kept out of channel.c, which must not have any global state
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static list_t* registry = NULL;
+
+// Adds a channel with counters enabled to the list channel_stats_dump walks
+void stats_register(channel_t* channel)
+{
+    pthread_mutex_lock(&registry_mutex);
+    if (registry == NULL)
+    {
+        registry = list_create();
+    }
+    list_insert(registry, channel);
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+// Removes a channel from the list channel_stats_dump walks, before it is destroyed
+void stats_unregister(channel_t* channel)
+{
+    pthread_mutex_lock(&registry_mutex);
+    list_remove(registry, channel);
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+// Writes one line of counters for every live channel with counters enabled to out
+void channel_stats_dump(FILE* out)
+{
+    pthread_mutex_lock(&registry_mutex);
+    if (registry != NULL)
+    {
+        for (list_node_t* node = list_head(registry); node != NULL; node = list_next(node))
+        {
+            channel_t* channel = (channel_t*)list_data(node);
+            channel_stats_t stats;
+            channel_stats(channel, &stats);
+            fprintf(out, "channel=%p sends=%zu receives=%zu blocked_sends=%zu blocked_receives=%zu blocked_ns=%zu spurious_wakeups=%zu depth=",
+                    (void*)channel, stats.sends, stats.receives, stats.blocked_sends, stats.blocked_receives,
+                    stats.blocked_ns, stats.spurious_wakeups);
+            for (size_t bucket = 0; bucket < CHANNEL_STATS_BUCKETS; bucket++)
+            {
+                fprintf(out, (bucket == 0) ? "%zu" : ",%zu", stats.depth[bucket]);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+}
@@ -0,0 +1,12 @@
+#ifndef CHANNEL_STATS_H
+#define CHANNEL_STATS_H
+
+#include "channel.h"
+
+// Adds a channel with counters enabled to the list channel_stats_dump walks
+void stats_register(channel_t* channel);
+
+// Removes a channel from the list channel_stats_dump walks, before it is destroyed
+void stats_unregister(channel_t* channel);
+
+#endif // CHANNEL_STATS_H
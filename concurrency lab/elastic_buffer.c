@@ -0,0 +1,188 @@
+#include "elastic_buffer.h"
+
+// Creates a buffer of pointers that starts at capacity messages (at least 1), never shrinks below that and
+// grows up to max_capacity messages (at least capacity)
+elastic_buffer_t* elastic_buffer_create(size_t capacity, size_t max_capacity)
+{
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    if (max_capacity < capacity) {
+        max_capacity = capacity;
+    }
+    elastic_buffer_t* buffer = (elastic_buffer_t*) aligned_alloc(BUFFER_CACHE_LINE, sizeof(elastic_buffer_t));
+    pthread_rwlock_init(&buffer->lock, NULL);
+    buffer->ring = buffer_create(capacity);
+    buffer->min_capacity = capacity;
+    buffer->max_capacity = max_capacity;
+    buffer->retired = 0;
+    atomic_init(&buffer->resizes, 0);
+    atomic_init(&buffer->quiet, 0);
+    return buffer;
+}
+
+// Replaces the ring with one of capacity messages, unless another thread has resized it since resizes was generation
+// or the messages no longer fit; the new ring is allocated and the old one freed outside the lock, so the only time
+// adds and removes wait is while the live messages are moved across
+void resize_ring(elastic_buffer_t* buffer, size_t generation, size_t capacity)
+{
+    buffer_t* ring = buffer_create(capacity);
+    pthread_rwlock_wrlock(&buffer->lock);
+    buffer_t* old = buffer->ring;
+    if (atomic_load_explicit(&buffer->resizes, memory_order_relaxed) != generation || buffer_current_size(old) > capacity) {
+        pthread_rwlock_unlock(&buffer->lock);
+        buffer_free(ring);
+        return;
+    }
+    void* batch[ELASTIC_BUFFER_COPY_BATCH];
+    size_t moved = 0;
+    size_t count;
+    while ((count = buffer_remove_batch(old, batch, ELASTIC_BUFFER_COPY_BATCH)) > 0) {
+        buffer_add_batch(ring, batch, count);
+        moved += count;
+    }
+    buffer->retired += atomic_load_explicit(&old->tail, memory_order_relaxed) - moved;
+    buffer->ring = ring;
+    atomic_store_explicit(&buffer->quiet, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buffer->resizes, 1, memory_order_relaxed);
+    pthread_rwlock_unlock(&buffer->lock);
+    buffer_free(old);
+}
+
+// Returns the capacity to grow a full ring of capacity messages to, or 0 if it is already at max_capacity
+size_t grown_capacity(elastic_buffer_t* buffer, size_t capacity)
+{
+    if (capacity >= buffer->max_capacity) {
+        return 0;
+    }
+    return (capacity > buffer->max_capacity / 2) ? buffer->max_capacity : capacity * 2;
+}
+
+// Counts a remove that left size messages in the ring of the given capacity and generation, and halves the ring once
+// it has been at most a quarter full for a whole ring's worth of removes in a row
+void note_remove(elastic_buffer_t* buffer, size_t generation, size_t capacity, size_t size)
+{
+    if (capacity <= buffer->min_capacity) {
+        return;
+    }
+    if (size > capacity / 4) {
+        if (atomic_load_explicit(&buffer->quiet, memory_order_relaxed) != 0) {
+            atomic_store_explicit(&buffer->quiet, 0, memory_order_relaxed);
+        }
+        return;
+    }
+    if (atomic_fetch_add_explicit(&buffer->quiet, 1, memory_order_relaxed) + 1 >= capacity) {
+        atomic_store_explicit(&buffer->quiet, 0, memory_order_relaxed);
+        size_t halved = capacity / 2;
+        resize_ring(buffer, generation, halved > buffer->min_capacity ? halved : buffer->min_capacity);
+    }
+}
+
+// Adds data to the buffer, doubling the ring first if it is full and below max_capacity
+// Safe to call concurrently with every other elastic_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if the buffer is full at max_capacity
+enum buffer_status elastic_buffer_add(elastic_buffer_t* buffer, void* data)
+{
+    while (true) {
+        pthread_rwlock_rdlock(&buffer->lock);
+        enum buffer_status status = buffer_add(buffer->ring, data);
+        size_t capacity = buffer->ring->capacity;
+        size_t generation = atomic_load_explicit(&buffer->resizes, memory_order_relaxed);
+        pthread_rwlock_unlock(&buffer->lock);
+        size_t grown = grown_capacity(buffer, capacity);
+        if (status == BUFFER_SUCCESS || grown == 0) {
+            return status;
+        }
+        resize_ring(buffer, generation, grown);
+    }
+}
+
+// Removes the oldest value in the buffer and stores it in data, halving the ring if it has stayed mostly empty
+// Safe to call concurrently with every other elastic_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if the buffer is empty
+enum buffer_status elastic_buffer_remove(elastic_buffer_t* buffer, void** data)
+{
+    pthread_rwlock_rdlock(&buffer->lock);
+    enum buffer_status status = buffer_remove(buffer->ring, data);
+    size_t size = buffer_current_size(buffer->ring);
+    size_t capacity = buffer->ring->capacity;
+    size_t generation = atomic_load_explicit(&buffer->resizes, memory_order_relaxed);
+    pthread_rwlock_unlock(&buffer->lock);
+    if (status == BUFFER_SUCCESS) {
+        note_remove(buffer, generation, capacity, size);
+    }
+    return status;
+}
+
+// Adds up to count values from data in order, growing the ring like elastic_buffer_add
+// Returns the number of values added, which is 0 if the buffer is full at max_capacity
+size_t elastic_buffer_add_batch(elastic_buffer_t* buffer, void** data, size_t count)
+{
+    size_t added = 0;
+    while (true) {
+        pthread_rwlock_rdlock(&buffer->lock);
+        added += buffer_add_batch(buffer->ring, &data[added], count - added);
+        size_t capacity = buffer->ring->capacity;
+        size_t generation = atomic_load_explicit(&buffer->resizes, memory_order_relaxed);
+        pthread_rwlock_unlock(&buffer->lock);
+        size_t grown = grown_capacity(buffer, capacity);
+        if (added == count || grown == 0) {
+            return added;
+        }
+        resize_ring(buffer, generation, grown);
+    }
+}
+
+// Removes up to max values into data in FIFO order
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t elastic_buffer_remove_batch(elastic_buffer_t* buffer, void** data, size_t max)
+{
+    pthread_rwlock_rdlock(&buffer->lock);
+    size_t removed = buffer_remove_batch(buffer->ring, data, max);
+    size_t size = buffer_current_size(buffer->ring);
+    size_t capacity = buffer->ring->capacity;
+    size_t generation = atomic_load_explicit(&buffer->resizes, memory_order_relaxed);
+    pthread_rwlock_unlock(&buffer->lock);
+    if (removed > 0) {
+        note_remove(buffer, generation, capacity, size);
+    }
+    return removed;
+}
+
+// Returns the number of messages the ring currently holds
+size_t elastic_buffer_capacity(elastic_buffer_t* buffer)
+{
+    pthread_rwlock_rdlock(&buffer->lock);
+    size_t capacity = buffer->ring->capacity;
+    pthread_rwlock_unlock(&buffer->lock);
+    return capacity;
+}
+
+// Returns the number of messages ever added to the buffer
+size_t elastic_buffer_added(elastic_buffer_t* buffer)
+{
+    pthread_rwlock_rdlock(&buffer->lock);
+    size_t added = buffer->retired + atomic_load(&buffer->ring->tail);
+    pthread_rwlock_unlock(&buffer->lock);
+    return added;
+}
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t elastic_buffer_current_size(elastic_buffer_t* buffer)
+{
+    pthread_rwlock_rdlock(&buffer->lock);
+    size_t size = buffer_current_size(buffer->ring);
+    pthread_rwlock_unlock(&buffer->lock);
+    return size;
+}
+
+// Frees the memory allocated to the buffer
+void elastic_buffer_free(elastic_buffer_t* buffer)
+{
+    buffer_free(buffer->ring);
+    pthread_rwlock_destroy(&buffer->lock);
+    free(buffer);
+}
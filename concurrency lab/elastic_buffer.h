@@ -0,0 +1,66 @@
+#ifndef ELASTIC_BUFFER_H
+#define ELASTIC_BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "buffer.h"
+
+// Number of pointers a resize moves from the old ring to the new one per batch
+#define ELASTIC_BUFFER_COPY_BATCH 64
+
+// Bounded multi-producer/multi-consumer queue of pointers whose ring grows and shrinks with the load
+// Adds and removes run on the current buffer_t ring under the read side of lock, so they stay lock-free with respect
+// to each other. An add that finds the ring full doubles it (up to max_capacity) and retries; a ring whose removes
+// have left it at most a quarter full for capacity removes in a row is halved (down to min_capacity). A resize
+// allocates the new ring first and holds the write side of lock only while it moves the live messages across, so
+// adds and removes wait for at most one copy of the messages in the channel, which stay in FIFO order
+typedef struct {
+    pthread_rwlock_t lock;
+    buffer_t* ring;           // replaced under the write side of lock
+    size_t min_capacity;
+    size_t max_capacity;
+    size_t retired;           // messages added to earlier rings and not moved to this one
+    atomic_size_t resizes;    // number of times the ring was replaced, so a resize can tell it is out of date
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t quiet; // removes in a row that left the ring at most a quarter full
+} elastic_buffer_t;
+
+// Creates a buffer of pointers that starts at capacity messages (at least 1), never shrinks below that and
+// grows up to max_capacity messages (at least capacity)
+elastic_buffer_t* elastic_buffer_create(size_t capacity, size_t max_capacity);
+
+// Adds data to the buffer, doubling the ring first if it is full and below max_capacity
+// Safe to call concurrently with every other elastic_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if the buffer is full at max_capacity
+enum buffer_status elastic_buffer_add(elastic_buffer_t* buffer, void* data);
+
+// Removes the oldest value in the buffer and stores it in data, halving the ring if it has stayed mostly empty
+// Safe to call concurrently with every other elastic_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if the buffer is empty
+enum buffer_status elastic_buffer_remove(elastic_buffer_t* buffer, void** data);
+
+// Adds up to count values from data in order, growing the ring like elastic_buffer_add
+// Returns the number of values added, which is 0 if the buffer is full at max_capacity
+size_t elastic_buffer_add_batch(elastic_buffer_t* buffer, void** data, size_t count);
+
+// Removes up to max values into data in FIFO order
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t elastic_buffer_remove_batch(elastic_buffer_t* buffer, void** data, size_t max);
+
+// Returns the number of messages the ring currently holds
+size_t elastic_buffer_capacity(elastic_buffer_t* buffer);
+
+// Returns the number of messages ever added to the buffer
+size_t elastic_buffer_added(elastic_buffer_t* buffer);
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t elastic_buffer_current_size(elastic_buffer_t* buffer);
+
+// Frees the memory allocated to the buffer
+void elastic_buffer_free(elastic_buffer_t* buffer);
+
+#endif // ELASTIC_BUFFER_H
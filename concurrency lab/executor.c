@@ -0,0 +1,347 @@
+#include "executor.h"
+#include <assert.h>
+#include <unistd.h>
+
+#define EXECUTOR_DEQUE_SIZE 256
+
+typedef struct {
+    void* (*fn)(void*);
+    void* arg;
+    channel_t* results;
+} executor_task_t;
+
+typedef struct {
+    executor_deque_t deque;
+    pthread_t thread;
+    executor_t* executor;
+    unsigned seed;  // picks the first victim to steal from
+} executor_worker_t;
+
+struct executor {
+    executor_worker_t* workers;
+    size_t threads;
+    channel_t* submissions;  // tasks from outside the executor, and NULL wake-ups for idle workers
+    atomic_size_t idle;      // workers blocked, or about to block, on submissions
+    atomic_size_t pending;   // tasks submitted that haven't finished
+    pthread_mutex_t mutex;
+    pthread_cond_t finished; // signaled when pending drops to 0
+};
+
+// Worker running on this thread, NULL on threads outside every executor
+static _Thread_local executor_worker_t* this_worker = NULL;
+
+executor_array_t* array_create(int64_t capacity)
+{
+    executor_array_t* array = (executor_array_t*)malloc(sizeof(executor_array_t) + sizeof(void*) * (size_t)capacity);
+    array->capacity = capacity;
+    return array;
+}
+
+// Initializes an empty deque
+void executor_deque_init(executor_deque_t* deque)
+{
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array_create(EXECUTOR_DEQUE_SIZE));
+    deque->retired = list_create();
+}
+
+// Pushes an item at the bottom of the deque, doubling its array when full
+// Only the owner may call this
+void executor_deque_push(executor_deque_t* deque, void* item)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    executor_array_t* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    if (bottom - top > array->capacity - 1)
+    {
+        executor_array_t* grown = array_create(array->capacity * 2);
+        for (int64_t i = top; i < bottom; i++)
+        {
+            atomic_store_explicit(&grown->items[i % grown->capacity],
+                                  atomic_load_explicit(&array->items[i % array->capacity], memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        list_insert(deque->retired, array);
+        atomic_store_explicit(&deque->array, grown, memory_order_release);
+        array = grown;
+    }
+    atomic_store_explicit(&array->items[bottom % array->capacity], item, memory_order_relaxed);
+    //a release store rather than the usual release fence, which the thread sanitizer can't follow
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+}
+
+// Takes the item at the bottom of the deque, the one pushed last
+// Only the owner may call this; returns NULL if the deque is empty
+void* executor_deque_take(executor_deque_t* deque)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    executor_array_t* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    //pairs with the fence in executor_deque_steal so the owner and a thief can't both take the last item
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    void* item = NULL;
+    if (top <= bottom)
+    {
+        item = atomic_load_explicit(&array->items[bottom % array->capacity], memory_order_relaxed);
+        if (top == bottom)
+        {
+            //last item: race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            {
+                item = NULL;
+            }
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+// Takes the item at the top of the deque, the oldest one
+// Any thread may call this; returns the item, NULL if the deque is empty, or EXECUTOR_STEAL_RETRY if another
+// thread took the item first
+void* executor_deque_steal(executor_deque_t* deque)
+{
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    executor_array_t* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    void* item = atomic_load_explicit(&array->items[top % array->capacity], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return EXECUTOR_STEAL_RETRY;
+    }
+    return item;
+}
+
+// Returns true if the deque looks non-empty; only a snapshot
+bool deque_has_items(executor_deque_t* deque)
+{
+    return atomic_load(&deque->bottom) - atomic_load(&deque->top) > 0;
+}
+
+// Frees the deque's arrays; no thread may use the deque any more
+void executor_deque_free(executor_deque_t* deque)
+{
+    for (list_node_t* node = list_head(deque->retired); node != NULL; node = list_next(node))
+    {
+        free(list_data(node));
+    }
+    list_destroy(deque->retired);
+    free(atomic_load(&deque->array));
+}
+
+// Runs a task, delivers its result and counts it as finished
+void run_task(executor_t* executor, executor_task_t* task)
+{
+    void* result = task->fn(task->arg);
+    if (task->results != NULL)
+    {
+        enum channel_status status = channel_send(task->results, result);
+        assert(status == SUCCESS);
+    }
+    free(task);
+    if (atomic_fetch_sub(&executor->pending, 1) == 1)
+    {
+        pthread_mutex_lock(&executor->mutex);
+        pthread_cond_broadcast(&executor->finished);
+        pthread_mutex_unlock(&executor->mutex);
+    }
+}
+
+// Steals a task from the other workers, starting from a random victim
+executor_task_t* steal_task(executor_worker_t* worker)
+{
+    executor_t* executor = worker->executor;
+    worker->seed = worker->seed * 1103515245 + 12345;
+    size_t victim = (worker->seed >> 8) % executor->threads;
+    bool retry = true;
+    while (retry)
+    {
+        retry = false;
+        for (size_t i = 0; i < executor->threads; i++)
+        {
+            executor_worker_t* other = &executor->workers[(victim + i) % executor->threads];
+            if (other == worker)
+            {
+                continue;
+            }
+            void* item = executor_deque_steal(&other->deque);
+            if (item == EXECUTOR_STEAL_RETRY)
+            {
+                retry = true;
+            }
+            else if (item != NULL)
+            {
+                return (executor_task_t*)item;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Returns true if any worker's deque looks non-empty
+bool any_deque_has_items(executor_t* executor)
+{
+    for (size_t i = 0; i < executor->threads; i++)
+    {
+        if (deque_has_items(&executor->workers[i].deque))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void* executor_worker_main(void* arg)
+{
+    executor_worker_t* worker = (executor_worker_t*)arg;
+    executor_t* executor = worker->executor;
+    this_worker = worker;
+    while (true)
+    {
+        executor_task_t* task = (executor_task_t*)executor_deque_take(&worker->deque);
+        if (task == NULL)
+        {
+            task = steal_task(worker);
+        }
+        if (task == NULL)
+        {
+            void* data = NULL;
+            if (channel_non_blocking_receive(executor->submissions, &data) == SUCCESS)
+            {
+                task = (executor_task_t*)data;
+            }
+        }
+        if (task != NULL)
+        {
+            run_task(executor, task);
+            continue;
+        }
+
+        //the increment pairs with the fence in executor_submit: either it sees us idle or we see its task
+        atomic_fetch_add(&executor->idle, 1);
+        if (any_deque_has_items(executor))
+        {
+            atomic_fetch_sub(&executor->idle, 1);
+            continue;
+        }
+        void* data = NULL;
+        enum channel_status status = channel_receive(executor->submissions, &data);
+        atomic_fetch_sub(&executor->idle, 1);
+        if (status != SUCCESS)
+        {
+            break;
+        }
+        if (data != NULL)
+        {
+            run_task(executor, (executor_task_t*)data);
+        }
+    }
+    this_worker = NULL;
+    return NULL;
+}
+
+// Creates an executor with threads worker threads (0 for one per CPU)
+// Tasks submitted from outside the executor go through a channel of queue_size tasks; tasks submitted
+// by running tasks go onto their worker's deque, where idle workers steal them
+executor_t* executor_create(size_t threads, size_t queue_size)
+{
+    if (threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    executor_t* executor = (executor_t*)malloc(sizeof(executor_t));
+    executor->threads = threads;
+    //wake-ups are sent without blocking, so they need room in the buffer
+    executor->submissions = channel_create(queue_size > 0 ? queue_size : 1);
+    atomic_init(&executor->idle, 0);
+    atomic_init(&executor->pending, 0);
+    pthread_mutex_init(&executor->mutex, NULL);
+    pthread_cond_init(&executor->finished, NULL);
+    executor->workers = (executor_worker_t*)aligned_alloc(64, sizeof(executor_worker_t) * threads);
+    for (size_t i = 0; i < threads; i++)
+    {
+        executor_deque_init(&executor->workers[i].deque);
+        executor->workers[i].executor = executor;
+        executor->workers[i].seed = (unsigned)i + 1;
+    }
+    for (size_t i = 0; i < threads; i++)
+    {
+        int status = pthread_create(&executor->workers[i].thread, NULL, executor_worker_main, &executor->workers[i]);
+        assert(status == 0);
+    }
+    return executor;
+}
+
+// Runs fn(arg) on one of the executor's workers and then sends its return value on results, unless results is NULL
+// Blocks while the submission channel is full when called from outside the executor
+// Returns SUCCESS, or CLOSED_ERROR if the executor is being destroyed
+enum channel_status executor_submit(executor_t* executor, void* (*fn)(void*), void* arg, channel_t* results)
+{
+    executor_task_t* task = (executor_task_t*)malloc(sizeof(executor_task_t));
+    task->fn = fn;
+    task->arg = arg;
+    task->results = results;
+    atomic_fetch_add(&executor->pending, 1);
+
+    executor_worker_t* worker = this_worker;
+    if (worker != NULL && worker->executor == executor)
+    {
+        executor_deque_push(&worker->deque, task);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&executor->idle, memory_order_relaxed) > 0)
+        {
+            //a full channel means no worker is blocked receiving from it
+            channel_non_blocking_send(executor->submissions, NULL);
+        }
+        return SUCCESS;
+    }
+
+    enum channel_status status = channel_send(executor->submissions, task);
+    if (status != SUCCESS)
+    {
+        free(task);
+        atomic_fetch_sub(&executor->pending, 1);
+    }
+    return status;
+}
+
+// Blocks until every task submitted so far, and every task those tasks submitted, has finished
+// Must not be called from a task
+void executor_wait(executor_t* executor)
+{
+    pthread_mutex_lock(&executor->mutex);
+    while (atomic_load(&executor->pending) > 0)
+    {
+        pthread_cond_wait(&executor->finished, &executor->mutex);
+    }
+    pthread_mutex_unlock(&executor->mutex);
+}
+
+// Waits for every submitted task to finish, stops the workers and frees the executor
+void executor_destroy(executor_t* executor)
+{
+    executor_wait(executor);
+    channel_close(executor->submissions);
+    for (size_t i = 0; i < executor->threads; i++)
+    {
+        pthread_join(executor->workers[i].thread, NULL);
+        executor_deque_free(&executor->workers[i].deque);
+    }
+    channel_destroy(executor->submissions);
+    pthread_cond_destroy(&executor->finished);
+    pthread_mutex_destroy(&executor->mutex);
+    free(executor->workers);
+    free(executor);
+}
@@ -0,0 +1,63 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stdint.h>
+#include "channel.h"
+
+// Chase-Lev work-stealing deque of task pointers
+// The owner pushes and takes at bottom; thieves take from top with one CAS. Arrays that were grown out of
+// are kept in retired until the deque is freed, since a thief may still be reading one
+typedef struct {
+    int64_t capacity;
+    _Atomic(void*) items[];
+} executor_array_t;
+
+typedef struct {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Atomic(executor_array_t*) array;
+    list_t* retired;
+} executor_deque_t;
+
+// Returned by executor_deque_steal when it lost a race for the top item and the caller should try again
+#define EXECUTOR_STEAL_RETRY ((void*)-1)
+
+typedef struct executor executor_t;
+
+// Creates an executor with threads worker threads (0 for one per CPU)
+// Tasks submitted from outside the executor go through a channel of queue_size tasks (at least 1); tasks
+// submitted by running tasks go onto their worker's deque, where idle workers steal them
+executor_t* executor_create(size_t threads, size_t queue_size);
+
+// Runs fn(arg) on one of the executor's workers and then sends its return value on results, unless results is NULL
+// Blocks while the submission channel is full when called from outside the executor
+// Returns SUCCESS, or CLOSED_ERROR if the executor is being destroyed
+enum channel_status executor_submit(executor_t* executor, void* (*fn)(void*), void* arg, channel_t* results);
+
+// Blocks until every task submitted so far, and every task those tasks submitted, has finished
+// Must not be called from a task
+void executor_wait(executor_t* executor);
+
+// Waits for every submitted task to finish, stops the workers and frees the executor
+void executor_destroy(executor_t* executor);
+
+// Initializes an empty deque
+void executor_deque_init(executor_deque_t* deque);
+
+// Pushes an item at the bottom of the deque, doubling its array when full
+// Only the owner may call this
+void executor_deque_push(executor_deque_t* deque, void* item);
+
+// Takes the item at the bottom of the deque, the one pushed last
+// Only the owner may call this; returns NULL if the deque is empty
+void* executor_deque_take(executor_deque_t* deque);
+
+// Takes the item at the top of the deque, the oldest one
+// Any thread may call this; returns the item, NULL if the deque is empty, or EXECUTOR_STEAL_RETRY if another
+// thread took the item first
+void* executor_deque_steal(executor_deque_t* deque);
+
+// Frees the deque's arrays; no thread may use the deque any more
+void executor_deque_free(executor_deque_t* deque);
+
+#endif // EXECUTOR_H
@@ -0,0 +1,450 @@
+#include "fiber.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#ifdef __SANITIZE_THREAD__
+#include <sanitizer/tsan_interface.h>
+#endif
+
+#define FIBER_CACHE_LINE 64
+
+// Where a fiber that switched out to park stands with whoever resumes it; see fiber_park
+enum fiber_pending {
+    PENDING_NONE,
+    PENDING_PARKED,  // its worker has switched away from it
+    PENDING_WOKEN    // fiber_unpark has taken it out of its slot
+};
+
+struct fiber {
+    ucontext_t context;
+    void* stack;            // mapping of stack_size bytes, starting with a guard page
+    size_t stack_size;
+    void* (*start)(void*);
+    void* arg;
+    fiber_pool_t* pool;
+    atomic_int pending;     // enum fiber_pending
+    bool parking;           // switched out in fiber_park
+    bool done;              // start has returned
+#ifdef __SANITIZE_THREAD__
+    void* tsan_fiber;
+#endif
+};
+
+// Run queue of one worker; the owner takes fibers from the front and thieves from the back
+// count is atomic so that thieves can skip empty queues without taking the mutex
+typedef struct {
+    pthread_mutex_t mutex;
+    fiber_t** fibers;
+    size_t capacity;
+    size_t head;
+    atomic_size_t count;
+} fiber_queue_t;
+
+typedef struct {
+    _Alignas(FIBER_CACHE_LINE) fiber_queue_t queue;
+    pthread_t thread;
+    ucontext_t context;     // the worker's own stack, which fibers switch back to
+    fiber_t* current;
+    fiber_pool_t* pool;
+    unsigned seed;          // picks the first victim to steal from
+#ifdef __SANITIZE_THREAD__
+    void* tsan_fiber;
+#endif
+} fiber_worker_t;
+
+struct fiber_pool {
+    fiber_worker_t* workers;
+    size_t threads;
+    size_t stack_size;
+    atomic_size_t runnable;  // fibers queued or about to be; never less than the fibers in the queues
+    atomic_size_t idle;      // workers that are going to sleep or asleep on work
+    atomic_size_t live;      // fibers spawned that haven't returned
+    atomic_size_t next;      // next worker that gets a fiber readied from outside the pool
+    atomic_bool stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;     // signaled when a fiber becomes runnable while a worker is idle
+    pthread_cond_t done;     // signaled when live drops to 0
+};
+
+// Worker running on this thread, NULL on threads outside every pool
+static _Thread_local fiber_worker_t* this_worker = NULL;
+
+// Reads this_worker through a call so that fibers that moved to another thread see that thread's worker,
+// rather than a thread-local address the compiler kept from before the switch
+__attribute__((noinline)) fiber_worker_t* worker_self()
+{
+    return this_worker;
+}
+
+void queue_init(fiber_queue_t* queue)
+{
+    pthread_mutex_init(&queue->mutex, NULL);
+    queue->capacity = 16;
+    queue->fibers = (fiber_t**)malloc(sizeof(fiber_t*) * queue->capacity);
+    queue->head = 0;
+    atomic_init(&queue->count, 0);
+}
+
+void queue_push(fiber_queue_t* queue, fiber_t* fiber)
+{
+    pthread_mutex_lock(&queue->mutex);
+    size_t count = atomic_load_explicit(&queue->count, memory_order_relaxed);
+    if (count == queue->capacity)
+    {
+        fiber_t** fibers = (fiber_t**)malloc(sizeof(fiber_t*) * queue->capacity * 2);
+        for (size_t i = 0; i < count; i++)
+        {
+            fibers[i] = queue->fibers[(queue->head + i) % queue->capacity];
+        }
+        free(queue->fibers);
+        queue->fibers = fibers;
+        queue->capacity *= 2;
+        queue->head = 0;
+    }
+    queue->fibers[(queue->head + count) % queue->capacity] = fiber;
+    atomic_store_explicit(&queue->count, count + 1, memory_order_relaxed);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Takes the oldest fiber (front) or, for thieves, the newest one (back)
+fiber_t* queue_take(fiber_queue_t* queue, bool front)
+{
+    if (atomic_load_explicit(&queue->count, memory_order_relaxed) == 0)
+    {
+        return NULL;
+    }
+    fiber_t* fiber = NULL;
+    pthread_mutex_lock(&queue->mutex);
+    size_t count = atomic_load_explicit(&queue->count, memory_order_relaxed);
+    if (count > 0)
+    {
+        if (front)
+        {
+            fiber = queue->fibers[queue->head];
+            queue->head = (queue->head + 1) % queue->capacity;
+        }
+        else
+        {
+            fiber = queue->fibers[(queue->head + count - 1) % queue->capacity];
+        }
+        atomic_store_explicit(&queue->count, count - 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return fiber;
+}
+
+void queue_destroy(fiber_queue_t* queue)
+{
+    free(queue->fibers);
+    pthread_mutex_destroy(&queue->mutex);
+}
+
+// Queues a fiber that can run: on the caller's worker if it belongs to the same pool so it stays on a
+// warm cache, otherwise round robin; an idle worker is woken so it can steal it
+void fiber_ready(fiber_t* fiber)
+{
+    fiber_pool_t* pool = fiber->pool;
+    fiber_worker_t* worker = worker_self();
+    if (worker == NULL || worker->pool != pool)
+    {
+        worker = &pool->workers[atomic_fetch_add(&pool->next, 1) % pool->threads];
+    }
+    //counted before it is queued so an idle worker that sees runnable == 0 can't miss it
+    atomic_fetch_add(&pool->runnable, 1);
+    queue_push(&worker->queue, fiber);
+    if (atomic_load(&pool->idle) > 0)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// Switches from the running fiber back to its worker
+void switch_to_worker(fiber_t* fiber)
+{
+    fiber_worker_t* worker = worker_self();
+#ifdef __SANITIZE_THREAD__
+    __tsan_switch_to_fiber(worker->tsan_fiber, 0);
+#endif
+    swapcontext(&fiber->context, &worker->context);
+}
+
+// First function on every fiber's stack
+void fiber_entry()
+{
+    fiber_t* fiber = worker_self()->current;
+    fiber->start(fiber->arg);
+    fiber->done = true;
+    switch_to_worker(fiber);
+}
+
+void fiber_free(fiber_t* fiber)
+{
+#ifdef __SANITIZE_THREAD__
+    __tsan_destroy_fiber(fiber->tsan_fiber);
+#endif
+    munmap(fiber->stack, fiber->stack_size);
+    free(fiber);
+}
+
+// Runs fiber until it returns, parks or yields, then does what it switched out for
+// A parked fiber is only queued again here if fiber_unpark took it out of its slot first
+void run_fiber(fiber_worker_t* worker, fiber_t* fiber)
+{
+    worker->current = fiber;
+#ifdef __SANITIZE_THREAD__
+    __tsan_switch_to_fiber(fiber->tsan_fiber, 0);
+#endif
+    swapcontext(&worker->context, &fiber->context);
+    worker->current = NULL;
+
+    fiber_pool_t* pool = worker->pool;
+    if (fiber->done)
+    {
+        fiber_free(fiber);
+        if (atomic_fetch_sub(&pool->live, 1) == 1)
+        {
+            pthread_mutex_lock(&pool->mutex);
+            pthread_cond_broadcast(&pool->done);
+            pthread_mutex_unlock(&pool->mutex);
+        }
+    }
+    else if (fiber->parking)
+    {
+        fiber->parking = false;
+        if (atomic_exchange(&fiber->pending, PENDING_PARKED) == PENDING_WOKEN)
+        {
+            fiber_ready(fiber);
+        }
+    }
+    else
+    {
+        fiber_ready(fiber);
+    }
+}
+
+// Takes a fiber from the worker's own queue, or steals one starting from a random victim
+fiber_t* find_work(fiber_worker_t* worker)
+{
+    fiber_t* fiber = queue_take(&worker->queue, true);
+    fiber_pool_t* pool = worker->pool;
+    if (fiber == NULL && pool->threads > 1)
+    {
+        worker->seed = worker->seed * 1103515245 + 12345;
+        size_t victim = (worker->seed >> 8) % pool->threads;
+        for (size_t i = 0; i < pool->threads && fiber == NULL; i++)
+        {
+            fiber_worker_t* other = &pool->workers[(victim + i) % pool->threads];
+            if (other != worker)
+            {
+                fiber = queue_take(&other->queue, false);
+            }
+        }
+    }
+    if (fiber != NULL)
+    {
+        atomic_fetch_sub(&pool->runnable, 1);
+    }
+    return fiber;
+}
+
+void* worker_main(void* arg)
+{
+    fiber_worker_t* worker = (fiber_worker_t*)arg;
+    fiber_pool_t* pool = worker->pool;
+    this_worker = worker;
+#ifdef __SANITIZE_THREAD__
+    worker->tsan_fiber = __tsan_get_current_fiber();
+#endif
+    while (true)
+    {
+        fiber_t* fiber = find_work(worker);
+        if (fiber != NULL)
+        {
+            run_fiber(worker, fiber);
+            continue;
+        }
+
+        //the increment pairs with the one on runnable in fiber_ready: either it sees us idle or we see its fiber
+        pthread_mutex_lock(&pool->mutex);
+        atomic_fetch_add(&pool->idle, 1);
+        while (atomic_load(&pool->runnable) == 0 && !atomic_load(&pool->stopping))
+        {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+        atomic_fetch_sub(&pool->idle, 1);
+        bool stop = atomic_load(&pool->stopping) && atomic_load(&pool->runnable) == 0;
+        pthread_mutex_unlock(&pool->mutex);
+        if (stop)
+        {
+            break;
+        }
+    }
+    this_worker = NULL;
+    return NULL;
+}
+
+// Creates a pool of threads OS threads that run fibers; a threads of 0 uses one thread per CPU
+// Every fiber of the pool gets a stack of stack_size bytes, or FIBER_STACK_SIZE if stack_size is 0
+fiber_pool_t* fiber_pool_create(size_t threads, size_t stack_size)
+{
+    if (threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (stack_size == 0)
+    {
+        stack_size = FIBER_STACK_SIZE;
+    }
+
+    fiber_pool_t* pool = (fiber_pool_t*)malloc(sizeof(fiber_pool_t));
+    pool->threads = threads;
+    pool->stack_size = (stack_size + page - 1) / page * page;
+    atomic_init(&pool->runnable, 0);
+    atomic_init(&pool->idle, 0);
+    atomic_init(&pool->live, 0);
+    atomic_init(&pool->next, 0);
+    atomic_init(&pool->stopping, false);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->workers = (fiber_worker_t*)aligned_alloc(FIBER_CACHE_LINE, sizeof(fiber_worker_t) * threads);
+    for (size_t i = 0; i < threads; i++)
+    {
+        fiber_worker_t* worker = &pool->workers[i];
+        queue_init(&worker->queue);
+        worker->current = NULL;
+        worker->pool = pool;
+        worker->seed = (unsigned)i + 1;
+    }
+    for (size_t i = 0; i < threads; i++)
+    {
+        int status = pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]);
+        assert(status == 0);
+    }
+    return pool;
+}
+
+// Starts a fiber that runs start(arg) on one of the pool's threads
+// Can be called from any thread or fiber; the fiber's resources are released when start returns
+void fiber_spawn(fiber_pool_t* pool, void* (*start)(void*), void* arg)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    fiber_t* fiber = (fiber_t*)malloc(sizeof(fiber_t));
+    //one extra page below the stack stays inaccessible so an overflow faults instead of corrupting memory
+    fiber->stack_size = pool->stack_size + page;
+    fiber->stack = mmap(NULL, fiber->stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    assert(fiber->stack != MAP_FAILED);
+    mprotect(fiber->stack, page, PROT_NONE);
+    fiber->start = start;
+    fiber->arg = arg;
+    fiber->pool = pool;
+    atomic_init(&fiber->pending, PENDING_NONE);
+    fiber->parking = false;
+    fiber->done = false;
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = (char*)fiber->stack + page;
+    fiber->context.uc_stack.ss_size = pool->stack_size;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, fiber_entry, 0);
+#ifdef __SANITIZE_THREAD__
+    fiber->tsan_fiber = __tsan_create_fiber(0);
+#endif
+    atomic_fetch_add(&pool->live, 1);
+    fiber_ready(fiber);
+}
+
+// Blocks the calling thread until every fiber spawned on the pool so far has returned
+// Must not be called from one of the pool's fibers
+void fiber_pool_join(fiber_pool_t* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (atomic_load(&pool->live) > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Stops the pool's threads and frees the pool
+// Every fiber must have returned (see fiber_pool_join)
+void fiber_pool_destroy(fiber_pool_t* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    atomic_store(&pool->stopping, true);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 0; i < pool->threads; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+        queue_destroy(&pool->workers[i].queue);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+}
+
+// Returns the fiber running on the calling thread, or NULL if the caller is a plain thread
+fiber_t* fiber_current()
+{
+    fiber_worker_t* worker = worker_self();
+    return (worker != NULL) ? worker->current : NULL;
+}
+
+// Lets the other runnable fibers of the pool run before the calling fiber continues
+void fiber_yield()
+{
+    fiber_t* fiber = fiber_current();
+    assert(fiber != NULL);
+    switch_to_worker(fiber);
+}
+
+// Suspends the calling fiber until value is non-zero
+// The fiber publishes itself in slot and re-checks value, so either it sees the value change or
+// fiber_unpark sees it; the one of fiber_unpark and the worker that comes second queues it again,
+// which keeps either from touching the fiber after it has been resumed
+void fiber_park(_Atomic(fiber_t*)* slot, atomic_uint* value)
+{
+    fiber_t* fiber = fiber_current();
+    assert(fiber != NULL);
+    if (atomic_load(value) != 0)
+    {
+        return;
+    }
+    atomic_store(&fiber->pending, PENDING_NONE);
+    atomic_store(slot, fiber);
+    if (atomic_load(value) != 0)
+    {
+        fiber_t* expected = fiber;
+        if (atomic_compare_exchange_strong(slot, &expected, NULL))
+        {
+            return;
+        }
+        //fiber_unpark already has us and will queue us once we're switched out
+    }
+    fiber->parking = true;
+    switch_to_worker(fiber);
+}
+
+// Resumes the fiber parked in slot, if there is one
+// Must be called after making the value that fiber is parked on non-zero
+void fiber_unpark(_Atomic(fiber_t*)* slot)
+{
+    if (atomic_load(slot) == NULL)
+    {
+        return;
+    }
+    fiber_t* fiber = atomic_exchange(slot, NULL);
+    if (fiber != NULL && atomic_exchange(&fiber->pending, PENDING_WOKEN) == PENDING_PARKED)
+    {
+        fiber_ready(fiber);
+    }
+}
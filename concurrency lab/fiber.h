@@ -0,0 +1,44 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define FIBER_STACK_SIZE (64 * 1024)
+
+typedef struct fiber fiber_t;
+typedef struct fiber_pool fiber_pool_t;
+
+// Creates a pool of threads OS threads that run fibers; a threads of 0 uses one thread per CPU
+// Every fiber of the pool gets a stack of stack_size bytes, or FIBER_STACK_SIZE if stack_size is 0
+fiber_pool_t* fiber_pool_create(size_t threads, size_t stack_size);
+
+// Starts a fiber that runs start(arg) on one of the pool's threads
+// Can be called from any thread or fiber; the fiber's resources are released when start returns
+void fiber_spawn(fiber_pool_t* pool, void* (*start)(void*), void* arg);
+
+// Blocks the calling thread until every fiber spawned on the pool so far has returned
+// Must not be called from one of the pool's fibers
+void fiber_pool_join(fiber_pool_t* pool);
+
+// Stops the pool's threads and frees the pool
+// Every fiber must have returned (see fiber_pool_join)
+void fiber_pool_destroy(fiber_pool_t* pool);
+
+// Returns the fiber running on the calling thread, or NULL if the caller is a plain thread
+fiber_t* fiber_current();
+
+// Lets the other runnable fibers of the pool run before the calling fiber continues
+void fiber_yield();
+
+// Suspends the calling fiber until value is non-zero
+// The fiber stores itself in slot so that whoever makes value non-zero can resume it with fiber_unpark
+// Returns immediately if value is already non-zero; callers re-check their own condition afterwards
+void fiber_park(_Atomic(fiber_t*)* slot, atomic_uint* value);
+
+// Resumes the fiber parked in slot, if there is one
+// Must be called after making the value that fiber is parked on non-zero
+void fiber_unpark(_Atomic(fiber_t*)* slot);
+
+#endif // FIBER_H
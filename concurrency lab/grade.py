@@ -80,6 +80,38 @@ add_test_cases("test_select_response_time", iters_one, timeout_response_time)
 add_test_cases("test_cpu_utilization_select", iters_one, timeout_cpu_utilization)
 add_test_cases("test_cpu_utilization_overall", iters_one, timeout_cpu_utilization)
 add_test_cases("test_for_too_many_wakeups", iters_one, timeout_too_many_wakeups)
+add_test_cases("test_buffer_concurrent", iters_slow)
+add_test_cases("test_spsc_channel", iters_slow)
+add_test_cases("test_spsc_select_close", iters_slow)
+add_test_cases("test_wakeups_per_message", iters_slow)
+add_test_cases("test_batch", iters_slow)
+add_test_cases("test_rendezvous", iters_slow)
+add_test_cases("test_select_set", iters_slow)
+add_test_cases("test_spin_budget", iters_slow)
+add_test_cases("test_channel_stats", iters_slow)
+add_test_cases("test_typed_channel", iters_slow)
+add_test_cases("test_fibers", iters_one, timeout_channel * 5)
+add_test_case_channel("test_stress_fibers", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_fibers", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_fibers", iters_one, timeout_valgrind * 5)
+add_test_cases("test_executor", iters_slow)
+add_test_cases("test_broadcast", iters_slow)
+add_test_cases("test_shm_channel", iters_slow)
+add_test_cases("test_event_fd", iters_slow)
+add_test_case_channel("test_stress_delta", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_delta", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_delta", iters_one, timeout_valgrind * 5)
+add_test_cases("test_graph", iters_one)
+add_test_cases("test_sharded_channel", iters_slow)
+add_test_cases("test_select_waiters", iters_slow)
+add_test_cases("test_priority_channel", iters_slow)
+add_test_cases("test_elastic_channel", iters_slow)
+add_test_cases("test_select_many", iters_slow)
+add_test_cases("test_select_fair", iters_slow)
+add_test_cases("test_list_destroy")
+add_test_case_channel("test_stress_unbuffered", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_unbuffered", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_unbuffered", iters_one, timeout_valgrind * 5)
 
 # Score distribution
 point_breakdown_checkpoint = [
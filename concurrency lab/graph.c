@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "graph.h"
+
+// Allocates a graph that owns arrays with room for edges edges
+graph_t* graph_alloc(size_t nodes, size_t edges)
+{
+    graph_t* graph = (graph_t*) malloc(sizeof(graph_t));
+    graph->nodes = nodes;
+    graph->edges = edges;
+    graph->offsets = (uint64_t*) calloc(nodes + 1, sizeof(uint64_t));
+    // malloc(0) may return NULL, which a graph without edges must not be mistaken for
+    graph->targets = (uint32_t*) malloc(sizeof(uint32_t) * (edges > 0 ? edges : 1));
+    graph->weights = (uint32_t*) malloc(sizeof(uint32_t) * (edges > 0 ? edges : 1));
+    graph->mapping = NULL;
+    graph->mapping_size = 0;
+    return graph;
+}
+
+int compare_keys(const void* a, const void* b)
+{
+    uint64_t key_a = *(const uint64_t*) a;
+    uint64_t key_b = *(const uint64_t*) b;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// Builds a graph of nodes nodes from count edges in any order
+// Self-loops are dropped, and only the lightest of duplicate edges is kept
+graph_t* graph_from_edges(size_t nodes, const graph_edge_t* edges, size_t count)
+{
+    // bucket the edges by source, each one as its target in the high half of a key and its weight in the
+    // low half, so sorting a row by key orders it by target with the lightest duplicate first
+    uint64_t* starts = (uint64_t*) calloc(nodes + 1, sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        if (edges[i].src != edges[i].dst) {
+            starts[edges[i].src + 1]++;
+        }
+    }
+    for (size_t node = 0; node < nodes; node++) {
+        starts[node + 1] += starts[node];
+    }
+    size_t kept = starts[nodes];
+    uint64_t* keys = (uint64_t*) malloc(sizeof(uint64_t) * (kept > 0 ? kept : 1));
+    uint64_t* cursors = (uint64_t*) malloc(sizeof(uint64_t) * (nodes > 0 ? nodes : 1));
+    memcpy(cursors, starts, sizeof(uint64_t) * nodes);
+    for (size_t i = 0; i < count; i++) {
+        if (edges[i].src != edges[i].dst) {
+            keys[cursors[edges[i].src]++] = ((uint64_t) edges[i].dst << 32) | edges[i].weight;
+        }
+    }
+    free(cursors);
+
+    graph_t* graph = graph_alloc(nodes, kept);
+    size_t edge = 0;
+    for (size_t node = 0; node < nodes; node++) {
+        qsort(&keys[starts[node]], starts[node + 1] - starts[node], sizeof(uint64_t), compare_keys);
+        graph->offsets[node] = edge;
+        for (size_t i = starts[node]; i < starts[node + 1]; i++) {
+            uint32_t target = (uint32_t) (keys[i] >> 32);
+            if (edge > graph->offsets[node] && graph->targets[edge - 1] == target) {
+                continue;
+            }
+            graph->targets[edge] = target;
+            graph->weights[edge] = (uint32_t) keys[i];
+            edge++;
+        }
+    }
+    graph->offsets[nodes] = edge;
+    graph->edges = edge;
+    free(keys);
+    free(starts);
+    return graph;
+}
+
+// Parses filename as a text matrix: the number of nodes followed by one row of weights per node, negative for
+// no edge
+graph_t* graph_load_text(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    size_t nodes;
+    if (fscanf(file, "%zu", &nodes) != 1 || nodes == 0) {
+        fclose(file);
+        return NULL;
+    }
+    size_t capacity = nodes * 4;
+    size_t count = 0;
+    graph_edge_t* edges = (graph_edge_t*) malloc(sizeof(graph_edge_t) * capacity);
+    for (size_t src = 0; src < nodes; src++) {
+        for (size_t dst = 0; dst < nodes; dst++) {
+            long weight;
+            if (fscanf(file, "%ld", &weight) != 1) {
+                free(edges);
+                fclose(file);
+                return NULL;
+            }
+            if (weight < 0 || src == dst) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity *= 2;
+                edges = (graph_edge_t*) realloc(edges, sizeof(graph_edge_t) * capacity);
+            }
+            edges[count++] = (graph_edge_t) {(uint32_t) src, (uint32_t) dst, (uint32_t) weight};
+        }
+    }
+    fclose(file);
+    graph_t* graph = graph_from_edges(nodes, edges, count);
+    free(edges);
+    return graph;
+}
+
+// Returns the size of a binary graph file with the given numbers of nodes and edges
+size_t graph_file_size(size_t nodes, size_t edges)
+{
+    return sizeof(graph_header_t) + sizeof(uint64_t) * (nodes + 1) + sizeof(uint32_t) * edges * 2;
+}
+
+// Maps the binary graph file filename read-only
+// Returns NULL if the file can't be opened or isn't a valid binary graph file
+graph_t* graph_map(const char* filename)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(graph_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t) info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    const graph_header_t* header = (const graph_header_t*) mapping;
+    if (header->magic != GRAPH_MAGIC || header->nodes == 0 || header->nodes > UINT32_MAX ||
+        header->edges > size || graph_file_size(header->nodes, header->edges) != size) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    graph_t* graph = (graph_t*) malloc(sizeof(graph_t));
+    graph->nodes = header->nodes;
+    graph->edges = header->edges;
+    graph->offsets = (uint64_t*) ((char*) mapping + sizeof(graph_header_t));
+    graph->targets = (uint32_t*) (graph->offsets + graph->nodes + 1);
+    graph->weights = graph->targets + graph->edges;
+    graph->mapping = mapping;
+    graph->mapping_size = size;
+    if (graph->offsets[graph->nodes] != graph->edges) {
+        graph_free(graph);
+        return NULL;
+    }
+    return graph;
+}
+
+// Loads a graph from filename, mapping it if it is a binary graph file and otherwise parsing it as a text matrix:
+// the number of nodes followed by one row of weights per node, negative for no edge
+// Returns NULL if the file can't be opened or isn't a valid graph
+graph_t* graph_load(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    uint64_t magic = 0;
+    size_t read = fread(&magic, sizeof(magic), 1, file);
+    fclose(file);
+    if (read == 1 && magic == GRAPH_MAGIC) {
+        return graph_map(filename);
+    }
+    return graph_load_text(filename);
+}
+
+// Writes graph to filename as a binary graph file
+// Returns false if the file can't be written
+bool graph_save(const graph_t* graph, const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    graph_header_t header = {GRAPH_MAGIC, graph->nodes, graph->edges};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(graph->offsets, sizeof(uint64_t), graph->nodes + 1, file) == graph->nodes + 1 &&
+                   fwrite(graph->targets, sizeof(uint32_t), graph->edges, file) == graph->edges &&
+                   fwrite(graph->weights, sizeof(uint32_t), graph->edges, file) == graph->edges;
+    return (fclose(file) == 0) && written;
+}
+
+// Returns the weight of the edge from src to dst, or GRAPH_NO_EDGE if there is none
+uint32_t graph_weight(const graph_t* graph, size_t src, size_t dst)
+{
+    size_t low = graph->offsets[src];
+    size_t high = graph->offsets[src + 1];
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (graph->targets[mid] < dst) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < graph->offsets[src + 1] && graph->targets[low] == dst) {
+        return graph->weights[low];
+    }
+    return GRAPH_NO_EDGE;
+}
+
+// Returns the number of edges leaving node
+size_t graph_degree(const graph_t* graph, size_t node)
+{
+    return graph->offsets[node + 1] - graph->offsets[node];
+}
+
+// Returns the next number of a xorshift64* sequence; state must not start at 0
+uint64_t graph_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// Adds the edge between a and b in both directions, with a random weight from 1 to max_weight
+void add_undirected(graph_edge_t* edges, size_t* count, size_t a, size_t b, uint32_t max_weight, uint64_t* state)
+{
+    uint32_t weight = 1 + (uint32_t) (graph_random(state) % (max_weight > 0 ? max_weight : 1));
+    edges[(*count)++] = (graph_edge_t) {(uint32_t) a, (uint32_t) b, weight};
+    edges[(*count)++] = (graph_edge_t) {(uint32_t) b, (uint32_t) a, weight};
+}
+
+// Generates an undirected graph (every edge goes both ways with the same weight) of nodes nodes in which every
+// node links to degree / 2 others picked at random, with weights from 1 to max_weight
+graph_t* graph_generate_random(size_t nodes, size_t degree, uint32_t max_weight, uint64_t seed)
+{
+    uint64_t state = seed | 1;
+    size_t links = degree / 2;
+    size_t count = 0;
+    graph_edge_t* edges = (graph_edge_t*) malloc(sizeof(graph_edge_t) * (nodes * links * 2 + 1));
+    for (size_t node = 0; node < nodes; node++) {
+        for (size_t i = 0; i < links; i++) {
+            size_t other = graph_random(&state) % nodes;
+            if (other != node) {
+                add_undirected(edges, &count, node, other, max_weight, &state);
+            }
+        }
+    }
+    graph_t* graph = graph_from_edges(nodes, edges, count);
+    free(edges);
+    return graph;
+}
+
+// Generates an undirected width x height grid in which every node links to the nodes above, below, left and right
+// of it, with weights from 1 to max_weight
+graph_t* graph_generate_grid(size_t width, size_t height, uint32_t max_weight, uint64_t seed)
+{
+    uint64_t state = seed | 1;
+    size_t nodes = width * height;
+    size_t count = 0;
+    graph_edge_t* edges = (graph_edge_t*) malloc(sizeof(graph_edge_t) * (nodes * 4 + 1));
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            size_t node = y * width + x;
+            if (x + 1 < width) {
+                add_undirected(edges, &count, node, node + 1, max_weight, &state);
+            }
+            if (y + 1 < height) {
+                add_undirected(edges, &count, node, node + width, max_weight, &state);
+            }
+        }
+    }
+    graph_t* graph = graph_from_edges(nodes, edges, count);
+    free(edges);
+    return graph;
+}
+
+// Generates an undirected power-law graph of nodes nodes by preferential attachment (Barabasi-Albert): every new
+// node links to links_per_node of the earlier ones, picked with a probability proportional to their degree
+graph_t* graph_generate_power_law(size_t nodes, size_t links_per_node, uint32_t max_weight, uint64_t seed)
+{
+    uint64_t state = seed | 1;
+    size_t count = 0;
+    graph_edge_t* edges = (graph_edge_t*) malloc(sizeof(graph_edge_t) * (nodes * links_per_node * 2 + 1));
+    // every node appears here once per edge it has, so a uniform pick from it is a pick proportional to degree
+    uint32_t* endpoints = (uint32_t*) malloc(sizeof(uint32_t) * (nodes * links_per_node * 2 + 1));
+    size_t endpoint_count = 0;
+    for (size_t node = 1; node < nodes; node++) {
+        size_t links = (node < links_per_node) ? node : links_per_node;
+        for (size_t i = 0; i < links; i++) {
+            size_t other;
+            if (endpoint_count == 0) {
+                other = graph_random(&state) % node;
+            } else {
+                other = endpoints[graph_random(&state) % endpoint_count];
+            }
+            add_undirected(edges, &count, node, other, max_weight, &state);
+            endpoints[endpoint_count++] = (uint32_t) node;
+            endpoints[endpoint_count++] = (uint32_t) other;
+        }
+    }
+    free(endpoints);
+    graph_t* graph = graph_from_edges(nodes, edges, count);
+    free(edges);
+    return graph;
+}
+
+// Frees the graph, or unmaps it if it was mapped from a file
+void graph_free(graph_t* graph)
+{
+    if (graph->mapping != NULL) {
+        munmap(graph->mapping, graph->mapping_size);
+    } else {
+        free(graph->offsets);
+        free(graph->targets);
+        free(graph->weights);
+    }
+    free(graph);
+}
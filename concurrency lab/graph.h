@@ -0,0 +1,81 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Weight graph_weight returns for a pair of nodes with no edge between them
+#define GRAPH_NO_EDGE UINT32_MAX
+
+// First 8 bytes of a binary graph file ("CLGRAPH1" read as a little-endian integer)
+#define GRAPH_MAGIC 0x3148504152474c43ULL
+
+// One directed edge of an edge list
+typedef struct {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t weight;
+} graph_edge_t;
+
+// Header of a binary graph file; it is followed by offsets, targets and weights exactly as they are laid out in
+// graph_t, so the file can be mapped and used without parsing
+typedef struct {
+    uint64_t magic;
+    uint64_t nodes;
+    uint64_t edges;
+} graph_header_t;
+
+// Weighted directed graph in compressed sparse row form
+// The edges leaving node n are targets[offsets[n]] to targets[offsets[n + 1] - 1], sorted by target and without
+// self-loops or duplicates, with their weights at the same positions in weights
+// A graph loaded from a binary file points into the file's mapping instead of owning its arrays
+typedef struct {
+    size_t nodes;
+    size_t edges;
+    uint64_t* offsets;
+    uint32_t* targets;
+    uint32_t* weights;
+    void* mapping;       // NULL unless the arrays point into a mapped file
+    size_t mapping_size;
+} graph_t;
+
+// Builds a graph of nodes nodes from count edges in any order
+// Self-loops are dropped, and only the lightest of duplicate edges is kept
+graph_t* graph_from_edges(size_t nodes, const graph_edge_t* edges, size_t count);
+
+// Loads a graph from filename, mapping it if it is a binary graph file and otherwise parsing it as a text matrix:
+// the number of nodes followed by one row of weights per node, negative for no edge
+// Returns NULL if the file can't be opened or isn't a valid graph
+graph_t* graph_load(const char* filename);
+
+// Maps the binary graph file filename read-only
+// Returns NULL if the file can't be opened or isn't a valid binary graph file
+graph_t* graph_map(const char* filename);
+
+// Writes graph to filename as a binary graph file
+// Returns false if the file can't be written
+bool graph_save(const graph_t* graph, const char* filename);
+
+// Returns the weight of the edge from src to dst, or GRAPH_NO_EDGE if there is none
+uint32_t graph_weight(const graph_t* graph, size_t src, size_t dst);
+
+// Returns the number of edges leaving node
+size_t graph_degree(const graph_t* graph, size_t node);
+
+// Generates an undirected graph (every edge goes both ways with the same weight) of nodes nodes in which every
+// node links to degree / 2 others picked at random, with weights from 1 to max_weight
+graph_t* graph_generate_random(size_t nodes, size_t degree, uint32_t max_weight, uint64_t seed);
+
+// Generates an undirected width x height grid in which every node links to the nodes above, below, left and right
+// of it, with weights from 1 to max_weight
+graph_t* graph_generate_grid(size_t width, size_t height, uint32_t max_weight, uint64_t seed);
+
+// Generates an undirected power-law graph of nodes nodes by preferential attachment (Barabasi-Albert): every new
+// node links to links_per_node of the earlier ones, picked with a probability proportional to their degree
+graph_t* graph_generate_power_law(size_t nodes, size_t links_per_node, uint32_t max_weight, uint64_t seed);
+
+// Frees the graph, or unmaps it if it was mapped from a file
+void graph_free(graph_t* graph);
+
+#endif // GRAPH_H
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "graph.h"
+
+// Usage: ./graph_gen random|grid|power_law nodes file [degree] [seed]
+// Writes a generated topology to file as a binary graph file that the stress test can load like a text one
+// degree is the average number of links per node (4 by default, always 4 for grids, which are as square as nodes
+// allows); weights go from 1 to 9 like in the text topologies
+int main(int argc, char** argv)
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s random|grid|power_law nodes file [degree] [seed]\n", argv[0]);
+        return 1;
+    }
+    const char* kind = argv[1];
+    size_t nodes = (size_t) atol(argv[2]);
+    const char* filename = argv[3];
+    size_t degree = (argc > 4) ? (size_t) atol(argv[4]) : 4;
+    uint64_t seed = (argc > 5) ? (uint64_t) atoll(argv[5]) : 1;
+    if (nodes == 0 || nodes > UINT32_MAX) {
+        fprintf(stderr, "nodes must be between 1 and %u\n", UINT32_MAX);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    graph_t* graph;
+    if (strcmp(kind, "random") == 0) {
+        graph = graph_generate_random(nodes, degree, 9, seed);
+    } else if (strcmp(kind, "grid") == 0) {
+        size_t width = 1;
+        while ((width + 1) * (width + 1) <= nodes) {
+            width++;
+        }
+        graph = graph_generate_grid(width, nodes / width, 9, seed);
+    } else if (strcmp(kind, "power_law") == 0) {
+        graph = graph_generate_power_law(nodes, degree / 2 > 0 ? degree / 2 : 1, 9, seed);
+    } else {
+        fprintf(stderr, "unknown kind of graph: %s\n", kind);
+        return 1;
+    }
+    if (!graph_save(graph, filename)) {
+        fprintf(stderr, "could not write %s\n", filename);
+        graph_free(graph);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %zu nodes, %zu edges in %.3fs\n", filename, graph->nodes, graph->edges, seconds);
+    graph_free(graph);
+    return 0;
+}
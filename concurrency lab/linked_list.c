@@ -36,9 +36,9 @@ void list_destroy(list_t* list)
     //loop through the list and free every node
     while (curr != NULL) 
     {
-        //list_node_t* next = curr->next;
+        list_node_t* next = curr->next;
         free(curr);
-        curr = curr->next;
+        curr = next;
     }
 
     free(list); //free the allocated memory
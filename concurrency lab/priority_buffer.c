@@ -0,0 +1,125 @@
+#include "priority_buffer.h"
+
+// Creates a buffer that holds capacity pointers (at least 1) over all its priority levels
+priority_buffer_t* priority_buffer_create(size_t capacity)
+{
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    priority_buffer_t* buffer = (priority_buffer_t*) aligned_alloc(BUFFER_CACHE_LINE, sizeof(priority_buffer_t));
+    buffer->capacity = capacity;
+    for (size_t level = 0; level < PRIORITY_LEVELS; level++) {
+        buffer->rings[level] = buffer_create(capacity);
+    }
+    atomic_init(&buffer->size, 0);
+    return buffer;
+}
+
+// Reserves up to count of the free messages of the buffer
+// Returns the number reserved, which is 0 if the buffer is full
+// A compare-and-swap instead of a fetch-and-add never counts past capacity even for a moment, so a sender can't
+// see the buffer full because of another sender that is about to give its reservation back
+size_t reserve_room(priority_buffer_t* buffer, size_t count)
+{
+    size_t size = atomic_load_explicit(&buffer->size, memory_order_relaxed);
+    size_t reserved;
+    do {
+        if (size >= buffer->capacity) {
+            return 0;
+        }
+        reserved = (buffer->capacity - size < count) ? buffer->capacity - size : count;
+    } while (!atomic_compare_exchange_weak_explicit(&buffer->size, &size, size + reserved,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    return reserved;
+}
+
+// Returns the ring of the given priority
+buffer_t* level_ring(priority_buffer_t* buffer, unsigned priority)
+{
+    return buffer->rings[(priority < PRIORITY_LEVELS) ? priority : PRIORITY_LEVELS - 1];
+}
+
+// Adds data at the given priority (0 is the lowest)
+// Safe to call concurrently with every other priority_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if the buffer is full
+enum buffer_status priority_buffer_add(priority_buffer_t* buffer, void* data, unsigned priority)
+{
+    if (reserve_room(buffer, 1) == 0) {
+        return BUFFER_ERROR;
+    }
+    //the ring holds capacity messages and at most capacity are reserved, so there is always room
+    buffer_add(level_ring(buffer, priority), data);
+    return BUFFER_SUCCESS;
+}
+
+// Removes the oldest value of the highest priority in the buffer and stores it in data
+// Safe to call concurrently with every other priority_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if the buffer is empty
+enum buffer_status priority_buffer_remove(priority_buffer_t* buffer, void** data)
+{
+    if (atomic_load_explicit(&buffer->size, memory_order_relaxed) == 0) {
+        return BUFFER_ERROR;
+    }
+    for (size_t level = PRIORITY_LEVELS; level-- > 0;) {
+        if (buffer_remove(buffer->rings[level], data) == BUFFER_SUCCESS) {
+            //only give the room back once the slot is free again, so the ring can't overflow
+            atomic_fetch_sub_explicit(&buffer->size, 1, memory_order_release);
+            return BUFFER_SUCCESS;
+        }
+    }
+    return BUFFER_ERROR;
+}
+
+// Adds up to count values from data in order at the given priority
+// Returns the number of values added, which is 0 if the buffer is full
+size_t priority_buffer_add_batch(priority_buffer_t* buffer, void** data, size_t count, unsigned priority)
+{
+    size_t reserved = reserve_room(buffer, count);
+    size_t added = 0;
+    while (added < reserved) {
+        added += buffer_add_batch(level_ring(buffer, priority), &data[added], reserved - added);
+    }
+    return added;
+}
+
+// Removes up to max values into data, highest priority first
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t priority_buffer_remove_batch(priority_buffer_t* buffer, void** data, size_t max)
+{
+    size_t removed = 0;
+    for (size_t level = PRIORITY_LEVELS; level-- > 0 && removed < max;) {
+        removed += buffer_remove_batch(buffer->rings[level], &data[removed], max - removed);
+    }
+    if (removed > 0) {
+        atomic_fetch_sub_explicit(&buffer->size, removed, memory_order_release);
+    }
+    return removed;
+}
+
+// Returns the number of messages ever added to the buffer
+size_t priority_buffer_added(priority_buffer_t* buffer)
+{
+    size_t added = 0;
+    for (size_t level = 0; level < PRIORITY_LEVELS; level++) {
+        added += atomic_load(&buffer->rings[level]->tail);
+    }
+    return added;
+}
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t priority_buffer_current_size(priority_buffer_t* buffer)
+{
+    return atomic_load(&buffer->size);
+}
+
+// Frees the memory allocated to the buffer
+void priority_buffer_free(priority_buffer_t* buffer)
+{
+    for (size_t level = 0; level < PRIORITY_LEVELS; level++) {
+        buffer_free(buffer->rings[level]);
+    }
+    free(buffer);
+}
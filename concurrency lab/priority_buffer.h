@@ -0,0 +1,56 @@
+#ifndef PRIORITY_BUFFER_H
+#define PRIORITY_BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "buffer.h"
+
+// Number of priority levels of a priority buffer; priorities above the highest level count as the highest
+#define PRIORITY_LEVELS 8
+
+// Bounded multi-producer/multi-consumer queue that delivers higher priorities first
+// Every level is its own buffer_t ring, so adding and removing are O(1) and lock-free like in a plain buffer;
+// messages of the same priority come out in the order they went in. The levels share one capacity: a sender
+// reserves room in size before writing to its level, so every ring has room for all capacity messages and the
+// add to it can't fail. Receivers take from the highest non-empty level
+typedef struct {
+    size_t capacity;
+    buffer_t* rings[PRIORITY_LEVELS];
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t size;
+} priority_buffer_t;
+
+// Creates a buffer that holds capacity pointers (at least 1) over all its priority levels
+priority_buffer_t* priority_buffer_create(size_t capacity);
+
+// Adds data at the given priority (0 is the lowest)
+// Safe to call concurrently with every other priority_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if the buffer is full
+enum buffer_status priority_buffer_add(priority_buffer_t* buffer, void* data, unsigned priority);
+
+// Removes the oldest value of the highest priority in the buffer and stores it in data
+// Safe to call concurrently with every other priority_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if the buffer is empty
+enum buffer_status priority_buffer_remove(priority_buffer_t* buffer, void** data);
+
+// Adds up to count values from data in order at the given priority
+// Returns the number of values added, which is 0 if the buffer is full
+size_t priority_buffer_add_batch(priority_buffer_t* buffer, void** data, size_t count, unsigned priority);
+
+// Removes up to max values into data, highest priority first
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t priority_buffer_remove_batch(priority_buffer_t* buffer, void** data, size_t max);
+
+// Returns the number of messages ever added to the buffer
+size_t priority_buffer_added(priority_buffer_t* buffer);
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t priority_buffer_current_size(priority_buffer_t* buffer);
+
+// Frees the memory allocated to the buffer
+void priority_buffer_free(priority_buffer_t* buffer);
+
+#endif // PRIORITY_BUFFER_H
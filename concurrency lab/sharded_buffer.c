@@ -0,0 +1,145 @@
+#include "sharded_buffer.h"
+#include <stdint.h>
+
+// Number of threads that have sent on some sharded buffer, which hands out home lanes in turn
+static atomic_size_t producers = 0;
+// The calling thread's producer number, SIZE_MAX until it first sends
+static _Thread_local size_t producer = SIZE_MAX;
+// Lane the calling thread starts its next receive at
+static _Thread_local size_t next_lane = 0;
+
+// Creates a buffer of lanes lanes (at least 1) that together hold at least capacity messages of elem_size bytes,
+// or pointers if elem_size is 0; fifo pins every producer to its home lane
+sharded_buffer_t* sharded_buffer_create(size_t capacity, size_t elem_size, size_t lanes, bool fifo)
+{
+    if (lanes == 0) {
+        lanes = 1;
+    }
+    size_t lane_capacity = (capacity + lanes - 1) / lanes;
+    if (lane_capacity == 0) {
+        lane_capacity = 1;
+    }
+    sharded_buffer_t* buffer = (sharded_buffer_t*) malloc(sizeof(sharded_buffer_t));
+    buffer->lanes = lanes;
+    buffer->fifo = fifo;
+    buffer->rings = (buffer_t**) malloc(sizeof(buffer_t*) * lanes);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        buffer->rings[lane] = (elem_size > 0) ? buffer_create_typed(lane_capacity, elem_size) : buffer_create(lane_capacity);
+    }
+    return buffer;
+}
+
+// Returns the calling thread's home lane
+size_t home_lane(sharded_buffer_t* buffer)
+{
+    if (producer == SIZE_MAX) {
+        producer = atomic_fetch_add_explicit(&producers, 1, memory_order_relaxed);
+    }
+    return producer % buffer->lanes;
+}
+
+enum buffer_status lane_add(buffer_t* ring, void* data)
+{
+    return (ring->elem_size > 0) ? buffer_add_value(ring, data) : buffer_add(ring, data);
+}
+
+enum buffer_status lane_remove(buffer_t* ring, void** data)
+{
+    return (ring->elem_size > 0) ? buffer_remove_value(ring, *data) : buffer_remove(ring, data);
+}
+
+// Adds the value (a pointer, or the elem_size bytes it points to in a typed buffer) to the calling thread's lane,
+// or to the first other lane with room unless the buffer is fifo
+// Safe to call concurrently with every other sharded_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if its lane (every lane for a buffer that isn't fifo) is full
+enum buffer_status sharded_buffer_add(sharded_buffer_t* buffer, void* data)
+{
+    size_t home = home_lane(buffer);
+    size_t tries = buffer->fifo ? 1 : buffer->lanes;
+    for (size_t i = 0; i < tries; i++) {
+        if (lane_add(buffer->rings[(home + i) % buffer->lanes], data) == BUFFER_SUCCESS) {
+            return BUFFER_SUCCESS;
+        }
+    }
+    return BUFFER_ERROR;
+}
+
+// Removes a value from the first non-empty lane, in FIFO order within the lane, and stores it in data; in a typed
+// buffer data points to a pointer to the elem_size bytes the message is copied into instead
+// Safe to call concurrently with every other sharded_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if every lane is empty
+enum buffer_status sharded_buffer_remove(sharded_buffer_t* buffer, void** data)
+{
+    size_t start = next_lane;
+    for (size_t i = 0; i < buffer->lanes; i++) {
+        size_t lane = (start + i) % buffer->lanes;
+        if (lane_remove(buffer->rings[lane], data) == BUFFER_SUCCESS) {
+            next_lane = lane + 1;
+            return BUFFER_SUCCESS;
+        }
+    }
+    return BUFFER_ERROR;
+}
+
+// Adds up to count values from data in order, as sharded_buffer_add does for one, claiming the slots of each lane at once
+// Returns the number of values added, which is 0 if none fit
+size_t sharded_buffer_add_batch(sharded_buffer_t* buffer, void** data, size_t count)
+{
+    size_t home = home_lane(buffer);
+    size_t tries = buffer->fifo ? 1 : buffer->lanes;
+    size_t added = 0;
+    for (size_t i = 0; i < tries && added < count; i++) {
+        added += buffer_add_batch(buffer->rings[(home + i) % buffer->lanes], &data[added], count - added);
+    }
+    return added;
+}
+
+// Removes up to max values into data, draining one lane at a time in round-robin order
+// Returns the number of values removed, which is 0 if every lane is empty
+size_t sharded_buffer_remove_batch(sharded_buffer_t* buffer, void** data, size_t max)
+{
+    size_t start = next_lane;
+    size_t removed = 0;
+    for (size_t i = 0; i < buffer->lanes && removed < max; i++) {
+        size_t lane = (start + i) % buffer->lanes;
+        size_t count = buffer_remove_batch(buffer->rings[lane], &data[removed], max - removed);
+        if (count > 0) {
+            removed += count;
+            next_lane = lane + 1;
+        }
+    }
+    return removed;
+}
+
+// Returns the number of messages ever added to the buffer
+size_t sharded_buffer_added(sharded_buffer_t* buffer)
+{
+    size_t added = 0;
+    for (size_t lane = 0; lane < buffer->lanes; lane++) {
+        added += atomic_load(&buffer->rings[lane]->tail);
+    }
+    return added;
+}
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t sharded_buffer_current_size(sharded_buffer_t* buffer)
+{
+    size_t size = 0;
+    for (size_t lane = 0; lane < buffer->lanes; lane++) {
+        size += buffer_current_size(buffer->rings[lane]);
+    }
+    return size;
+}
+
+// Frees the memory allocated to the buffer
+void sharded_buffer_free(sharded_buffer_t* buffer)
+{
+    for (size_t lane = 0; lane < buffer->lanes; lane++) {
+        buffer_free(buffer->rings[lane]);
+    }
+    free(buffer->rings);
+    free(buffer);
+}
@@ -0,0 +1,58 @@
+#ifndef SHARDED_BUFFER_H
+#define SHARDED_BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "buffer.h"
+
+// Bounded multi-producer/multi-consumer queue split into lanes, each an independent buffer_t ring,
+// so producers on different lanes never write the same head, tail or slot cache lines
+// Every thread gets a home lane the first time it sends (threads take lanes in turn, so up to lanes
+// producers each have one to themselves) and tries it first; a fifo buffer only ever uses the home
+// lane, which keeps every producer's messages in order, while other buffers spill into the next
+// lane with room. Receivers scan the lanes round-robin from the lane after the one they last took
+// a message from, so no lane is starved
+typedef struct {
+    size_t lanes;
+    bool fifo;
+    buffer_t** rings;
+} sharded_buffer_t;
+
+// Creates a buffer of lanes lanes (at least 1) that together hold at least capacity messages of elem_size bytes,
+// or pointers if elem_size is 0; fifo pins every producer to its home lane
+sharded_buffer_t* sharded_buffer_create(size_t capacity, size_t elem_size, size_t lanes, bool fifo);
+
+// Adds the value (a pointer, or the elem_size bytes it points to in a typed buffer) to the calling thread's lane,
+// or to the first other lane with room unless the buffer is fifo
+// Safe to call concurrently with every other sharded_buffer call
+// Returns BUFFER_SUCCESS if the value was added
+// Returns BUFFER_ERROR if its lane (every lane for a buffer that isn't fifo) is full
+enum buffer_status sharded_buffer_add(sharded_buffer_t* buffer, void* data);
+
+// Removes a value from the first non-empty lane, in FIFO order within the lane, and stores it in data; in a typed
+// buffer data points to a pointer to the elem_size bytes the message is copied into instead
+// Safe to call concurrently with every other sharded_buffer call
+// Returns BUFFER_SUCCESS if a value was removed
+// Returns BUFFER_ERROR if every lane is empty
+enum buffer_status sharded_buffer_remove(sharded_buffer_t* buffer, void** data);
+
+// Adds up to count values from data in order, as sharded_buffer_add does for one, claiming the slots of each lane at once
+// Returns the number of values added, which is 0 if none fit
+size_t sharded_buffer_add_batch(sharded_buffer_t* buffer, void** data, size_t count);
+
+// Removes up to max values into data, draining one lane at a time in round-robin order
+// Returns the number of values removed, which is 0 if every lane is empty
+size_t sharded_buffer_remove_batch(sharded_buffer_t* buffer, void** data, size_t max);
+
+// Returns the number of messages ever added to the buffer
+size_t sharded_buffer_added(sharded_buffer_t* buffer);
+
+// Returns the current number of messages in the buffer
+// Only a snapshot when other threads are adding or removing at the same time
+size_t sharded_buffer_current_size(sharded_buffer_t* buffer);
+
+// Frees the memory allocated to the buffer
+void sharded_buffer_free(sharded_buffer_t* buffer);
+
+#endif // SHARDED_BUFFER_H
@@ -0,0 +1,315 @@
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "shm_buffer.h"
+
+#define SHM_BUFFER_MAGIC 0x73686d5f72696e67ull
+
+// Maps the ring of the shared memory object fd refers to and wraps it in a handle for this process
+// Returns NULL if it can't be mapped or every entry of peers is taken
+shm_buffer_t* shm_attach(int fd, size_t size)
+{
+    shm_ring_t* ring = (shm_ring_t*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+    int pid = (int) getpid();
+    for (size_t peer = 0; peer < SHM_BUFFER_PEERS; peer++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ring->peers[peer], &expected, pid)) {
+            shm_buffer_t* buffer = (shm_buffer_t*) malloc(sizeof(shm_buffer_t));
+            buffer->ring = ring;
+            buffer->peer = peer;
+            return buffer;
+        }
+    }
+    munmap(ring, size);
+    return NULL;
+}
+
+// Creates the shared memory object name (which starts with a /) holding a ring of capacity messages
+// (at least 1) of elem_size bytes (at least 1), and opens it
+// Returns NULL if the object already exists or can't be created
+shm_buffer_t* shm_buffer_create(const char* name, size_t capacity, size_t elem_size)
+{
+    if (strlen(name) >= SHM_BUFFER_NAME_MAX || capacity == 0 || elem_size == 0) {
+        return NULL;
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    size_t size = sizeof(shm_ring_t) + capacity * (sizeof(atomic_size_t) + elem_size);
+    if (ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    // the object starts out zeroed: no peers, closed, and no magic yet
+    shm_buffer_t* buffer = shm_attach(fd, size);
+    close(fd);
+    if (buffer == NULL) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    shm_ring_t* ring = buffer->ring;
+    ring->capacity = capacity;
+    ring->elem_size = elem_size;
+    ring->size = size;
+    strcpy(ring->name, name);
+    atomic_init(&ring->open, true);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->data, 0);
+    atomic_init(&ring->data_sleeping, 0);
+    atomic_init(&ring->space, 0);
+    atomic_init(&ring->space_sleeping, 0);
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&ring->seq[i], 2 * i);
+    }
+    buffer->values = (unsigned char*) &ring->seq[capacity];
+    atomic_store_explicit(&ring->magic, SHM_BUFFER_MAGIC, memory_order_release);
+    return buffer;
+}
+
+// Opens the ring another process created with shm_buffer_create
+// Returns NULL if there is no such ring or SHM_BUFFER_PEERS processes already have it open
+shm_buffer_t* shm_buffer_open(const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(shm_ring_t)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t) st.st_size;
+    shm_buffer_t* buffer = shm_attach(fd, size);
+    close(fd);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    shm_ring_t* ring = buffer->ring;
+    if (atomic_load_explicit(&ring->magic, memory_order_acquire) != SHM_BUFFER_MAGIC || ring->size != size) {
+        // not a ring, or its creator hasn't finished building it
+        atomic_store(&ring->peers[buffer->peer], 0);
+        munmap(ring, size);
+        free(buffer);
+        return NULL;
+    }
+    buffer->values = (unsigned char*) &ring->seq[ring->capacity];
+    return buffer;
+}
+
+// Claims the next position of counter (tail with filled 0, head with filled 1) and stores it in pos
+// Returns false if the ring is full (tail) or empty (head)
+bool shm_claim(shm_ring_t* ring, atomic_size_t* counter, size_t filled, size_t* pos)
+{
+    *pos = atomic_load_explicit(counter, memory_order_relaxed);
+    while (true) {
+        size_t seq = atomic_load_explicit(&ring->seq[*pos % ring->capacity], memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (2 * *pos + filled);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(counter, pos, *pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            *pos = atomic_load_explicit(counter, memory_order_relaxed);
+        }
+    }
+}
+
+// Wakes every process sleeping on word, if sleeping says there may be one
+// The fence pairs with the one in shm_sleep: either the sleeper's re-check sees our slot change or we see
+// its flag. Whoever clears the flag wakes everyone, since sleepers that lose the race set it again
+void shm_wake(atomic_uint* word, atomic_uint* sleeping)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(sleeping, memory_order_relaxed) != 0 && atomic_exchange(sleeping, 0) != 0) {
+        atomic_fetch_add(word, 1);
+        syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+// Copies the elem_size bytes at value into the ring and wakes a receiver if one is asleep
+// Safe to call concurrently with every other shm_buffer call, from any process
+// Returns BUFFER_SUCCESS if the ring is not full and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status shm_buffer_add_value(shm_buffer_t* buffer, const void* value)
+{
+    shm_ring_t* ring = buffer->ring;
+    size_t pos;
+    if (!shm_claim(ring, &ring->tail, 0, &pos)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(&buffer->values[(pos % ring->capacity) * ring->elem_size], value, ring->elem_size);
+    atomic_store_explicit(&ring->seq[pos % ring->capacity], 2 * pos + 1, memory_order_release);
+    shm_wake(&ring->data, &ring->data_sleeping);
+    return BUFFER_SUCCESS;
+}
+
+// Copies the oldest message of the ring into the elem_size bytes at value and wakes a sender if one is asleep
+// Safe to call concurrently with every other shm_buffer call, from any process
+// Returns BUFFER_SUCCESS if the ring is not empty and a message was copied out
+// Returns BUFFER_ERROR otherwise
+enum buffer_status shm_buffer_remove_value(shm_buffer_t* buffer, void* value)
+{
+    shm_ring_t* ring = buffer->ring;
+    size_t pos;
+    if (!shm_claim(ring, &ring->head, 1, &pos)) {
+        return BUFFER_ERROR;
+    }
+    memcpy(value, &buffer->values[(pos % ring->capacity) * ring->elem_size], ring->elem_size);
+    atomic_store_explicit(&ring->seq[pos % ring->capacity], 2 * (pos + ring->capacity), memory_order_release);
+    shm_wake(&ring->space, &ring->space_sleeping);
+    return BUFFER_SUCCESS;
+}
+
+// Returns false if the process pid has exited, even if its parent hasn't reaped it yet
+bool shm_peer_alive(int pid)
+{
+    int fd = (int) syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0) {
+        return errno != ESRCH;
+    }
+    // a pidfd becomes readable once its process exits
+    struct pollfd exited = {fd, POLLIN, 0};
+    bool alive = (poll(&exited, 1, 0) == 0);
+    close(fd);
+    return alive;
+}
+
+// Closes the ring if a process that had it open died without detaching, since nobody would ever
+// wake the calls waiting on it
+void shm_reap_peers(shm_buffer_t* buffer)
+{
+    shm_ring_t* ring = buffer->ring;
+    int self = (int) getpid();
+    for (size_t peer = 0; peer < SHM_BUFFER_PEERS; peer++) {
+        int pid = atomic_load(&ring->peers[peer]);
+        if (pid != 0 && pid != self && !shm_peer_alive(pid)) {
+            atomic_compare_exchange_strong(&ring->peers[peer], &pid, 0);
+            shm_buffer_close(buffer);
+        }
+    }
+}
+
+// Sleeps on word until the slot at counter may have reached the state filled stands for (see shm_claim),
+// the ring is closed, or SHM_BUFFER_LIVENESS_MS pass, in which case it checks on the other processes
+void shm_sleep(shm_buffer_t* buffer, atomic_uint* word, atomic_uint* sleeping, atomic_size_t* counter, size_t filled)
+{
+    shm_ring_t* ring = buffer->ring;
+    // reading word first means a wake between here and futex wait makes the wait return at once
+    unsigned seen = atomic_load(word);
+    atomic_store(sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    size_t pos = atomic_load_explicit(counter, memory_order_relaxed);
+    intptr_t diff = (intptr_t) atomic_load(&ring->seq[pos % ring->capacity]) - (intptr_t) (2 * pos + filled);
+    if (diff < 0 && atomic_load(&ring->open)) {
+        struct timespec timeout = {0, SHM_BUFFER_LIVENESS_MS * 1000000L};
+        if (syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, NULL, 0) != 0 && errno == ETIMEDOUT) {
+            shm_reap_peers(buffer);
+        }
+    }
+}
+
+// Copies the elem_size bytes at value into the ring, sleeping while it is full
+// Returns BUFFER_SUCCESS once value was copied in, or BUFFER_ERROR if the ring is closed
+enum buffer_status shm_buffer_send(shm_buffer_t* buffer, const void* value)
+{
+    shm_ring_t* ring = buffer->ring;
+    for (size_t attempt = 0; atomic_load(&ring->open); attempt++) {
+        if (shm_buffer_add_value(buffer, value) == BUFFER_SUCCESS) {
+            return BUFFER_SUCCESS;
+        }
+        if (attempt < SHM_BUFFER_YIELDS) {
+            // the receiver may only need a moment, and may be waiting for this CPU
+            sched_yield();
+            continue;
+        }
+        shm_sleep(buffer, &ring->space, &ring->space_sleeping, &ring->tail, 0);
+    }
+    return BUFFER_ERROR;
+}
+
+// Copies the oldest message of the ring into the elem_size bytes at value, sleeping while it is empty
+// Returns BUFFER_SUCCESS once a message was copied out, or BUFFER_ERROR if the ring is closed
+enum buffer_status shm_buffer_receive(shm_buffer_t* buffer, void* value)
+{
+    shm_ring_t* ring = buffer->ring;
+    for (size_t attempt = 0; atomic_load(&ring->open); attempt++) {
+        if (shm_buffer_remove_value(buffer, value) == BUFFER_SUCCESS) {
+            return BUFFER_SUCCESS;
+        }
+        if (attempt < SHM_BUFFER_YIELDS) {
+            sched_yield();
+            continue;
+        }
+        shm_sleep(buffer, &ring->data, &ring->data_sleeping, &ring->head, 1);
+    }
+    return BUFFER_ERROR;
+}
+
+// Returns false once any process closed the ring, or one of the processes that had it open died
+bool shm_buffer_is_open(shm_buffer_t* buffer)
+{
+    return atomic_load(&buffer->ring->open);
+}
+
+// Closes the ring for every process and wakes every blocked call
+// Returns false if it was already closed
+bool shm_buffer_close(shm_buffer_t* buffer)
+{
+    shm_ring_t* ring = buffer->ring;
+    bool expected = true;
+    if (!atomic_compare_exchange_strong(&ring->open, &expected, false)) {
+        return false;
+    }
+    atomic_fetch_add(&ring->data, 1);
+    atomic_fetch_add(&ring->space, 1);
+    syscall(SYS_futex, &ring->data, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    syscall(SYS_futex, &ring->space, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    return true;
+}
+
+// Unmaps the ring and frees the handle; the shared memory object is removed once no process has it open
+void shm_buffer_detach(shm_buffer_t* buffer)
+{
+    shm_ring_t* ring = buffer->ring;
+    atomic_store(&ring->peers[buffer->peer], 0);
+    bool last = true;
+    for (size_t peer = 0; peer < SHM_BUFFER_PEERS; peer++) {
+        last = last && (atomic_load(&ring->peers[peer]) == 0);
+    }
+    if (last) {
+        shm_unlink(ring->name);
+    }
+    munmap(ring, ring->size);
+    free(buffer);
+}
+
+// Returns the current number of messages in the ring
+// Only a snapshot when other threads or processes are adding or removing at the same time
+size_t shm_buffer_current_size(shm_buffer_t* buffer)
+{
+    // head is read first so the difference can never be negative
+    size_t head = atomic_load(&buffer->ring->head);
+    size_t tail = atomic_load(&buffer->ring->tail);
+    size_t size = tail - head;
+    return size > buffer->ring->capacity ? buffer->ring->capacity : size;
+}
@@ -0,0 +1,94 @@
+#ifndef SHM_BUFFER_H
+#define SHM_BUFFER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "buffer.h"
+
+// Number of processes that can have one shared-memory ring open at the same time
+#define SHM_BUFFER_PEERS 16
+// Longest name (including the terminating 0) of a shared-memory ring
+#define SHM_BUFFER_NAME_MAX 64
+// Number of sched_yield calls a blocked call makes before it sleeps
+#define SHM_BUFFER_YIELDS 2
+// How often a blocked call checks that the other processes of the ring are still alive
+#define SHM_BUFFER_LIVENESS_MS 100
+
+// Bounded multi-producer/multi-consumer ring of elem_size-byte messages that lives entirely in a
+// shared memory object, so processes that map it exchange messages without any system call
+// The slots work as in buffer_t (seq is 2 * pos while free for position pos, 2 * pos + 1 once filled)
+// and are stored right after the header, followed by the values; there are no pointers inside the
+// mapping since every process maps it at its own address
+// A blocked sender (receiver) sleeps on the space (data) futex word after setting space_sleeping
+// (data_sleeping); the other side only bumps the word and calls futex wake if it is the one to clear
+// the flag, so a sleep costs one wake however many messages go by before the sleeper runs again
+// peers holds the pid of every process that has the ring open, 0 in free entries
+typedef struct {
+    atomic_ullong magic; // written last by the creator, so openers never see a half-built ring
+    size_t capacity;
+    size_t elem_size;
+    size_t size;         // bytes in the mapping
+    char name[SHM_BUFFER_NAME_MAX];
+    atomic_bool open;
+    atomic_int peers[SHM_BUFFER_PEERS];
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t head;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t tail;
+    _Alignas(BUFFER_CACHE_LINE) atomic_uint data;
+    atomic_uint data_sleeping;
+    _Alignas(BUFFER_CACHE_LINE) atomic_uint space;
+    atomic_uint space_sleeping;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t seq[];
+} shm_ring_t;
+
+// One process's handle on a shared-memory ring
+typedef struct {
+    shm_ring_t* ring;
+    unsigned char* values;
+    size_t peer; // this handle's entry in ring->peers
+} shm_buffer_t;
+
+// Creates the shared memory object name (which starts with a /) holding a ring of capacity messages
+// (at least 1) of elem_size bytes (at least 1), and opens it
+// Returns NULL if the object already exists or can't be created
+shm_buffer_t* shm_buffer_create(const char* name, size_t capacity, size_t elem_size);
+
+// Opens the ring another process created with shm_buffer_create
+// Returns NULL if there is no such ring or SHM_BUFFER_PEERS processes already have it open
+shm_buffer_t* shm_buffer_open(const char* name);
+
+// Copies the elem_size bytes at value into the ring and wakes a receiver if one is asleep
+// Safe to call concurrently with every other shm_buffer call, from any process
+// Returns BUFFER_SUCCESS if the ring is not full and value was copied in
+// Returns BUFFER_ERROR otherwise
+enum buffer_status shm_buffer_add_value(shm_buffer_t* buffer, const void* value);
+
+// Copies the oldest message of the ring into the elem_size bytes at value and wakes a sender if one is asleep
+// Safe to call concurrently with every other shm_buffer call, from any process
+// Returns BUFFER_SUCCESS if the ring is not empty and a message was copied out
+// Returns BUFFER_ERROR otherwise
+enum buffer_status shm_buffer_remove_value(shm_buffer_t* buffer, void* value);
+
+// Copies the elem_size bytes at value into the ring, sleeping while it is full
+// Returns BUFFER_SUCCESS once value was copied in, or BUFFER_ERROR if the ring is closed
+enum buffer_status shm_buffer_send(shm_buffer_t* buffer, const void* value);
+
+// Copies the oldest message of the ring into the elem_size bytes at value, sleeping while it is empty
+// Returns BUFFER_SUCCESS once a message was copied out, or BUFFER_ERROR if the ring is closed
+enum buffer_status shm_buffer_receive(shm_buffer_t* buffer, void* value);
+
+// Returns false once any process closed the ring, or one of the processes that had it open died
+bool shm_buffer_is_open(shm_buffer_t* buffer);
+
+// Closes the ring for every process and wakes every blocked call
+// Returns false if it was already closed
+bool shm_buffer_close(shm_buffer_t* buffer);
+
+// Unmaps the ring and frees the handle; the shared memory object is removed once no process has it open
+void shm_buffer_detach(shm_buffer_t* buffer);
+
+// Returns the current number of messages in the ring
+// Only a snapshot when other threads or processes are adding or removing at the same time
+size_t shm_buffer_current_size(shm_buffer_t* buffer);
+
+#endif // SHM_BUFFER_H
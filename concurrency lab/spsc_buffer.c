@@ -0,0 +1,132 @@
+#include <string.h>
+#include "spsc_buffer.h"
+
+// Creates a buffer with the given capacity
+spsc_buffer_t* spsc_buffer_create(size_t capacity)
+{
+    spsc_buffer_t* buffer = (spsc_buffer_t*) aligned_alloc(BUFFER_CACHE_LINE, sizeof(spsc_buffer_t));
+    buffer->capacity = capacity;
+    buffer->data = (void**) malloc(capacity * sizeof(void*));
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    buffer->cached_head = 0;
+    buffer->cached_tail = 0;
+    return buffer;
+}
+
+// Adds the value into the buffer
+// Must only be called by one thread at a time
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status spsc_buffer_add(spsc_buffer_t* buffer, void* data)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    if (tail - buffer->cached_head >= buffer->capacity) {
+        // looks full from our cached copy, refresh it before giving up
+        buffer->cached_head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        if (tail - buffer->cached_head >= buffer->capacity) {
+            return BUFFER_ERROR;
+        }
+    }
+    buffer->data[tail % buffer->capacity] = data;
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+// Removes the value from the buffer in FIFO order and stores it in data
+// Must only be called by one thread at a time
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status spsc_buffer_remove(spsc_buffer_t* buffer, void** data)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    if (head == buffer->cached_tail) {
+        // looks empty from our cached copy, refresh it before giving up
+        buffer->cached_tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        if (head == buffer->cached_tail) {
+            return BUFFER_ERROR;
+        }
+    }
+    *data = buffer->data[head % buffer->capacity];
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+    return BUFFER_SUCCESS;
+}
+
+// Adds up to count values from data into the buffer in order with at most two memcpy calls
+// Must only be called by one thread at a time
+// Returns the number of values added, which is 0 if the buffer is full
+size_t spsc_buffer_add_batch(spsc_buffer_t* buffer, void** data, size_t count)
+{
+    size_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    size_t space = buffer->capacity - (tail - buffer->cached_head);
+    if (space < count) {
+        buffer->cached_head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        space = buffer->capacity - (tail - buffer->cached_head);
+    }
+    if (count > space) {
+        count = space;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    // the run may wrap around the end of the ring, so copy it as up to two segments
+    size_t start = tail % buffer->capacity;
+    size_t first = buffer->capacity - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(&buffer->data[start], data, first * sizeof(void*));
+    memcpy(buffer->data, &data[first], (count - first) * sizeof(void*));
+    atomic_store_explicit(&buffer->tail, tail + count, memory_order_release);
+    return count;
+}
+
+// Removes up to max values from the buffer in FIFO order into data with at most two memcpy calls
+// Must only be called by one thread at a time
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t spsc_buffer_remove_batch(spsc_buffer_t* buffer, void** data, size_t max)
+{
+    size_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    size_t available = buffer->cached_tail - head;
+    if (available < max) {
+        buffer->cached_tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        available = buffer->cached_tail - head;
+    }
+    if (max > available) {
+        max = available;
+    }
+    if (max == 0) {
+        return 0;
+    }
+    size_t start = head % buffer->capacity;
+    size_t first = buffer->capacity - start;
+    if (first > max) {
+        first = max;
+    }
+    memcpy(data, &buffer->data[start], first * sizeof(void*));
+    memcpy(&data[first], buffer->data, (max - first) * sizeof(void*));
+    atomic_store_explicit(&buffer->head, head + max, memory_order_release);
+    return max;
+}
+
+// Frees the memory allocated to the buffer
+void spsc_buffer_free(spsc_buffer_t* buffer)
+{
+    free(buffer->data);
+    free(buffer);
+}
+
+// Returns the total capacity of the buffer
+size_t spsc_buffer_capacity(spsc_buffer_t* buffer)
+{
+    return buffer->capacity;
+}
+
+// Returns the current number of elements in the buffer
+// Only a snapshot when the producer or consumer is running at the same time
+size_t spsc_buffer_current_size(spsc_buffer_t* buffer)
+{
+    size_t head = atomic_load(&buffer->head);
+    size_t tail = atomic_load(&buffer->tail);
+    return tail - head;
+}
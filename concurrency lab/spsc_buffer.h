@@ -0,0 +1,57 @@
+#ifndef SPSC_BUFFER_H
+#define SPSC_BUFFER_H
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "buffer.h"
+
+// Bounded single-producer/single-consumer ring
+// head is only written by the consumer and tail only by the producer; each side keeps its own
+// cached copy of the other side's index next to the index it owns, so in steady state a call
+// touches only its own cache line and reads the shared one only when the cached copy says the
+// ring looks full (producer) or empty (consumer)
+typedef struct {
+    size_t capacity;
+    void** data;
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t head;
+    size_t cached_tail; // consumer's last seen value of tail
+    _Alignas(BUFFER_CACHE_LINE) atomic_size_t tail;
+    size_t cached_head; // producer's last seen value of head
+} spsc_buffer_t;
+
+// Creates a buffer with the given capacity
+spsc_buffer_t* spsc_buffer_create(size_t capacity);
+
+// Adds the value into the buffer
+// Must only be called by one thread at a time
+// Returns BUFFER_SUCCESS if the buffer is not full and value was added
+// Returns BUFFER_ERROR otherwise
+enum buffer_status spsc_buffer_add(spsc_buffer_t* buffer, void* data);
+
+// Removes the value from the buffer in FIFO order and stores it in data
+// Must only be called by one thread at a time
+// Returns BUFFER_SUCCESS if the buffer is not empty and a value was removed
+// Returns BUFFER_ERROR otherwise
+enum buffer_status spsc_buffer_remove(spsc_buffer_t* buffer, void** data);
+
+// Adds up to count values from data into the buffer in order with at most two memcpy calls
+// Must only be called by one thread at a time
+// Returns the number of values added, which is 0 if the buffer is full
+size_t spsc_buffer_add_batch(spsc_buffer_t* buffer, void** data, size_t count);
+
+// Removes up to max values from the buffer in FIFO order into data with at most two memcpy calls
+// Must only be called by one thread at a time
+// Returns the number of values removed, which is 0 if the buffer is empty
+size_t spsc_buffer_remove_batch(spsc_buffer_t* buffer, void** data, size_t max);
+
+// Frees the memory allocated to the buffer
+void spsc_buffer_free(spsc_buffer_t* buffer);
+
+// Returns the total capacity of the buffer
+size_t spsc_buffer_capacity(spsc_buffer_t* buffer);
+
+// Returns the current number of elements in the buffer
+// Only a snapshot when the producer or consumer is running at the same time
+size_t spsc_buffer_current_size(spsc_buffer_t* buffer);
+
+#endif // SPSC_BUFFER_H
@@ -3,52 +3,273 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <time.h>
 #include "channel.h"
 #include "stress.h"
+#include "graph.h"
 
 typedef unsigned int distance_t;
 typedef struct {
     size_t src;
-    size_t epoch;
     distance_t dist[0];
 } distance_vector_t;
 
+// Update a router sends its neighbors: count distances for the consecutive destinations first, first + 1, ...,
+// or count (destination, distance) pairs stored one after the other if first is sparse_update
+// credit is the share of the termination credit the update carries to its receiver
+typedef struct {
+    size_t src;
+    size_t count;
+    size_t first;
+    size_t credit;
+    distance_t dist[0];
+} distance_update_t;
+
+// What a router tells the harness on credit_channel: credit it created because its own was too small to
+// split, and credit it gave back on going idle
+// A router always reports creating credit before sending any of it, so the harness's count can't reach 0 early
+typedef struct {
+    size_t minted;
+    size_t returned;
+} credit_message_t;
+
+// In delta mode an update holds num_destinations / DELTA_UPDATE_FRACTION distances (at least DELTA_UPDATE_MIN,
+// rounded up to a whole number of pairs), so a whole vector takes up to DELTA_UPDATE_FRACTION of them
+#define DELTA_UPDATE_FRACTION 4
+#define DELTA_UPDATE_MIN 16
+
+// Termination detection by credit recovery: every router starts with ROUTER_CREDIT, splits what it holds between
+// the updates it sends and itself, adds the credit of every update it receives, and sends all it holds to the
+// harness whenever it goes idle. The routers have converged once the harness got back all the credit there is
+// A router whose credit would give an update less than CREDIT_MIN_SHARE creates more first
+#define ROUTER_CREDIT ((size_t)1 << 40)
+#define CREDIT_MIN_SHARE ((size_t)1 << 16)
+
 static const distance_t inf_distance = 0x7fffffff;
-static distance_t* topology;
+static const size_t no_router = (size_t)-1; // src of the probes that collect the final vectors
+static const size_t sparse_update = (size_t)-1;
+static bool delta_updates;     // routers only send the entries that changed since their previous update
+static size_t update_capacity; // distances in one update
+static atomic_size_t updates_sent;
+static atomic_size_t pair_rounds;   // calls of build_updates that sent pairs
+static atomic_size_t run_rounds;    // calls that sent some runs of the vector
+static atomic_size_t vector_rounds; // calls that sent every run
+static graph_t* topology;
 static distance_t* solution;
 static size_t num_channel;
+static size_t num_destinations; // routers keep their distances to nodes 0 to num_destinations - 1
 static channel_t** channels;
 static channel_t* done_channel;
 static channel_t* completed_channel;
+static channel_t* credit_channel;
 
 distance_t get_link_distance(size_t src, size_t dst) {
-    return topology[src * num_channel + dst];
-}
-
-void set_link_distance(size_t src, size_t dst, distance_t distance) {
-    topology[src * num_channel + dst] = distance;
+    if (src == dst) {
+        return 0;
+    }
+    uint32_t weight = graph_weight(topology, src, dst);
+    return (weight >= inf_distance) ? inf_distance : weight;
 }
 
 distance_t get_solution_distance(size_t src, size_t dst) {
-    return solution[src * num_channel + dst];
+    return solution[src * num_destinations + dst];
 }
 
 void set_solution_distance(size_t src, size_t dst, distance_t distance) {
-    solution[src * num_channel + dst] = distance;
+    solution[src * num_destinations + dst] = distance;
+}
+
+// Side of the square tiles floyd_warshall works on; three tiles of distances fit in a core's L2 cache
+#define FLOYD_WARSHALL_TILE 64
+
+typedef distance_t distance_vec_t __attribute__((vector_size(16)));
+#define DISTANCE_LANES (sizeof(distance_vec_t) / sizeof(distance_t))
+
+typedef struct {
+    size_t thread;
+    size_t threads;
+    pthread_barrier_t* barrier;
+} floyd_warshall_args_t;
+
+// Relaxes the solution tile at (row_tile, col_tile) through every intermediate node of tile mid_tile:
+// solution[src][dst] = min(solution[src][dst], solution[src][mid] + solution[mid][dst])
+// The intermediate is the outer loop, so the tile may be the one it reads from (the diagonal tile, and the
+// tiles in its row and column), just as in the plain triple loop
+// Every distance is at most inf_distance, so a sum fits in distance_t and an unreachable hop never wins
+void relax_tile(size_t row_tile, size_t col_tile, size_t mid_tile) {
+    size_t row = row_tile * FLOYD_WARSHALL_TILE;
+    size_t col = col_tile * FLOYD_WARSHALL_TILE;
+    size_t mid = mid_tile * FLOYD_WARSHALL_TILE;
+    size_t row_end = (row + FLOYD_WARSHALL_TILE < num_channel) ? row + FLOYD_WARSHALL_TILE : num_channel;
+    size_t col_end = (col + FLOYD_WARSHALL_TILE < num_channel) ? col + FLOYD_WARSHALL_TILE : num_channel;
+    size_t mid_end = (mid + FLOYD_WARSHALL_TILE < num_channel) ? mid + FLOYD_WARSHALL_TILE : num_channel;
+    for (size_t intermediate = mid; intermediate < mid_end; intermediate++) {
+        const distance_t* through = &solution[intermediate * num_channel];
+        for (size_t src = row; src < row_end; src++) {
+            distance_t* dist = &solution[src * num_channel];
+            distance_t first = dist[intermediate];
+            if (first == inf_distance) {
+                continue;
+            }
+            size_t dst = col;
+            for (; dst + DISTANCE_LANES <= col_end; dst += DISTANCE_LANES) {
+                distance_vec_t current, via;
+                memcpy(&current, &dist[dst], sizeof(current));
+                memcpy(&via, &through[dst], sizeof(via));
+                via += first;
+                distance_vec_t shorter = (distance_vec_t)(via < current);
+                current = (via & shorter) | (current & ~shorter);
+                memcpy(&dist[dst], &current, sizeof(current));
+            }
+            for (; dst < col_end; dst++) {
+                if (first + through[dst] < dist[dst]) {
+                    dist[dst] = first + through[dst];
+                }
+            }
+        }
+    }
+}
+
+// Runs this thread's share of every phase of the tiled Floyd-Warshall algorithm: for each diagonal tile,
+// first the tile itself, then the other tiles in its row and column, then all the remaining tiles, each
+// phase only reading tiles the previous ones finished
+void* floyd_warshall_worker(void* arg) {
+    floyd_warshall_args_t* args = (floyd_warshall_args_t*)arg;
+    size_t tiles = (num_channel + FLOYD_WARSHALL_TILE - 1) / FLOYD_WARSHALL_TILE;
+    for (size_t mid = 0; mid < tiles; mid++) {
+        if (args->thread == 0) {
+            relax_tile(mid, mid, mid);
+        }
+        pthread_barrier_wait(args->barrier);
+        for (size_t task = args->thread; task < 2 * tiles; task += args->threads) {
+            size_t other = task / 2;
+            if (other == mid) {
+                continue;
+            }
+            if (task % 2 == 0) {
+                relax_tile(mid, other, mid);
+            } else {
+                relax_tile(other, mid, mid);
+            }
+        }
+        pthread_barrier_wait(args->barrier);
+        for (size_t task = args->thread; task < tiles * tiles; task += args->threads) {
+            size_t row = task / tiles;
+            size_t col = task % tiles;
+            if (row != mid && col != mid) {
+                relax_tile(row, col, mid);
+            }
+        }
+        pthread_barrier_wait(args->barrier);
+    }
+    return NULL;
 }
 
 void floyd_warshall()
 {
-    memcpy(solution, topology, sizeof(distance_t) * num_channel * num_channel);
-    for (size_t intermediate = 0; intermediate < num_channel; intermediate++) {
+    for (size_t src = 0; src < num_channel; src++) {
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            set_solution_distance(src, dst, (src == dst) ? 0 : inf_distance);
+        }
+        for (size_t edge = topology->offsets[src]; edge < topology->offsets[src + 1]; edge++) {
+            set_solution_distance(src, topology->targets[edge], get_link_distance(src, topology->targets[edge]));
+        }
+    }
+    size_t tiles = (num_channel + FLOYD_WARSHALL_TILE - 1) / FLOYD_WARSHALL_TILE;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = (cpus > 0) ? (size_t)cpus : 1;
+    // the row and column phase has the fewest tiles to share out
+    if (threads > 2 * tiles) {
+        threads = 2 * tiles;
+    }
+
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, (unsigned)threads);
+    floyd_warshall_args_t* args = malloc(sizeof(floyd_warshall_args_t) * threads);
+    assert(args != NULL);
+    pthread_t* pid = malloc(sizeof(pthread_t) * threads);
+    assert(pid != NULL);
+    for (size_t i = 0; i < threads; i++) {
+        args[i] = (floyd_warshall_args_t){i, threads, &barrier};
+        if (i > 0) {
+            int pthread_status = pthread_create(&pid[i], NULL, floyd_warshall_worker, &args[i]);
+            assert(pthread_status == 0);
+        }
+    }
+    floyd_warshall_worker(&args[0]);
+    for (size_t i = 1; i < threads; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    free(pid);
+    free(args);
+    pthread_barrier_destroy(&barrier);
+}
+
+// Entry of the binary heap dijkstra keeps its frontier in
+typedef struct {
+    distance_t distance;
+    uint32_t node;
+} heap_entry_t;
+
+// Adds entry to the binary min-heap of count entries at heap
+void heap_push(heap_entry_t* heap, size_t* count, heap_entry_t entry) {
+    size_t i = (*count)++;
+    while (i > 0 && heap[(i - 1) / 2].distance > entry.distance) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = entry;
+}
+
+// Removes and returns the entry with the smallest distance from the binary min-heap of count entries at heap
+heap_entry_t heap_pop(heap_entry_t* heap, size_t* count) {
+    heap_entry_t top = heap[0];
+    heap_entry_t last = heap[--(*count)];
+    size_t i = 0;
+    while (2 * i + 1 < *count) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < *count && heap[child + 1].distance < heap[child].distance) {
+            child++;
+        }
+        if (heap[child].distance >= last.distance) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// Fills the solution column of every destination with Dijkstra's algorithm from that destination
+// The topology is undirected, so the distance from the destination to a node is the node's distance to it; an entry
+// goes on the heap every time a node's distance drops, and stale ones are skipped when they come off
+void dijkstra()
+{
+    heap_entry_t* heap = malloc(sizeof(heap_entry_t) * (topology->edges + 1));
+    assert(heap != NULL);
+    for (size_t dst = 0; dst < num_destinations; dst++) {
         for (size_t src = 0; src < num_channel; src++) {
-            for (size_t dst = 0; dst < num_channel; dst++) {
-                if (get_solution_distance(src, intermediate) + get_solution_distance(intermediate, dst) < get_solution_distance(src, dst)) {
-                    set_solution_distance(src, dst, get_solution_distance(src, intermediate) + get_solution_distance(intermediate, dst));
+            set_solution_distance(src, dst, inf_distance);
+        }
+        size_t count = 0;
+        set_solution_distance(dst, dst, 0);
+        heap_push(heap, &count, (heap_entry_t){0, (uint32_t)dst});
+        while (count > 0) {
+            heap_entry_t entry = heap_pop(heap, &count);
+            if (entry.distance > get_solution_distance(entry.node, dst)) {
+                continue;
+            }
+            for (size_t edge = topology->offsets[entry.node]; edge < topology->offsets[entry.node + 1]; edge++) {
+                distance_t distance = entry.distance + get_link_distance(entry.node, topology->targets[edge]);
+                if (distance < get_solution_distance(topology->targets[edge], dst)) {
+                    set_solution_distance(topology->targets[edge], dst, distance);
+                    heap_push(heap, &count, (heap_entry_t){distance, topology->targets[edge]});
                 }
             }
         }
     }
+    free(heap);
 }
 
 void print_graph()
@@ -71,7 +292,7 @@ void print_solution()
 {
     //printf("SOLUTION\n");
     for (size_t src = 0; src < num_channel; src++) {
-        for (size_t dst = 0; dst < num_channel; dst++) {
+        for (size_t dst = 0; dst < num_destinations; dst++) {
             distance_t distance = get_solution_distance(src, dst);
             if (distance == inf_distance) {
                 printf("inf ");
@@ -83,83 +304,179 @@ void print_solution()
     }
 }
 
-bool create_topology(const char* filename)
+// Loads the topology in filename and calculates the distances of every node to the first destinations nodes,
+// or to all of them if destinations is 0
+bool create_topology(const char* filename, size_t destinations)
 {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Could not open topology file: %s\n", filename);
+    topology = graph_load(filename);
+    if (topology == NULL) {
+        printf("Could not load topology file: %s\n", filename);
         return false;
     }
-    int num_scanned = fscanf(file, "%zu", &num_channel);
-    assert(num_scanned == 1);
-    assert(num_channel > 0);
-    topology = malloc(sizeof(distance_t) * num_channel * num_channel);
-    assert(topology != NULL);
-    solution = malloc(sizeof(distance_t) * num_channel * num_channel);
+    num_channel = topology->nodes;
+    num_destinations = (destinations == 0 || destinations > num_channel) ? num_channel : destinations;
+    solution = malloc(sizeof(distance_t) * num_channel * num_destinations);
     assert(solution != NULL);
-    // populate topology
-    for (size_t src = 0; src < num_channel; src++) {
-        for (size_t dst = 0; dst < num_channel; dst++) {
-            distance_t distance;
-            num_scanned = fscanf(file, "%d", (int*)&distance);
-            assert(num_scanned == 1);
-            // negative values get converted to inf_distance
-            if (distance > inf_distance) {
-                distance = inf_distance;
-            }
-            set_link_distance(src, dst, distance);
-        }
+    if (num_destinations == num_channel) {
+        // calculate solution using Floyd-Warshall algorithm
+        floyd_warshall();
+    } else {
+        // a few columns are cheaper to get with one shortest path search each
+        dijkstra();
     }
-    fclose(file);
-    // calculate solution using Floyd-Warshall algorithm
-    floyd_warshall();
     return true;
 }
 
 void destroy_topology()
 {
     //printf("\nOOGA\n");
-    free(topology);
+    graph_free(topology);
     //printf("\nBOOGA\n");
     free(solution);
     //printf("\nHUUUUUHHHHHHHHH\n");
 }
 
+// Size of one distance vector, which routers copy into completed_channel to report their state
+size_t vector_size()
+{
+    return sizeof(distance_vector_t) + sizeof(distance_t) * num_destinations;
+}
+
+// Size of one distance update, which routers copy into each other's typed channels
+size_t update_size()
+{
+    return sizeof(distance_update_t) + sizeof(distance_t) * update_capacity;
+}
+
+// Returns the update at position i of outbox
+distance_update_t* outbox_update(char* outbox, size_t i)
+{
+    return (distance_update_t*)(outbox + i * update_size());
+}
+
+// Fills outbox with the updates that tell a neighbor the new distances in state of the changed_count entries
+// listed in changed, and returns how many it took
+// The vector is split into runs of update_capacity distances; the entries go out as pairs, or as every run
+// that holds one of them unless pairs take fewer updates (always outside delta mode), which is the whole
+// vector once every run holds a change. dirty is scratch space with room for one flag per run
+size_t build_updates(size_t index, distance_vector_t* state, size_t* changed, size_t changed_count, char* outbox,
+                     bool* dirty)
+{
+    if (changed_count == 0) {
+        return 0;
+    }
+    size_t runs = (num_destinations + update_capacity - 1) / update_capacity;
+    memset(dirty, 0, sizeof(bool) * runs);
+    size_t dirty_runs = 0;
+    for (size_t i = 0; i < changed_count; i++) {
+        if (!dirty[changed[i] / update_capacity]) {
+            dirty[changed[i] / update_capacity] = true;
+            dirty_runs++;
+        }
+    }
+    size_t pairs = update_capacity / 2;
+    size_t count = 0;
+    if (delta_updates && (changed_count + pairs - 1) / pairs < dirty_runs) {
+        atomic_fetch_add_explicit(&pair_rounds, 1, memory_order_relaxed);
+        for (size_t start = 0; start < changed_count; start += pairs) {
+            distance_update_t* update = outbox_update(outbox, count++);
+            update->src = index;
+            update->first = sparse_update;
+            update->count = (changed_count - start < pairs) ? changed_count - start : pairs;
+            for (size_t i = 0; i < update->count; i++) {
+                update->dist[2 * i] = (distance_t)changed[start + i];
+                update->dist[2 * i + 1] = state->dist[changed[start + i]];
+            }
+        }
+    } else {
+        atomic_fetch_add_explicit((dirty_runs == runs) ? &vector_rounds : &run_rounds, 1, memory_order_relaxed);
+        for (size_t first = 0; first < num_destinations; first += update_capacity) {
+            if (!dirty[first / update_capacity]) {
+                continue;
+            }
+            distance_update_t* update = outbox_update(outbox, count++);
+            update->src = index;
+            update->first = first;
+            update->count = (num_destinations - first < update_capacity) ? num_destinations - first : update_capacity;
+            memcpy(update->dist, &state->dist[first], sizeof(distance_t) * update->count);
+        }
+    }
+    return count;
+}
+
+// Gives each of the count updates in outbox an equal share of *credit, keeping at least as much, and creates
+// more credit first if the shares would be too small
+void share_credit(size_t* credit, char* outbox, size_t update_count, size_t sends)
+{
+    size_t shares = update_count * sends + 1;
+    if (*credit / shares < CREDIT_MIN_SHARE) {
+        credit_message_t message = {.minted = shares * CREDIT_MIN_SHARE, .returned = 0};
+        enum channel_status status = channel_send_value(credit_channel, &message);
+        assert(status == SUCCESS);
+        *credit += message.minted;
+    }
+    size_t share = *credit / shares;
+    for (size_t i = 0; i < update_count; i++) {
+        outbox_update(outbox, i)->credit = share;
+    }
+    *credit -= share * (shares - 1);
+}
+
 void* router(void* arg)
 {
     bool changed = false;
     size_t index = (size_t)arg;
     size_t selected_index;
-    distance_vector_t* prev_prev_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(prev_prev_state != NULL);
-    distance_vector_t* prev_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
-    assert(prev_state != NULL);
-    distance_vector_t* curr_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
+    // curr_state holds the distances of the updates being sent, next_state the ones found since; the
+    // updates are copied into the channels, so they only have to stay put until every neighbor has them all
+    distance_vector_t* curr_state = malloc(vector_size());
     assert(curr_state != NULL);
-    distance_vector_t* next_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
+    distance_vector_t* next_state = malloc(vector_size());
     assert(next_state != NULL);
-    prev_prev_state->src = index;
-    prev_state->src = index;
+    distance_update_t* neighbor_update = malloc(update_size());
+    assert(neighbor_update != NULL);
+    char* outbox = malloc(update_size() * ((num_destinations + update_capacity - 1) / update_capacity));
+    assert(outbox != NULL);
+    // entries of next_state that differ from curr_state, each listed once
+    size_t* changed_list = malloc(sizeof(size_t) * num_destinations);
+    assert(changed_list != NULL);
+    bool* listed = malloc(sizeof(bool) * num_destinations);
+    assert(listed != NULL);
+    bool* dirty = malloc(sizeof(bool) * ((num_destinations + update_capacity - 1) / update_capacity));
+    assert(dirty != NULL);
+    size_t changed_count = 0;
+    size_t credit = ROUTER_CREDIT;
     curr_state->src = index;
     next_state->src = index;
-    prev_prev_state->epoch = 0;
-    prev_state->epoch = 1;
-    curr_state->epoch = 2;
-    next_state->epoch = 3;
-    for (size_t i = 0; i < num_channel; i++) {
-        prev_prev_state->dist[i] = get_link_distance(index, i);
-        prev_state->dist[i] = get_link_distance(index, i);
-        curr_state->dist[i] = get_link_distance(index, i);
-        next_state->dist[i] = get_link_distance(index, i);
+    for (size_t i = 0; i < num_destinations; i++) {
+        curr_state->dist[i] = inf_distance;
+        listed[i] = false;
     }
-    size_t total_select_count = 2;
-    for (size_t i = 0; i < num_channel; i++) {
-        if ((i != index) && get_link_distance(index, i) != inf_distance) {
-            total_select_count++;
+    if (index < num_destinations) {
+        curr_state->dist[index] = 0;
+    }
+    size_t first_edge = topology->offsets[index];
+    size_t last_edge = topology->offsets[index + 1];
+    for (size_t edge = first_edge; edge < last_edge; edge++) {
+        if (topology->targets[edge] < num_destinations) {
+            curr_state->dist[topology->targets[edge]] = get_link_distance(index, topology->targets[edge]);
         }
     }
+    memcpy(next_state->dist, curr_state->dist, sizeof(distance_t) * num_destinations);
+    // neighbors start out knowing nothing, which is what an unreachable entry tells them
+    for (size_t i = 0; i < num_destinations; i++) {
+        if (curr_state->dist[i] != inf_distance) {
+            changed_list[changed_count++] = i;
+        }
+    }
+    size_t update_count = build_updates(index, curr_state, changed_list, changed_count, outbox, dirty);
+    changed_count = 0;
+    size_t total_select_count = 2 + (last_edge - first_edge);
     select_t* select_list = malloc(sizeof(select_t) * total_select_count);
     assert(select_list != NULL);
+    // next update each neighbor gets this round
+    size_t* next_update = malloc(sizeof(size_t) * total_select_count);
+    assert(next_update != NULL);
     size_t select_count = 0;
     select_list[select_count].channel = done_channel;
     select_list[select_count].dir = RECV;
@@ -167,64 +484,90 @@ void* router(void* arg)
     select_count++;
     select_list[select_count].channel = channels[index];
     select_list[select_count].dir = RECV;
-    select_list[select_count].data = NULL;
+    select_list[select_count].data = neighbor_update;
     select_count++;
-    for (size_t i = 0; i < num_channel; i++) {
-        if ((i != index) && get_link_distance(index, i) != inf_distance) {
-            select_list[select_count].channel = channels[i];
-            select_list[select_count].dir = SEND;
-            select_list[select_count].data = curr_state;
-            select_count++;
+    for (size_t edge = first_edge; edge < last_edge; edge++) {
+        select_list[select_count].channel = channels[topology->targets[edge]];
+        select_list[select_count].dir = SEND;
+        select_list[select_count].data = outbox_update(outbox, 0);
+        next_update[select_count] = 0;
+        select_count++;
+    }
+    // register with every channel once; sends that already went out this round are disabled
+    // instead of being swapped out of the list
+    select_set_t* select_set = select_set_create(select_list, select_count);
+    size_t pending_sends = select_count - 2;
+    if (update_count == 0) {
+        for (size_t i = 2; i < total_select_count; i++) {
+            select_set_enable(select_set, i, false);
         }
+        pending_sends = 0;
+    } else {
+        share_credit(&credit, outbox, update_count, pending_sends);
     }
     while (true) {
-        enum channel_status status = channel_select(select_list, select_count, &selected_index);
+        if ((pending_sends == 0) && !changed && (credit > 0)) {
+            // idle: nothing left to send and nothing new to tell, so give the credit back
+            credit_message_t message = {.minted = 0, .returned = credit};
+            enum channel_status status = channel_send_value(credit_channel, &message);
+            assert(status == SUCCESS);
+            credit = 0;
+        }
+        enum channel_status status = select_set_wait(select_set, &selected_index);
         if (status == SUCCESS) {
             assert(selected_index != 0);
             if (selected_index == 1) {
-                if (select_list[selected_index].data) {
+                if (neighbor_update->src != no_router) {
                     // update next_state with new data
-                    distance_vector_t* neighbor_state = select_list[selected_index].data;
-                    distance_t neighbor_dist = get_link_distance(index, neighbor_state->src);
+                    credit += neighbor_update->credit;
+                    distance_t neighbor_dist = get_link_distance(index, neighbor_update->src);
                     assert(neighbor_dist != inf_distance);
-                    for (size_t i = 0; i < num_channel; i++) {
-                        distance_t new_dist = neighbor_dist + neighbor_state->dist[i];
-                        if (new_dist < next_state->dist[i]) {
-                            next_state->dist[i] = new_dist;
+                    bool sparse = (neighbor_update->first == sparse_update);
+                    for (size_t i = 0; i < neighbor_update->count; i++) {
+                        size_t dst = sparse ? neighbor_update->dist[2 * i] : neighbor_update->first + i;
+                        distance_t new_dist = neighbor_dist + neighbor_update->dist[sparse ? 2 * i + 1 : i];
+                        if (new_dist < next_state->dist[dst]) {
+                            next_state->dist[dst] = new_dist;
                             changed = true;
+                            if (!listed[dst]) {
+                                listed[dst] = true;
+                                changed_list[changed_count++] = dst;
+                            }
                         }
                     }
                 } else {
-                    // special message sent to test convergence
-                    bool converged = (select_count == 2) && !changed;
-                    status = channel_send(completed_channel, converged ? curr_state : NULL);
+                    // special message sent once the routers converged; reply with our state
+                    assert((pending_sends == 0) && !changed);
+                    status = channel_send_value(completed_channel, curr_state);
                     assert(status == SUCCESS);
                 }
             } else {
-                select_count--;
-                // swap last element and selected element
-                channel_t* temp = select_list[select_count].channel;
-                select_list[select_count].channel = select_list[selected_index].channel;
-                select_list[selected_index].channel = temp;
+                atomic_fetch_add_explicit(&updates_sent, 1, memory_order_relaxed);
+                if (++next_update[selected_index] < update_count) {
+                    select_list[selected_index].data = outbox_update(outbox, next_update[selected_index]);
+                } else {
+                    select_set_enable(select_set, selected_index, false);
+                    pending_sends--;
+                }
             }
             // check if we've sent to everyone
-            if (select_count == 2) {
+            if (pending_sends == 0) {
                 // check if we want to reset
                 if (changed) {
-                    // cycle triple buffer
-                    distance_vector_t* temp_state = curr_state;
-                    curr_state = next_state;
-                    next_state = prev_prev_state;
-                    prev_prev_state = prev_state;
-                    prev_state = temp_state;
-                    next_state->epoch = curr_state->epoch + 1;
-                    for (size_t i = 0; i < num_channel; i++) {
-                        next_state->dist[i] = curr_state->dist[i];
+                    // every neighbor has its copies, so curr_state can take the new distances
+                    for (size_t i = 0; i < changed_count; i++) {
+                        curr_state->dist[changed_list[i]] = next_state->dist[changed_list[i]];
+                        listed[changed_list[i]] = false;
                     }
+                    update_count = build_updates(index, curr_state, changed_list, changed_count, outbox, dirty);
+                    changed_count = 0;
                     // reset to broadcast again
-                    select_count = total_select_count;
-                    for (size_t i = 2; i < select_count; i++) {
-                        select_list[i].data = curr_state;
+                    pending_sends = total_select_count - 2;
+                    share_credit(&credit, outbox, update_count, pending_sends);
+                    for (size_t i = 2; i < total_select_count; i++) {
+                        next_update[i] = 0;
+                        select_list[i].data = outbox_update(outbox, 0);
+                        select_set_enable(select_set, i, true);
                     }
                     changed = false;
                 }
@@ -236,109 +579,129 @@ void* router(void* arg)
             break;
         }
     }
+    select_set_destroy(select_set);
+    free(next_update);
     free(select_list);
-    free(prev_prev_state);
-    free(prev_state);
+    free(dirty);
+    free(listed);
+    free(changed_list);
+    free(outbox);
     free(curr_state);
     free(next_state);
+    free(neighbor_update);
     return NULL;
 }
 
-bool check_done()
+// Blocks until the routers have given back all the credit there is, which they only do once every one of them
+// is idle and no update is left in the channels
+void wait_for_quiescence()
+{
+    size_t outstanding = num_channel * ROUTER_CREDIT;
+    credit_message_t message;
+    while (outstanding > 0) {
+        enum channel_status status = channel_receive_value(credit_channel, &message);
+        assert(status == SUCCESS);
+        outstanding += message.minted;
+        outstanding -= message.returned;
+    }
+}
+
+// Collects every router's distance vector and checks it against the solution
+// The routers must have converged already
+void check_solution()
 {
-    bool valid = true;
     enum channel_status status;
-    distance_vector_t** completed = malloc(sizeof(distance_vector_t*) * num_channel);
-    assert(completed != NULL);
-    // validate by sending special NULL message to flush channels
+    distance_vector_t* reply = malloc(vector_size());
+    assert(reply != NULL);
+    distance_update_t* probe = malloc(update_size());
+    assert(probe != NULL);
+    probe->src = no_router;
+    probe->count = 0;
+    probe->credit = 0;
     for (size_t i = 0; i < num_channel; i++) {
-        status = channel_send(channels[i], NULL);
+        status = channel_send_value(channels[i], probe);
         assert(status == SUCCESS);
     }
-    // receive special response
     for (size_t i = 0; i < num_channel; i++) {
-        void* data = NULL;
-        status = channel_receive(completed_channel, &data);
+        status = channel_receive_value(completed_channel, reply);
         assert(status == SUCCESS);
-        if (data == NULL) {
-            valid = false;
-        } else {
-            distance_vector_t* new_data = (distance_vector_t*)data;
-            size_t index = new_data->src;
-            completed[index] = new_data;
+        for (size_t dst = 0; dst < num_destinations; dst++) {
+            assert(reply->dist[dst] == get_solution_distance(reply->src, dst));
         }
     }
-    if (valid) {
-        // ensure epoch hasn't changed since first validation
-        for (size_t i = 0; i < num_channel; i++) {
-            status = channel_send(channels[i], NULL);
-            assert(status == SUCCESS);
-        }
-        // receive special response
-        for (size_t i = 0; i < num_channel; i++) {
-            void* data = NULL;
-            status = channel_receive(completed_channel, &data);
-            assert(status == SUCCESS);
-            if (data == NULL) {
-                valid = false;
-            } else {
-                distance_vector_t* new_data = (distance_vector_t*)data;
-                size_t index = new_data->src;
-                if (completed[index]->epoch != new_data->epoch) {
-                    valid = false;
-                }
-            }
-        }
-        if (valid) {
-            // check results
-            for (size_t src = 0; src < num_channel; src++) {
-                for (size_t dst = 0; dst < num_channel; dst++) {
-                    assert(completed[src]->dist[dst] == get_solution_distance(src, dst));
-                }
-            }
-        }
-    }
-    free(completed);
-    return valid;
+    free(probe);
+    free(reply);
 }
 
-void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
+// Runs one router per node of the topology in filename, as a thread each or as fibers of pool if it isn't NULL,
+// and checks that they converge on the shortest paths to the first destinations nodes (all of them if it is 0)
+// Routers send delta updates if delta is true; the totals of the run are stored in report unless it is NULL
+void run_routers(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, fiber_pool_t* pool,
+                 size_t destinations, bool delta, stress_report_t* report)
 {
     assert(main_buffer_size <= 1); // only support up to a buffer size of 1
     assert(secondary_buffer_size <= 1); // only support up to a buffer size of 1
     int pthread_status;
     enum channel_status status;
-    bool initialized = create_topology(filename);
+    bool initialized = create_topology(filename, destinations);
     assert(initialized);
+    delta_updates = delta;
+    update_capacity = num_destinations;
+    if (delta) {
+        update_capacity = (num_destinations + DELTA_UPDATE_FRACTION - 1) / DELTA_UPDATE_FRACTION;
+        update_capacity = (update_capacity < DELTA_UPDATE_MIN) ? DELTA_UPDATE_MIN : update_capacity;
+        update_capacity += update_capacity % 2;
+        update_capacity = (update_capacity > num_destinations + num_destinations % 2) ? num_destinations + num_destinations % 2 : update_capacity;
+    }
+    atomic_store(&updates_sent, 0);
+    atomic_store(&pair_rounds, 0);
+    atomic_store(&run_rounds, 0);
+    atomic_store(&vector_rounds, 0);
     channels = malloc(sizeof(channel_t*) * num_channel);
     assert(channels != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        channels[i] = channel_create(main_buffer_size);
+        channels[i] = channel_create_typed(main_buffer_size, update_size());
         assert(channels[i] != NULL);
     }
     done_channel = channel_create(secondary_buffer_size);
     assert(done_channel != NULL);
-    completed_channel = channel_create(secondary_buffer_size);
+    completed_channel = channel_create_typed(secondary_buffer_size, vector_size());
     assert(completed_channel != NULL);
+    // room for every router to go idle at once without waiting on the harness
+    credit_channel = channel_create_typed(num_channel, sizeof(credit_message_t));
+    assert(credit_channel != NULL);
 
-    pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
-    assert(pid != NULL);
-    for (size_t i = 0; i < num_channel; i++) {
-        pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
-        assert(pthread_status == 0);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t* pid = NULL;
+    if (pool != NULL) {
+        for (size_t i = 0; i < num_channel; i++) {
+            fiber_spawn(pool, router, (void*)i);
+        }
+    } else {
+        pid = malloc(sizeof(pthread_t) * num_channel);
+        assert(pid != NULL);
+        for (size_t i = 0; i < num_channel; i++) {
+            pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
+            assert(pthread_status == 0);
+        }
     }
 
     // wait for convergence
-    while (!check_done()) {
-        usleep(1000);
-    }
+    wait_for_quiescence();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    check_solution();
 
     // stop threads
     status = channel_close(done_channel);
     assert(status == SUCCESS);
     // join threads
-    for (size_t i = 0; i < num_channel; i++) {
-        pthread_join(pid[i], NULL);
+    if (pool != NULL) {
+        fiber_pool_join(pool);
+    } else {
+        for (size_t i = 0; i < num_channel; i++) {
+            pthread_join(pid[i], NULL);
+        }
     }
     // cleanup
     status = channel_destroy(done_channel);
@@ -347,6 +710,10 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     assert(status == SUCCESS);
     status = channel_destroy(completed_channel);
     assert(status == SUCCESS);
+    status = channel_close(credit_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(credit_channel);
+    assert(status == SUCCESS);
     //printf("\nSTARTING FOR LOOP\n");
     for (size_t i = 0; i < num_channel; i++) {
         status = channel_close(channels[i]);
@@ -356,9 +723,42 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
         assert(status == SUCCESS);
     }
     //printf("\nENDING FOR LOOP\n");
+    if (report != NULL) {
+        report->nodes = num_channel;
+        report->updates = atomic_load(&updates_sent);
+        report->bytes = report->updates * update_size();
+        report->pair_rounds = atomic_load(&pair_rounds);
+        report->run_rounds = atomic_load(&run_rounds);
+        report->vector_rounds = atomic_load(&vector_rounds);
+        report->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    }
     free(pid);
     //printf("\nFREED pid\n");
     free(channels);
     //printf("\nFREED channels\n");
     destroy_topology();
 }
+
+void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
+{
+    run_routers(main_buffer_size, secondary_buffer_size, filename, NULL, 0, false, NULL);
+}
+
+void run_stress_report(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, bool delta,
+                       stress_report_t* report)
+{
+    run_routers(main_buffer_size, secondary_buffer_size, filename, NULL, 0, delta, report);
+}
+
+void run_stress_fibers(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, size_t threads)
+{
+    run_stress_fibers_bounded(main_buffer_size, secondary_buffer_size, filename, threads, 0);
+}
+
+void run_stress_fibers_bounded(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                               size_t threads, size_t destinations)
+{
+    fiber_pool_t* pool = fiber_pool_create(threads, 0);
+    run_routers(main_buffer_size, secondary_buffer_size, filename, pool, destinations, false, NULL);
+    fiber_pool_destroy(pool);
+}
@@ -1,6 +1,37 @@
 #ifndef STRESS_H
 #define STRESS_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+// Totals of one run of the routers (see run_stress_report)
+typedef struct {
+    size_t nodes;
+    size_t updates;  // distance updates the routers sent each other
+    size_t bytes;    // bytes those updates copied through the channels
+    size_t pair_rounds;   // rounds in which a router sent its changes as (destination, distance) pairs
+    size_t run_rounds;    // rounds in which it sent only the runs of its vector that hold a change
+    size_t vector_rounds; // rounds in which every run held a change, so it sent its whole vector
+    double seconds;  // from starting the routers until they all went idle with no update in flight
+} stress_report_t;
+
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename);
 
+// Same as run_stress, but the routers run as fibers on a pool of threads OS threads (0 for one per CPU)
+void run_stress_fibers(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, size_t threads);
+
+// Same as run_stress_fibers, but every router only keeps its distances to nodes 0 to destinations - 1 (all nodes if
+// destinations is 0), so a router's state and updates stay the same size however many nodes the topology has, and
+// the reference distances come from one Dijkstra search per destination instead of Floyd-Warshall
+// The topology must be undirected, like the ones graph_gen writes
+void run_stress_fibers_bounded(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                               size_t threads, size_t destinations);
+
+// Same as run_stress, but if delta is true every router only sends its neighbors the entries that changed since its
+// previous update, either as (destination, distance) pairs or as the runs of consecutive distances that hold them,
+// whichever takes fewer updates, which is the whole vector once every run holds a change; stores the totals of the
+// run in report
+void run_stress_report(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename, bool delta,
+                       stress_report_t* report);
+
 #endif // STRESS_H
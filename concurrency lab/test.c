@@ -6,10 +6,16 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sched.h>
 #include "stress.h"
 #include "stress_send_recv.h"
+#include "executor.h"
+#include "graph.h"
 
 #define mu_str_(text) #text
 #define mu_str(text) mu_str_(text)
@@ -37,6 +43,7 @@ typedef struct {
     sem_t *done;
     enum channel_status out;
     size_t index;
+    size_t cursor; // rotation state of the fair select helpers
 } select_args;
 
 typedef struct {
@@ -77,6 +84,7 @@ void init_object_for_select_api(select_args* new_args, select_t *list, size_t li
     new_args->out = GENERIC_ERROR;
     new_args->index = list_size;
     new_args->done = done;
+    new_args->cursor = 0;
 }
 
 void print_test_details(const char* test_name, const char* message) {
@@ -107,6 +115,14 @@ void* helper_select(select_args *myargs) {
     return NULL; 
 }
 
+void* helper_select_fair(select_args *myargs) {
+    myargs->out = channel_select_fair(myargs->select_list, myargs->list_size, &myargs->index, &myargs->cursor);
+    if (myargs->done) {
+        sem_post(myargs->done);
+    }
+    return NULL;
+}
+
 void* helper_non_blocking_send(send_args *myargs) {
     myargs->out = channel_non_blocking_send(myargs->channel, myargs->data);
     if (myargs->done) {
@@ -1149,6 +1165,88 @@ char* test_stress() {
     return NULL;
 }
 
+char* test_stress_delta() {
+    print_test_details(__func__, "Stress Testing the routers with delta updates");
+    const char* topologies[] = {"topology.txt", "connected_topology.txt", "random_topology.txt", "random_topology_1.txt", "big_graph.txt"};
+    for (size_t i = 0; i < sizeof(topologies) / sizeof(topologies[0]); i++) {
+        stress_report_t report;
+        run_stress_report(1, 1, topologies[i], true, &report);
+        mu_assert("test_stress_delta: Report is incomplete", report.nodes > 0 && report.updates > 0 && report.bytes > 0);
+    }
+
+    /* On 100 nodes the changes go out as pairs, as the runs that hold them and as whole vectors */
+    stress_report_t report;
+    run_stress_report(1, 1, "big_graph.txt", true, &report);
+    mu_assert("test_stress_delta: No round sent pairs", report.pair_rounds > 0);
+    mu_assert("test_stress_delta: No round sent part of the runs", report.run_rounds > 0);
+    mu_assert("test_stress_delta: No round sent the whole vector", report.vector_rounds > 0);
+
+    /* A vector that fits in one update always goes out whole */
+    run_stress_report(1, 1, "topology.txt", true, &report);
+    mu_assert("test_stress_delta: A one-run vector was split",
+              report.pair_rounds == 0 && report.run_rounds == 0 && report.vector_rounds > 0);
+
+    /* Without delta updates every round sends the whole vector */
+    run_stress_report(1, 1, "big_graph.txt", false, &report);
+    mu_assert("test_stress_delta: Full updates were split",
+              report.pair_rounds == 0 && report.run_rounds == 0 && report.vector_rounds > 0);
+    return NULL;
+}
+
+// Returns true if every edge of graph has a matching edge back with the same weight
+bool graph_is_undirected(graph_t* graph) {
+    for (size_t src = 0; src < graph->nodes; src++) {
+        for (size_t edge = graph->offsets[src]; edge < graph->offsets[src + 1]; edge++) {
+            if (graph_weight(graph, graph->targets[edge], src) != graph->weights[edge]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+char* test_graph() {
+    print_test_details(__func__, "Testing sparse graphs, binary graph files and the topology generators");
+    graph_t* text = graph_load("topology.txt");
+    mu_assert("test_graph: Could not load the text topology", text != NULL);
+    mu_assert("test_graph: Wrong size of the text topology", text->nodes == 10 && text->edges == 20);
+    mu_assert("test_graph: Wrong edges in the text topology",
+              graph_weight(text, 0, 9) == 1 && graph_weight(text, 0, 2) == GRAPH_NO_EDGE && graph_weight(text, 0, 0) == GRAPH_NO_EDGE);
+    graph_free(text);
+
+    graph_t* grid = graph_generate_grid(6, 5, 9, 1);
+    mu_assert("test_graph: Wrong size of the grid", grid->nodes == 30 && grid->edges == 2 * (5 * 5 + 6 * 4));
+    mu_assert("test_graph: Wrong degrees in the grid", graph_degree(grid, 0) == 2 && graph_degree(grid, 7) == 4);
+    mu_assert("test_graph: The grid isn't undirected", graph_is_undirected(grid));
+    graph_t* random = graph_generate_random(200, 6, 9, 2);
+    mu_assert("test_graph: The random graph isn't undirected", random->nodes == 200 && graph_is_undirected(random));
+    graph_free(random);
+    graph_t* power_law = graph_generate_power_law(200, 2, 9, 3);
+    mu_assert("test_graph: The power-law graph isn't undirected", power_law->nodes == 200 && graph_is_undirected(power_law));
+    for (size_t node = 0; node < power_law->nodes; node++) {
+        mu_assert("test_graph: A node of the power-law graph has no edge", graph_degree(power_law, node) > 0);
+    }
+    graph_free(power_law);
+
+    // a binary file maps back to the same graph, and the routers run on it like on a text topology
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/channel_test_graph_%d.bin", (int)getpid());
+    mu_assert("test_graph: Could not save the grid", graph_save(grid, filename));
+    graph_t* mapped = graph_load(filename);
+    mu_assert("test_graph: Could not map the grid", mapped != NULL && mapped->mapping != NULL);
+    mu_assert("test_graph: The mapped grid differs",
+              mapped->nodes == grid->nodes && mapped->edges == grid->edges &&
+              memcmp(mapped->offsets, grid->offsets, sizeof(uint64_t) * (grid->nodes + 1)) == 0 &&
+              memcmp(mapped->targets, grid->targets, sizeof(uint32_t) * grid->edges) == 0 &&
+              memcmp(mapped->weights, grid->weights, sizeof(uint32_t) * grid->edges) == 0);
+    graph_free(mapped);
+    graph_free(grid);
+    run_stress(1, 1, filename);
+    unlink(filename);
+    mu_assert("test_graph: Mapped a file that isn't a graph", graph_map("topology.txt") == NULL);
+    return NULL;
+}
+
 char* test_stress_send_recv() {
     print_test_details(__func__, "Stress Testing for send/recv without select (takes around 10 seconds)");
     run_stress_send_recv(1, 4, 0.25, 1000000);
@@ -1634,6 +1732,1863 @@ char* test_select_with_duplicate_channel_size1() {
 }
 
 
+typedef struct {
+    buffer_t* buffer;
+    size_t first;
+    size_t count;
+    bool* seen;
+} buffer_args;
+
+void* helper_buffer_add(buffer_args* myargs) {
+    for (size_t i = 0; i < myargs->count; i++) {
+        while (buffer_add(myargs->buffer, (void*)(myargs->first + i)) == BUFFER_ERROR) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void* helper_buffer_remove(buffer_args* myargs) {
+    for (size_t i = 0; i < myargs->count; i++) {
+        void* data = NULL;
+        while (buffer_remove(myargs->buffer, &data) == BUFFER_ERROR) {
+            sched_yield();
+        }
+        // every value is owned by exactly one remover so seen[] needs no lock
+        myargs->seen[(size_t)data] = true;
+    }
+    return NULL;
+}
+
+char* test_buffer_concurrent() {
+    print_test_details(__func__, "Testing concurrent lock-free buffer add/remove");
+
+    /* Several producers and consumers hammer a small ring directly; every value must come out exactly once */
+    size_t THREADS = 4;
+    size_t PER_THREAD = 20000;
+    buffer_t* buffer = buffer_create(3);
+    pthread_t add_pid[THREADS];
+    pthread_t remove_pid[THREADS];
+    buffer_args add_args[THREADS];
+    buffer_args remove_args[THREADS];
+    bool* seen[THREADS];
+
+    for (size_t i = 0; i < THREADS; i++) {
+        seen[i] = calloc(THREADS * PER_THREAD, sizeof(bool));
+        add_args[i] = (buffer_args){buffer, i * PER_THREAD, PER_THREAD, NULL};
+        remove_args[i] = (buffer_args){buffer, 0, PER_THREAD, seen[i]};
+        pthread_create(&add_pid[i], NULL, (void *)helper_buffer_add, &add_args[i]);
+        pthread_create(&remove_pid[i], NULL, (void *)helper_buffer_remove, &remove_args[i]);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(add_pid[i], NULL);
+        pthread_join(remove_pid[i], NULL);
+    }
+
+    mu_assert("test_buffer_concurrent: Buffer should be empty", buffer_current_size(buffer) == 0);
+    for (size_t value = 0; value < THREADS * PER_THREAD; value++) {
+        size_t count = 0;
+        for (size_t i = 0; i < THREADS; i++) {
+            count += seen[i][value] ? 1 : 0;
+        }
+        mu_assert("test_buffer_concurrent: Value lost or duplicated", count == 1);
+    }
+
+    for (size_t i = 0; i < THREADS; i++) {
+        free(seen[i]);
+    }
+    buffer_free(buffer);
+    return NULL;
+}
+
+typedef struct {
+    channel_t* channel;
+    size_t count;
+    enum channel_status out;
+} spsc_args;
+
+void* helper_spsc_producer(spsc_args* myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = 1; i <= myargs->count && myargs->out == SUCCESS; i++) {
+        myargs->out = channel_send(myargs->channel, (void*)i);
+    }
+    return NULL;
+}
+
+char* test_spsc_channel() {
+    print_test_details(__func__, "Testing single-producer/single-consumer channel");
+
+    /* One producer and one consumer move many messages through a small SPSC channel; order must be preserved */
+    size_t COUNT = 100000;
+    channel_t* channel = channel_create_spsc(4);
+    mu_assert("test_spsc_channel: Could not create channel", channel != NULL);
+
+    void* data = NULL;
+    mu_assert("test_spsc_channel: Empty channel should not receive", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+
+    pthread_t pid;
+    spsc_args args = {channel, COUNT, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_spsc_producer, &args);
+    for (size_t i = 1; i <= COUNT; i++) {
+        mu_assert("test_spsc_channel: Receive failed", channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_spsc_channel: Messages out of order", (size_t)data == i);
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc_channel: Send failed", args.out == SUCCESS);
+
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_spsc_channel: Non-blocking send failed", channel_non_blocking_send(channel, "Message") == SUCCESS);
+    }
+    mu_assert("test_spsc_channel: Full channel should not send", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* A size of 0 is an unbuffered channel: a send waits for the receiver instead of failing forever */
+    channel = channel_create_spsc(0);
+    mu_assert("test_spsc_channel: Could not create unbuffered channel", channel != NULL && channel->kind == CHANNEL_SYNC);
+    mu_assert("test_spsc_channel: Send without a receiver should not complete", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    args = (spsc_args){channel, 100, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_spsc_producer, &args);
+    for (size_t i = 1; i <= 100; i++) {
+        mu_assert("test_spsc_channel: Unbuffered receive failed", channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_spsc_channel: Unbuffered messages out of order", (size_t)data == i);
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc_channel: Unbuffered send failed", args.out == SUCCESS);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_spsc_select_close() {
+    print_test_details(__func__, "Testing select and close on single-producer/single-consumer channels");
+
+    size_t CHANNELS = 2;
+    pthread_t pid;
+    channel_t* channel[CHANNELS];
+    select_t list[CHANNELS];
+
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel[i] = channel_create_spsc(1);
+        list[i].dir = RECV;
+        list[i].channel = channel[i];
+        list[i].data = NULL;
+    }
+
+    // A blocked select wakes up when the producer sends on the second channel
+    select_args args;
+    init_object_for_select_api(&args, list, CHANNELS, NULL);
+    pthread_create(&pid, NULL, (void *)helper_select, &args);
+    usleep(10000);
+    mu_assert("test_spsc_select_close: It isn't blocked as expected", args.out == GENERIC_ERROR);
+    mu_assert("test_spsc_select_close: Send failed", channel_send(channel[1], "Message1") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc_select_close: Select failed", args.out == SUCCESS);
+    mu_assert("test_spsc_select_close: Received wrong index", args.index == 1);
+    mu_assert("test_spsc_select_close: Received wrong message", string_equal(list[1].data, "Message1"));
+
+    // A blocked receive and a blocked select both see the close
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channel[0], NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_spsc_select_close: It isn't blocked as expected", rec_args.out == GENERIC_ERROR);
+    mu_assert("test_spsc_select_close: Can't close channel", channel_close(channel[0]) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_spsc_select_close: Receive should see close", rec_args.out == CLOSED_ERROR);
+
+    size_t index;
+    mu_assert("test_spsc_select_close: Select on closed channel should return CLOSED_ERROR", channel_select(list, CHANNELS, &index) == CLOSED_ERROR);
+    mu_assert("test_spsc_select_close: Select returned wrong index", index == 0);
+
+    channel_destroy(channel[0]);
+    channel_close(channel[1]);
+    channel_destroy(channel[1]);
+    return NULL;
+}
+
+char* test_wakeups_per_message() {
+    print_test_details(__func__, "Testing that each message wakes at most one waiter");
+
+    /* Many receivers and selects park on the same channels; every send should hand its message to exactly one of them */
+    size_t THREADS = 20;
+    size_t CHANNELS = 2;
+    pthread_t pid[THREADS];
+    receive_args rec_args[THREADS];
+    select_args sel_args[THREADS];
+    select_t list[THREADS][CHANNELS];
+    channel_t* channel[CHANNELS];
+
+    sem_t done;
+    sem_init(&done, 0, 0);
+
+    // Blocked receivers
+    channel[0] = channel_create(1);
+    for (size_t i = 0; i < THREADS; i++) {
+        init_object_for_receive_api(&rec_args[i], channel[0], &done);
+        pthread_create(&pid[i], NULL, (void *)helper_receive, &rec_args[i]);
+    }
+    usleep(10000);
+    for (size_t i = 0; i < THREADS; i++) {
+        mu_assert("test_wakeups_per_message: Send failed", channel_send(channel[0], "Message") == SUCCESS);
+        sem_wait(&done);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_wakeups_per_message: Receive failed", rec_args[i].out == SUCCESS);
+    }
+    mu_assert("test_wakeups_per_message: Too many wakeups for blocked receives", channel_wakeups_per_message(channel[0]) <= 1.0);
+    channel_close(channel[0]);
+    channel_destroy(channel[0]);
+
+    // Blocked selects over the same two channels
+    for (size_t j = 0; j < CHANNELS; j++) {
+        channel[j] = channel_create(1);
+        for (size_t i = 0; i < THREADS; i++) {
+            list[i][j].dir = RECV;
+            list[i][j].channel = channel[j];
+            list[i][j].data = NULL;
+        }
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        init_object_for_select_api(&sel_args[i], list[i], CHANNELS, &done);
+        pthread_create(&pid[i], NULL, (void *)helper_select, &sel_args[i]);
+    }
+    usleep(10000);
+    for (size_t i = 0; i < THREADS; i++) {
+        mu_assert("test_wakeups_per_message: Send failed", channel_send(channel[i % CHANNELS], "Message") == SUCCESS);
+        sem_wait(&done);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_wakeups_per_message: Select failed", sel_args[i].out == SUCCESS);
+    }
+    for (size_t j = 0; j < CHANNELS; j++) {
+        mu_assert("test_wakeups_per_message: Too many wakeups for blocked selects", channel_wakeups_per_message(channel[j]) <= 1.0);
+        channel_close(channel[j]);
+        channel_destroy(channel[j]);
+    }
+
+    sem_destroy(&done);
+    return NULL;
+}
+
+typedef struct {
+    channel_t* channel;
+    void** items;
+    size_t count;
+    size_t chunk;
+    size_t done;
+    enum channel_status out;
+} batch_args;
+
+void* helper_send_batch(batch_args* myargs) {
+    myargs->done = 0;
+    myargs->out = SUCCESS;
+    while (myargs->done < myargs->count && myargs->out == SUCCESS) {
+        size_t n = myargs->count - myargs->done;
+        if (n > myargs->chunk) {
+            n = myargs->chunk;
+        }
+        size_t sent = 0;
+        myargs->out = channel_send_batch(myargs->channel, &myargs->items[myargs->done], n, &sent);
+        myargs->done += sent;
+    }
+    return NULL;
+}
+
+char* test_batch_channel(channel_t* channel) {
+    size_t COUNT = 20000;
+    void* items[COUNT];
+    void* out[COUNT];
+    size_t n = 0;
+
+    for (size_t i = 0; i < COUNT; i++) {
+        items[i] = (void*)(i + 1);
+    }
+
+    // Non-blocking batches stop at the capacity (4) and report what moved
+    mu_assert("test_batch: Non-blocking batch send failed", channel_non_blocking_send_batch(channel, items, 6, &n) == SUCCESS);
+    mu_assert("test_batch: Non-blocking batch send should fill the channel", n == 4);
+    mu_assert("test_batch: Full channel should not accept a batch", channel_non_blocking_send_batch(channel, items, 6, &n) == CHANNEL_FULL);
+    mu_assert("test_batch: Full channel batch should report nothing sent", n == 0);
+    mu_assert("test_batch: Batch receive failed", channel_receive_batch(channel, out, 10, &n) == SUCCESS);
+    mu_assert("test_batch: Batch receive should drain the channel", n == 4);
+    for (size_t i = 0; i < n; i++) {
+        mu_assert("test_batch: Batch receive out of order", out[i] == items[i]);
+    }
+    mu_assert("test_batch: Empty channel should not return a batch", channel_non_blocking_receive_batch(channel, out, 10, &n) == CHANNEL_EMPTY);
+
+    // Blocking batches in both directions keep FIFO order
+    pthread_t pid;
+    batch_args args = {channel, items, COUNT, 7, 0, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_batch, &args);
+    size_t received = 0;
+    while (received < COUNT) {
+        size_t max = COUNT - received;
+        if (max > 3) {
+            max = 3;
+        }
+        mu_assert("test_batch: Blocking batch receive failed", channel_receive_batch(channel, &out[received], max, &n) == SUCCESS);
+        mu_assert("test_batch: Blocking batch receive returned nothing", n > 0 && n <= max);
+        received += n;
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_batch: Blocking batch send failed", args.out == SUCCESS && args.done == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        mu_assert("test_batch: Blocking batches out of order", out[i] == items[i]);
+    }
+
+    // A blocked batch send reports how much it sent before the close
+    args = (batch_args){channel, items, 10, 10, 0, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_send_batch, &args);
+    usleep(10000);
+    mu_assert("test_batch: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_batch: Blocked batch send should see close", args.out == CLOSED_ERROR);
+    mu_assert("test_batch: Blocked batch send should have filled the channel", args.done == 4);
+    mu_assert("test_batch: Batch receive on closed channel", channel_receive_batch(channel, out, 10, &n) == CLOSED_ERROR);
+
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_batch() {
+    print_test_details(__func__, "Testing batch send/receive");
+    char* result = test_batch_channel(channel_create(4));
+    if (result != NULL) {
+        return result;
+    }
+    return test_batch_channel(channel_create_spsc(4));
+}
+
+typedef struct {
+    channel_t** channels;
+    size_t channel_count;
+    enum direction dir;
+    size_t count;
+    size_t sum;
+    enum channel_status out;
+} rendezvous_args;
+
+void* helper_rendezvous_select(rendezvous_args* myargs) {
+    select_t list[myargs->channel_count];
+    myargs->out = SUCCESS;
+    myargs->sum = 0;
+    for (size_t i = 1; i <= myargs->count && myargs->out == SUCCESS; i++) {
+        for (size_t j = 0; j < myargs->channel_count; j++) {
+            list[j].channel = myargs->channels[j];
+            list[j].dir = myargs->dir;
+            list[j].data = (void*)i;
+        }
+        size_t index;
+        myargs->out = channel_select(list, myargs->channel_count, &index);
+        if (myargs->out == SUCCESS) {
+            myargs->sum += (size_t)list[index].data;
+        }
+    }
+    return NULL;
+}
+
+char* test_rendezvous() {
+    print_test_details(__func__, "Testing unbuffered channels with direct handoff");
+
+    /* With nobody waiting on the other side, non-blocking calls never complete */
+    channel_t* channel = channel_create(0);
+    mu_assert("test_rendezvous: Buffer capacity is not as expected", buffer_capacity(channel->buffer) == 0);
+    void* data = NULL;
+    mu_assert("test_rendezvous: Send without a receiver should not complete", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    mu_assert("test_rendezvous: Receive without a sender should not complete", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+
+    /* A parked sender hands its message to a non-blocking receive */
+    pthread_t pid;
+    send_args snd_args;
+    init_object_for_send_api(&snd_args, channel, "Message1", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &snd_args);
+    usleep(10000);
+    mu_assert("test_rendezvous: Send isn't blocked as expected", snd_args.out == GENERIC_ERROR);
+    mu_assert("test_rendezvous: Receive from parked sender failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Send failed", snd_args.out == SUCCESS);
+    mu_assert("test_rendezvous: Received wrong message", string_equal(data, "Message1"));
+
+    /* A parked select receives straight from a plain send, on whichever entry it was sent */
+    channel_t* other = channel_create(1);
+    select_t list[2] = {{other, RECV, NULL}, {channel, RECV, NULL}};
+    select_args sel_args;
+    init_object_for_select_api(&sel_args, list, 2, NULL);
+    pthread_create(&pid, NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_rendezvous: Select isn't blocked as expected", sel_args.out == GENERIC_ERROR);
+    mu_assert("test_rendezvous: Send to parked select failed", channel_send(channel, "Message2") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Select failed", sel_args.out == SUCCESS);
+    mu_assert("test_rendezvous: Select returned wrong index", sel_args.index == 1);
+    mu_assert("test_rendezvous: Select received wrong message", string_equal(list[1].data, "Message2"));
+    mu_assert("test_rendezvous: Handoff should wake exactly one waiter", channel_wakeups_per_message(channel) <= 1.0);
+
+    /* Selects sending and selects receiving on the same unbuffered channels pair up; every message arrives exactly once */
+    size_t THREADS = 4;
+    size_t COUNT = 2000;
+    channel_t* channels[2] = {channel, channel_create(0)};
+    pthread_t pids[2 * THREADS];
+    rendezvous_args args[2 * THREADS];
+    for (size_t i = 0; i < 2 * THREADS; i++) {
+        args[i] = (rendezvous_args){channels, 2, (i < THREADS) ? SEND : RECV, COUNT, 0, GENERIC_ERROR};
+        pthread_create(&pids[i], NULL, (void *)helper_rendezvous_select, &args[i]);
+    }
+    size_t sent = 0;
+    size_t received = 0;
+    for (size_t i = 0; i < 2 * THREADS; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_rendezvous: Select in pairing failed", args[i].out == SUCCESS);
+        if (i < THREADS) {
+            sent += args[i].sum;
+        } else {
+            received += args[i].sum;
+        }
+    }
+    mu_assert("test_rendezvous: Messages were lost or duplicated", sent == received && sent == THREADS * COUNT * (COUNT + 1) / 2);
+
+    /* A select never pairs up with its own entries */
+    select_t both[2] = {{channel, SEND, "Message3"}, {channel, RECV, NULL}};
+    init_object_for_select_api(&sel_args, both, 2, NULL);
+    pthread_create(&pid, NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_rendezvous: Select paired with itself", sel_args.out == GENERIC_ERROR);
+    mu_assert("test_rendezvous: Receive from parked select failed", channel_receive(channel, &data) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Select failed", sel_args.out == SUCCESS);
+    mu_assert("test_rendezvous: Select returned wrong index", sel_args.index == 0);
+    mu_assert("test_rendezvous: Received wrong message", string_equal(data, "Message3"));
+
+    /* Close wakes a parked sender */
+    init_object_for_send_api(&snd_args, channel, "Message4", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &snd_args);
+    usleep(10000);
+    mu_assert("test_rendezvous: Send isn't blocked as expected", snd_args.out == GENERIC_ERROR);
+    mu_assert("test_rendezvous: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_rendezvous: Send should see close", snd_args.out == CLOSED_ERROR);
+
+    channel_destroy(channel);
+    channel_close(channels[1]);
+    channel_destroy(channels[1]);
+    channel_close(other);
+    channel_destroy(other);
+    return NULL;
+}
+
+typedef struct {
+    select_set_t* set;
+    enum channel_status out;
+    size_t index;
+} select_set_args;
+
+void* helper_select_set(select_set_args* myargs) {
+    myargs->out = select_set_wait(myargs->set, &myargs->index);
+    return NULL;
+}
+
+char* test_select_set() {
+    print_test_details(__func__, "Testing reusable select sets");
+
+    size_t CHANNELS = 3;
+    channel_t* channel[CHANNELS];
+    select_t list[CHANNELS];
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel[i] = channel_create(1);
+        list[i].channel = channel[i];
+        list[i].dir = RECV;
+        list[i].data = NULL;
+    }
+    select_set_t* set = select_set_create(list, CHANNELS);
+    mu_assert("test_select_set: Could not create select set", set != NULL);
+
+    /* Messages sent before the first wait are found */
+    size_t index;
+    mu_assert("test_select_set: Send failed", channel_send(channel[2], "Message1") == SUCCESS);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    mu_assert("test_select_set: Wait returned wrong index", index == 2);
+    mu_assert("test_select_set: Wait received wrong message", string_equal(list[2].data, "Message1"));
+
+    /* A blocked wait wakes up for a send */
+    pthread_t pid;
+    select_set_args args = {set, GENERIC_ERROR, CHANNELS};
+    pthread_create(&pid, NULL, (void *)helper_select_set, &args);
+    usleep(10000);
+    mu_assert("test_select_set: Wait isn't blocked as expected", args.out == GENERIC_ERROR);
+    mu_assert("test_select_set: Send failed", channel_send(channel[1], "Message2") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Wait failed", args.out == SUCCESS);
+    mu_assert("test_select_set: Wait returned wrong index", args.index == 1);
+    mu_assert("test_select_set: Wait received wrong message", string_equal(list[1].data, "Message2"));
+
+    /* Disabled entries are skipped until they are enabled again */
+    select_set_enable(set, 0, false);
+    mu_assert("test_select_set: Send failed", channel_send(channel[0], "Message3") == SUCCESS);
+    mu_assert("test_select_set: Send failed", channel_send(channel[1], "Message4") == SUCCESS);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    mu_assert("test_select_set: Wait used a disabled entry", index == 1);
+    select_set_enable(set, 0, true);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    mu_assert("test_select_set: Wait returned wrong index", index == 0);
+    mu_assert("test_select_set: Wait received wrong message", string_equal(list[0].data, "Message3"));
+
+    /* A set that isn't waiting doesn't keep messages from other receivers */
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channel[2], NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_select_set: Receive isn't blocked as expected", rec_args.out == GENERIC_ERROR);
+    mu_assert("test_select_set: Send failed", channel_send(channel[2], "Message5") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Receive failed", rec_args.out == SUCCESS);
+    mu_assert("test_select_set: Received wrong message", string_equal(rec_args.data, "Message5"));
+
+    /* Many waits in a row see every message exactly once */
+    size_t COUNT = 1000;
+    spsc_args snd_args[CHANNELS];
+    pthread_t pids[CHANNELS];
+    for (size_t i = 0; i < CHANNELS; i++) {
+        snd_args[i] = (spsc_args){channel[i], COUNT, GENERIC_ERROR};
+        pthread_create(&pids[i], NULL, (void *)helper_spsc_producer, &snd_args[i]);
+    }
+    size_t next[CHANNELS];
+    for (size_t i = 0; i < CHANNELS; i++) {
+        next[i] = 1;
+    }
+    for (size_t i = 0; i < CHANNELS * COUNT; i++) {
+        mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+        mu_assert("test_select_set: Messages out of order", (size_t)list[index].data == next[index]);
+        next[index]++;
+    }
+    for (size_t i = 0; i < CHANNELS; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_select_set: Send failed", snd_args[i].out == SUCCESS);
+    }
+
+    /* Close is reported with the index of the closed entry */
+    args.out = GENERIC_ERROR;
+    pthread_create(&pid, NULL, (void *)helper_select_set, &args);
+    usleep(10000);
+    mu_assert("test_select_set: Wait isn't blocked as expected", args.out == GENERIC_ERROR);
+    mu_assert("test_select_set: Can't close channel", channel_close(channel[1]) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Wait should see close", args.out == CLOSED_ERROR);
+    mu_assert("test_select_set: Wait returned wrong index", args.index == 1);
+
+    select_set_destroy(set);
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel_close(channel[i]);
+        channel_destroy(channel[i]);
+    }
+
+    /* Every message already buffered is found without further sends */
+    channel_t* buffered = channel_create(4);
+    select_t entry = {buffered, RECV, NULL};
+    set = select_set_create(&entry, 1);
+    mu_assert("test_select_set: Send failed", channel_send(buffered, (void*)1) == SUCCESS);
+    mu_assert("test_select_set: Send failed", channel_send(buffered, (void*)2) == SUCCESS);
+    mu_assert("test_select_set: Send failed", channel_send(buffered, (void*)3) == SUCCESS);
+    for (size_t i = 1; i <= 3; i++) {
+        mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+        mu_assert("test_select_set: Messages out of order", (size_t)entry.data == i);
+    }
+    select_set_destroy(set);
+    channel_close(buffered);
+    channel_destroy(buffered);
+
+    /* Entries of two sets on an unbuffered channel pair up with each other */
+    channel_t* unbuffered = channel_create(0);
+    select_t send_entry = {unbuffered, SEND, "Message6"};
+    select_t recv_entry = {unbuffered, RECV, NULL};
+    select_set_t* sender = select_set_create(&send_entry, 1);
+    set = select_set_create(&recv_entry, 1);
+    args = (select_set_args){sender, GENERIC_ERROR, 1};
+    pthread_create(&pid, NULL, (void *)helper_select_set, &args);
+    usleep(10000);
+    mu_assert("test_select_set: Wait isn't blocked as expected", args.out == GENERIC_ERROR);
+    mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_select_set: Wait failed", args.out == SUCCESS);
+    mu_assert("test_select_set: Wait returned wrong index", args.index == 0 && index == 0);
+    mu_assert("test_select_set: Wait received wrong message", string_equal(recv_entry.data, "Message6"));
+
+    /* Either set may reach the channel first, and each rendezvous moves exactly one message */
+    for (size_t i = 1; i <= 100; i++) {
+        send_entry.data = (void*)i;
+        args.out = GENERIC_ERROR;
+        pthread_create(&pid, NULL, (void *)helper_select_set, &args);
+        mu_assert("test_select_set: Wait failed", select_set_wait(set, &index) == SUCCESS);
+        mu_assert("test_select_set: Messages out of order", (size_t)recv_entry.data == i);
+        pthread_join(pid, NULL);
+        mu_assert("test_select_set: Wait failed", args.out == SUCCESS);
+    }
+    select_set_destroy(sender);
+    select_set_destroy(set);
+    channel_close(unbuffered);
+    channel_destroy(unbuffered);
+    return NULL;
+}
+
+char* test_spin_budget() {
+    print_test_details(__func__, "Testing adaptive spin budget of blocking calls");
+
+    channel_t* channel = channel_create(1);
+    mu_assert("test_spin_budget: Spin budget out of bounds", channel->spin_budget <= channel->spin_limit);
+    mu_assert("test_spin_budget: Spin limit out of bounds", channel->spin_limit <= CHANNEL_SPIN_MAX);
+
+    /* Ping-pong keeps the budget within its bounds */
+    size_t COUNT = 10000;
+    pthread_t pid;
+    spsc_args args = {channel, COUNT, GENERIC_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_spsc_producer, &args);
+    for (size_t i = 1; i <= COUNT; i++) {
+        void* data;
+        mu_assert("test_spin_budget: Receive failed", channel_receive(channel, &data) == SUCCESS);
+        mu_assert("test_spin_budget: Messages out of order", (size_t)data == i);
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_spin_budget: Send failed", args.out == SUCCESS);
+    mu_assert("test_spin_budget: Spin budget out of bounds", channel->spin_budget <= channel->spin_limit);
+
+    /* Force a 500us spin limit so the adaptive path also runs on a single CPU */
+    channel_set_spin_limit(channel, 500000);
+    mu_assert("test_spin_budget: Setting the limit should restart the budget", channel->spin_budget == CHANNEL_SPIN_MIN);
+
+    /* Waits shorter than the limit grow the budget towards their length */
+    for (size_t i = 0; i < 3; i++) {
+        receive_args rec_args;
+        init_object_for_receive_api(&rec_args, channel, NULL);
+        pthread_create(&pid, NULL, (void *)helper_receive, &rec_args);
+        usleep(100);
+        mu_assert("test_spin_budget: Send failed", channel_send(channel, "Message") == SUCCESS);
+        pthread_join(pid, NULL);
+        mu_assert("test_spin_budget: Receive failed", rec_args.out == SUCCESS);
+    }
+    mu_assert("test_spin_budget: Short waits should grow the budget", channel->spin_budget > CHANNEL_SPIN_MIN);
+    mu_assert("test_spin_budget: Spin budget out of bounds", channel->spin_budget <= channel->spin_limit);
+
+    /* Waits longer than the limit halve the budget down to its minimum */
+    for (size_t i = 0; i < 12; i++) {
+        receive_args rec_args;
+        init_object_for_receive_api(&rec_args, channel, NULL);
+        pthread_create(&pid, NULL, (void *)helper_receive, &rec_args);
+        usleep(2000);
+        mu_assert("test_spin_budget: Send failed", channel_send(channel, "Message") == SUCCESS);
+        pthread_join(pid, NULL);
+        mu_assert("test_spin_budget: Receive failed", rec_args.out == SUCCESS);
+    }
+    mu_assert("test_spin_budget: Slow waits should not keep spinning", channel->spin_budget == CHANNEL_SPIN_MIN);
+
+    /* A limit of 0 turns spinning off */
+    channel_set_spin_limit(channel, 0);
+    mu_assert("test_spin_budget: Spinning should be off", channel->spin_budget == 0);
+
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_channel_stats() {
+    print_test_details(__func__, "Testing per-channel counters");
+
+    channel_t* channel = channel_create(2);
+    channel_stats_t stats;
+    mu_assert("test_channel_stats: Counters should be off by default", channel_stats(channel, &stats) == GENERIC_ERROR);
+    channel_enable_stats(channel);
+
+    /* Non-blocking calls are counted with the depth they left behind */
+    void* data;
+    mu_assert("test_channel_stats: Send failed", channel_non_blocking_send(channel, "Message1") == SUCCESS);
+    mu_assert("test_channel_stats: Send failed", channel_send(channel, "Message2") == SUCCESS);
+    mu_assert("test_channel_stats: Full channel should not send", channel_non_blocking_send(channel, "Message3") == CHANNEL_FULL);
+    mu_assert("test_channel_stats: Receive failed", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_stats: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+    mu_assert("test_channel_stats: Reading counters failed", channel_stats(channel, &stats) == SUCCESS);
+    mu_assert("test_channel_stats: Wrong number of sends", stats.sends == 2);
+    mu_assert("test_channel_stats: Wrong number of receives", stats.receives == 2);
+    mu_assert("test_channel_stats: Nothing should have blocked", stats.blocked_sends == 0 && stats.blocked_receives == 0);
+    mu_assert("test_channel_stats: Wrong depth histogram", stats.depth[0] == 1 && stats.depth[1] == 2 && stats.depth[2] == 1);
+
+    /* A receive that has to wait is counted as blocked for about as long as it waited */
+    pthread_t pid;
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_channel_stats: Send failed", channel_send(channel, "Message4") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_channel_stats: Receive failed", rec_args.out == SUCCESS);
+    mu_assert("test_channel_stats: Reading counters failed", channel_stats(channel, &stats) == SUCCESS);
+    mu_assert("test_channel_stats: Wrong number of sends", stats.sends == 3);
+    mu_assert("test_channel_stats: Wrong number of receives", stats.receives == 3);
+    mu_assert("test_channel_stats: Blocked receive was not counted", stats.blocked_receives == 1 && stats.blocked_sends == 0);
+    mu_assert("test_channel_stats: Blocked time is too short", stats.blocked_ns >= 1000000);
+
+    /* Every channel with counters shows up in the dump */
+    char* dump = NULL;
+    size_t dump_size = 0;
+    FILE* out = open_memstream(&dump, &dump_size);
+    channel_stats_dump(out);
+    fclose(out);
+    mu_assert("test_channel_stats: Dump is missing the channel", strstr(dump, "sends=3 receives=3 blocked_sends=0 blocked_receives=1") != NULL);
+    free(dump);
+
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+typedef struct {
+    size_t id;
+    size_t check;
+    char text[16];
+} typed_message_t;
+
+typedef struct {
+    channel_t* channel;
+    size_t first;
+    size_t count;
+    size_t sum;
+    enum channel_status out;
+} typed_args;
+
+void* helper_typed_producer(typed_args* myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = myargs->first; i < myargs->first + myargs->count && myargs->out == SUCCESS; i++) {
+        typed_message_t message = {i, ~i, "Message"};
+        myargs->out = channel_send_value(myargs->channel, &message);
+    }
+    return NULL;
+}
+
+void* helper_typed_consumer(typed_args* myargs) {
+    myargs->out = SUCCESS;
+    myargs->sum = 0;
+    for (size_t i = 0; i < myargs->count && myargs->out == SUCCESS; i++) {
+        typed_message_t message;
+        myargs->out = channel_receive_value(myargs->channel, &message);
+        if (myargs->out == SUCCESS && (message.check != ~message.id || !string_equal(message.text, "Message"))) {
+            myargs->out = GENERIC_ERROR;
+        }
+        myargs->sum += message.id;
+    }
+    return NULL;
+}
+
+char* test_typed_channel() {
+    print_test_details(__func__, "Testing channels that copy fixed-size messages");
+
+    /* Messages are copied in, so the sender can reuse its value right away */
+    size_t capacity = 4;
+    channel_t* channel = channel_create_typed(capacity, sizeof(typed_message_t));
+    typed_message_t message = {0, 0, "Message"};
+    for (size_t i = 0; i < capacity; i++) {
+        message.id = i;
+        mu_assert("test_typed_channel: Send failed", channel_send_value(channel, &message) == SUCCESS);
+    }
+    mu_assert("test_typed_channel: Full channel should not send", channel_non_blocking_send(channel, &message) == CHANNEL_FULL);
+    for (size_t i = 0; i < capacity; i++) {
+        typed_message_t received = {0, 0, ""};
+        mu_assert("test_typed_channel: Receive failed", channel_receive_value(channel, &received) == SUCCESS);
+        mu_assert("test_typed_channel: Received wrong message", received.id == i && string_equal(received.text, "Message"));
+    }
+
+    /* A select copies into the destination given in its RECV entry */
+    typed_message_t received = {0, 0, ""};
+    select_t list[1] = {{channel, RECV, &received}};
+    select_args sel_args;
+    init_object_for_select_api(&sel_args, list, 1, NULL);
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_typed_channel: Select isn't blocked as expected", sel_args.out == GENERIC_ERROR);
+    message.id = 42;
+    mu_assert("test_typed_channel: Send failed", channel_send_value(channel, &message) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_typed_channel: Select failed", sel_args.out == SUCCESS);
+    mu_assert("test_typed_channel: Select received wrong message", list[0].data == &received && received.id == 42);
+
+    /* Concurrent producers and consumers see every message exactly once, on buffered and unbuffered channels */
+    size_t COUNT = 5000;
+    channel_t* channels[2] = {channel, channel_create_typed(0, sizeof(typed_message_t))};
+    for (size_t c = 0; c < 2; c++) {
+        pthread_t pids[4];
+        typed_args args[4];
+        for (size_t i = 0; i < 2; i++) {
+            args[i] = (typed_args){channels[c], i * COUNT, COUNT, 0, GENERIC_ERROR};
+            pthread_create(&pids[i], NULL, (void *)helper_typed_producer, &args[i]);
+            args[2 + i] = (typed_args){channels[c], 0, COUNT, 0, GENERIC_ERROR};
+            pthread_create(&pids[2 + i], NULL, (void *)helper_typed_consumer, &args[2 + i]);
+        }
+        for (size_t i = 0; i < 4; i++) {
+            pthread_join(pids[i], NULL);
+            mu_assert("test_typed_channel: Send or receive failed", args[i].out == SUCCESS);
+        }
+        mu_assert("test_typed_channel: Messages were lost or duplicated", args[2].sum + args[3].sum == (2 * COUNT) * (2 * COUNT - 1) / 2);
+    }
+
+    for (size_t c = 0; c < 2; c++) {
+        channel_close(channels[c]);
+        channel_destroy(channels[c]);
+    }
+    return NULL;
+}
+
+typedef struct {
+    channel_t* in;
+    channel_t* out;
+    size_t count;
+    size_t sum;
+    enum channel_status status;
+} fiber_args;
+
+void* helper_fiber_ring(fiber_args* myargs) {
+    myargs->status = SUCCESS;
+    for (size_t i = 0; i < myargs->count && myargs->status == SUCCESS; i++) {
+        void* data = NULL;
+        myargs->status = channel_receive(myargs->in, &data);
+        if (myargs->status == SUCCESS) {
+            myargs->status = channel_send(myargs->out, (void*)((size_t)data + 1));
+        }
+    }
+    return NULL;
+}
+
+void* helper_fiber_producer(fiber_args* myargs) {
+    myargs->status = SUCCESS;
+    for (size_t i = 1; i <= myargs->count && myargs->status == SUCCESS; i++) {
+        myargs->status = channel_send(myargs->out, (void*)i);
+        if (i % 100 == 0) {
+            fiber_yield();
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    fiber_pool_t* pool;
+    fiber_args* producers;
+    size_t num_producers;
+    channel_t* result;
+} fiber_fanin_args;
+
+// Spawns the producers from inside a fiber, then receives everything they send with channel_select
+void* helper_fiber_fanin(fiber_fanin_args* myargs) {
+    select_t list[myargs->num_producers];
+    size_t remaining = 0;
+    for (size_t i = 0; i < myargs->num_producers; i++) {
+        list[i] = (select_t){myargs->producers[i].out, RECV, NULL};
+        remaining += myargs->producers[i].count;
+        fiber_spawn(myargs->pool, (void*)helper_fiber_producer, &myargs->producers[i]);
+    }
+    size_t sum = 0;
+    for (; remaining > 0; remaining--) {
+        size_t index;
+        if (channel_select(list, myargs->num_producers, &index) != SUCCESS) {
+            break;
+        }
+        sum += (size_t)list[index].data;
+    }
+    channel_send(myargs->result, (void*)sum);
+    return NULL;
+}
+
+char* test_fibers() {
+    print_test_details(__func__, "Testing channels used from fibers");
+
+#ifdef __SANITIZE_THREAD__
+    size_t RING = 1000; // the sanitizer tracks every fiber like a thread
+#else
+    size_t RING = 10000;
+#endif
+    size_t LAPS = 3;
+    fiber_pool_t* pool = fiber_pool_create(4, 0);
+    mu_assert("test_fibers: Could not create pool", pool != NULL);
+
+    /* A ring of unbuffered channels through RING fibers, fed and drained by this thread */
+    channel_t** ring = malloc(sizeof(channel_t*) * (RING + 1));
+    fiber_args* args = malloc(sizeof(fiber_args) * RING);
+    for (size_t i = 0; i <= RING; i++) {
+        ring[i] = channel_create(0);
+    }
+    for (size_t i = 0; i < RING; i++) {
+        args[i] = (fiber_args){ring[i], ring[i + 1], LAPS, 0, GENERIC_ERROR};
+        fiber_spawn(pool, (void*)helper_fiber_ring, &args[i]);
+    }
+    for (size_t lap = 0; lap < LAPS; lap++) {
+        void* data = NULL;
+        mu_assert("test_fibers: Send failed", channel_send(ring[0], (void*)(lap * RING)) == SUCCESS);
+        mu_assert("test_fibers: Receive failed", channel_receive(ring[RING], &data) == SUCCESS);
+        mu_assert("test_fibers: Message skipped a fiber", (size_t)data == (lap + 1) * RING);
+    }
+    fiber_pool_join(pool);
+    for (size_t i = 0; i < RING; i++) {
+        mu_assert("test_fibers: Fiber send or receive failed", args[i].status == SUCCESS);
+    }
+    for (size_t i = 0; i <= RING; i++) {
+        channel_close(ring[i]);
+        channel_destroy(ring[i]);
+    }
+    free(args);
+    free(ring);
+
+    /* A fiber selects over channels fed by the fibers it spawned */
+    size_t PRODUCERS = 8;
+    size_t COUNT = 1000;
+    fiber_args producers[PRODUCERS];
+    for (size_t i = 0; i < PRODUCERS; i++) {
+        producers[i] = (fiber_args){NULL, channel_create(1), COUNT, 0, GENERIC_ERROR};
+    }
+    channel_t* result = channel_create(1);
+    fiber_fanin_args fanin = {pool, producers, PRODUCERS, result};
+    fiber_spawn(pool, (void*)helper_fiber_fanin, &fanin);
+    void* sum = NULL;
+    mu_assert("test_fibers: Receive failed", channel_receive(result, &sum) == SUCCESS);
+    mu_assert("test_fibers: Messages were lost or duplicated", (size_t)sum == PRODUCERS * COUNT * (COUNT + 1) / 2);
+    fiber_pool_join(pool);
+    for (size_t i = 0; i < PRODUCERS; i++) {
+        mu_assert("test_fibers: Fiber send failed", producers[i].status == SUCCESS);
+        channel_close(producers[i].out);
+        channel_destroy(producers[i].out);
+    }
+    channel_close(result);
+    channel_destroy(result);
+
+    fiber_pool_destroy(pool);
+    return NULL;
+}
+
+char* test_stress_fibers() {
+    print_test_details(__func__, "Stress Testing the router network with routers running as fibers (can take some time)");
+    run_stress_fibers(1, 1, "topology.txt", 0);
+    run_stress_fibers(1, 1, "connected_topology.txt", 2);
+    run_stress_fibers(1, 1, "random_topology.txt", 4);
+    run_stress_fibers(1, 1, "random_topology_1.txt", 0);
+    run_stress_fibers(1, 1, "big_graph.txt", 4);
+
+    /* 10,000 routers on a generated grid loaded from a binary graph file, each tracking 16 destinations */
+#ifdef __SANITIZE_THREAD__
+    size_t SIDE = 30; // the sanitizer tracks every fiber like a thread
+#else
+    size_t SIDE = 100;
+#endif
+    graph_t* grid = graph_generate_grid(SIDE, SIDE, 9, 1);
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/channel_test_routers_%d.bin", (int)getpid());
+    mu_assert("test_stress_fibers: Could not save the grid", graph_save(grid, filename));
+    graph_free(grid);
+    run_stress_fibers_bounded(1, 1, filename, 4, 16);
+    unlink(filename);
+    return NULL;
+}
+
+typedef struct {
+    executor_deque_t* deque;
+    size_t count;
+    size_t sum;
+    size_t taken;
+    atomic_bool* done;
+} deque_args;
+
+void* helper_deque_owner(deque_args* myargs) {
+    myargs->sum = 0;
+    myargs->taken = 0;
+    for (size_t i = 1; i <= myargs->count; i++) {
+        executor_deque_push(myargs->deque, (void*)i);
+        if (i % 3 == 0) {
+            void* item = executor_deque_take(myargs->deque);
+            if (item != NULL) {
+                myargs->sum += (size_t)item;
+                myargs->taken++;
+            }
+        }
+    }
+    void* item;
+    while ((item = executor_deque_take(myargs->deque)) != NULL) {
+        myargs->sum += (size_t)item;
+        myargs->taken++;
+    }
+    atomic_store(myargs->done, true);
+    return NULL;
+}
+
+void* helper_deque_thief(deque_args* myargs) {
+    myargs->sum = 0;
+    myargs->taken = 0;
+    while (true) {
+        void* item = executor_deque_steal(myargs->deque);
+        if (item == NULL) {
+            // the deque only stays empty once the owner has stopped pushing
+            if (atomic_load(myargs->done)) {
+                break;
+            }
+        } else if (item != EXECUTOR_STEAL_RETRY) {
+            myargs->sum += (size_t)item;
+            myargs->taken++;
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    executor_t* executor;
+    channel_t* results;
+    size_t depth;
+} fork_args;
+
+void* helper_square(void* arg) {
+    return (void*)((size_t)arg * (size_t)arg);
+}
+
+// Submits two children until depth reaches 0; every leaf sends 1 on results
+void* helper_fork(fork_args* myargs) {
+    if (myargs->depth == 0) {
+        free(myargs);
+        return (void*)1;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        fork_args* child = malloc(sizeof(fork_args));
+        *child = (fork_args){myargs->executor, myargs->results, myargs->depth - 1};
+        executor_submit(myargs->executor, (void*)helper_fork, child, child->depth == 0 ? myargs->results : NULL);
+    }
+    free(myargs);
+    return NULL;
+}
+
+char* test_executor() {
+    print_test_details(__func__, "Testing the work-stealing executor");
+
+    /* The owner takes the newest item and thieves the oldest, across array growth */
+    executor_deque_t deque;
+    executor_deque_init(&deque);
+    size_t COUNT = 1000;
+    for (size_t i = 1; i <= COUNT; i++) {
+        executor_deque_push(&deque, (void*)i);
+    }
+    mu_assert("test_executor: Steal should take the oldest item", executor_deque_steal(&deque) == (void*)1);
+    mu_assert("test_executor: Take should take the newest item", executor_deque_take(&deque) == (void*)COUNT);
+    for (size_t i = COUNT - 1; i >= 2; i--) {
+        mu_assert("test_executor: Items taken out of order", executor_deque_take(&deque) == (void*)i);
+    }
+    mu_assert("test_executor: Deque should be empty", executor_deque_take(&deque) == NULL);
+    mu_assert("test_executor: Deque should be empty", executor_deque_steal(&deque) == NULL);
+
+    /* Every item is taken exactly once while thieves race the owner */
+    size_t THIEVES = 3;
+    COUNT = 20000;
+    pthread_t pids[THIEVES + 1];
+    deque_args args[THIEVES + 1];
+    atomic_bool done = false;
+    args[0] = (deque_args){&deque, COUNT, 0, 0, &done};
+    pthread_create(&pids[0], NULL, (void *)helper_deque_owner, &args[0]);
+    for (size_t i = 1; i <= THIEVES; i++) {
+        args[i] = (deque_args){&deque, COUNT, 0, 0, &done};
+        pthread_create(&pids[i], NULL, (void *)helper_deque_thief, &args[i]);
+    }
+    pthread_join(pids[0], NULL);
+    size_t sum = args[0].sum;
+    size_t taken = args[0].taken;
+    for (size_t i = 1; i <= THIEVES; i++) {
+        pthread_join(pids[i], NULL);
+        sum += args[i].sum;
+        taken += args[i].taken;
+    }
+    mu_assert("test_executor: Items were lost or taken twice", taken == COUNT && sum == COUNT * (COUNT + 1) / 2);
+    executor_deque_free(&deque);
+
+    /* Results of tasks submitted from outside arrive on the results channel */
+    size_t TASKS = 1000;
+    executor_t* executor = executor_create(4, 16);
+    channel_t* results = channel_create(TASKS);
+    size_t expected = 0;
+    for (size_t i = 0; i < TASKS; i++) {
+        mu_assert("test_executor: Submit failed", executor_submit(executor, helper_square, (void*)i, results) == SUCCESS);
+        expected += i * i;
+    }
+    executor_wait(executor);
+    void* result;
+    for (size_t i = 0; i < TASKS; i++) {
+        mu_assert("test_executor: Result missing", channel_non_blocking_receive(results, &result) == SUCCESS);
+        expected -= (size_t)result;
+    }
+    mu_assert("test_executor: Results were lost or duplicated", expected == 0);
+
+    /* Tasks that submit tasks run to completion on the workers' deques */
+    size_t DEPTH = 10;
+    channel_t* leaves = channel_create(1 << DEPTH);
+    fork_args* root = malloc(sizeof(fork_args));
+    *root = (fork_args){executor, leaves, DEPTH};
+    mu_assert("test_executor: Submit failed", executor_submit(executor, (void*)helper_fork, root, NULL) == SUCCESS);
+    executor_wait(executor);
+    size_t count = 0;
+    while (channel_non_blocking_receive(leaves, &result) == SUCCESS) {
+        count += (size_t)result;
+    }
+    mu_assert("test_executor: Forked tasks were lost", count == (size_t)1 << DEPTH);
+
+    executor_destroy(executor);
+    channel_close(results);
+    channel_destroy(results);
+    channel_close(leaves);
+    channel_destroy(leaves);
+    return NULL;
+}
+
+void* helper_broadcast_consumer(typed_args* myargs) {
+    myargs->out = SUCCESS;
+    myargs->sum = 0;
+    for (size_t i = 0; i < myargs->count && myargs->out == SUCCESS; i++) {
+        typed_message_t message;
+        myargs->out = channel_receive_value(myargs->channel, &message);
+        if (myargs->out == SUCCESS && (message.id != i || message.check != ~message.id)) {
+            myargs->out = GENERIC_ERROR;
+        }
+        myargs->sum += message.id;
+    }
+    return NULL;
+}
+
+char* test_broadcast() {
+    print_test_details(__func__, "Testing broadcast channels and their subscribers");
+
+    /* Every subscriber receives every message, and a send waits for the slowest one */
+    channel_t* channel = channel_create_broadcast(2, 0);
+    channel_t* fast = channel_subscribe(channel);
+    channel_t* slow = channel_subscribe(channel);
+    mu_assert("test_broadcast: Subscribe failed", fast != NULL && slow != NULL);
+    mu_assert("test_broadcast: Subscribing to a subscriber should fail", channel_subscribe(fast) == NULL);
+    void* data = NULL;
+    mu_assert("test_broadcast: Receiving from a broadcast channel should fail", channel_non_blocking_receive(channel, &data) == GENERIC_ERROR);
+    mu_assert("test_broadcast: Sending on a subscriber should fail", channel_non_blocking_send(fast, "Message") == GENERIC_ERROR);
+    mu_assert("test_broadcast: Send failed", channel_send(channel, "Message1") == SUCCESS);
+    mu_assert("test_broadcast: Send failed", channel_send(channel, "Message2") == SUCCESS);
+    mu_assert("test_broadcast: Full channel should not send", channel_non_blocking_send(channel, "Message3") == CHANNEL_FULL);
+    for (size_t i = 0; i < 2; i++) {
+        mu_assert("test_broadcast: Receive failed", channel_receive(fast, &data) == SUCCESS);
+        mu_assert("test_broadcast: Received wrong message", string_equal(data, (i == 0) ? "Message1" : "Message2"));
+    }
+    mu_assert("test_broadcast: Lag is wrong", channel_lag(fast) == 0 && channel_lag(slow) == 2 && channel_lag(channel) == 2);
+    mu_assert("test_broadcast: Slow subscriber should hold the channel back", channel_non_blocking_send(channel, "Message3") == CHANNEL_FULL);
+
+    send_args send;
+    init_object_for_send_api(&send, channel, "Message3", NULL);
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_send, &send);
+    usleep(10000);
+    mu_assert("test_broadcast: Send isn't blocked as expected", send.out == GENERIC_ERROR);
+    mu_assert("test_broadcast: Receive failed", channel_receive(slow, &data) == SUCCESS && string_equal(data, "Message1"));
+    pthread_join(pid, NULL);
+    mu_assert("test_broadcast: Send failed", send.out == SUCCESS);
+
+    /* A select on a subscriber wakes up on a send */
+    mu_assert("test_broadcast: Receive failed", channel_receive(fast, &data) == SUCCESS && string_equal(data, "Message3"));
+    select_t list[1] = {{fast, RECV, NULL}};
+    select_args sel_args;
+    init_object_for_select_api(&sel_args, list, 1, NULL);
+    pthread_create(&pid, NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_broadcast: Select isn't blocked as expected", sel_args.out == GENERIC_ERROR);
+    channel_close(slow);
+    mu_assert("test_broadcast: Closing a subscriber should release its messages", channel_non_blocking_send(channel, "Message4") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_broadcast: Select failed", sel_args.out == SUCCESS && string_equal(list[0].data, "Message4"));
+
+    /* Closing the broadcast channel closes its subscribers */
+    mu_assert("test_broadcast: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_broadcast: Subscriber should be closed", channel_receive(fast, &data) == CLOSED_ERROR);
+    mu_assert("test_broadcast: Subscribing to a closed channel should fail", channel_subscribe(channel) == NULL);
+    mu_assert("test_broadcast: Destroy failed", channel_destroy(channel) == SUCCESS);
+    mu_assert("test_broadcast: Destroy failed", channel_destroy(fast) == SUCCESS && channel_destroy(slow) == SUCCESS);
+
+    /* Concurrent subscribers each see every typed message once, in order */
+    size_t COUNT = 5000;
+    channel = channel_create_broadcast(8, sizeof(typed_message_t));
+    pthread_t pids[4];
+    typed_args args[4];
+    for (size_t i = 1; i < 4; i++) {
+        args[i] = (typed_args){channel_subscribe(channel), 0, COUNT, 0, GENERIC_ERROR};
+        pthread_create(&pids[i], NULL, (void *)helper_broadcast_consumer, &args[i]);
+    }
+    args[0] = (typed_args){channel, 0, COUNT, 0, GENERIC_ERROR};
+    pthread_create(&pids[0], NULL, (void *)helper_typed_producer, &args[0]);
+    for (size_t i = 0; i < 4; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_broadcast: Send or receive failed", args[i].out == SUCCESS);
+    }
+    for (size_t i = 1; i < 4; i++) {
+        mu_assert("test_broadcast: Messages were lost or duplicated", args[i].sum == COUNT * (COUNT - 1) / 2);
+    }
+
+    channel_close(channel);
+    channel_destroy(channel);
+    for (size_t i = 1; i < 4; i++) {
+        channel_destroy(args[i].channel);
+    }
+    return NULL;
+}
+
+char* test_shm_channel() {
+    print_test_details(__func__, "Testing channels shared between processes");
+
+    char name[SHM_BUFFER_NAME_MAX];
+    snprintf(name, sizeof(name), "/channel_test_%d", (int)getpid());
+    channel_t* channel = channel_create_shm(name, 8, sizeof(typed_message_t));
+    mu_assert("test_shm_channel: Create failed", channel != NULL);
+    mu_assert("test_shm_channel: Name should be taken", channel_create_shm(name, 8, sizeof(typed_message_t)) == NULL);
+
+    /* A select can't wait for another process */
+    typed_message_t message = {0, ~(size_t)0, "Message"};
+    select_t list[1] = {{channel, SEND, &message}};
+    size_t index = 1;
+    mu_assert("test_shm_channel: Select should fail", channel_select(list, 1, &index) == GENERIC_ERROR && index == 0);
+
+    /* Messages cross to a child process in order, blocking on a full ring */
+    size_t COUNT = 5000;
+    pid_t pid = fork();
+    if (pid == 0) {
+        channel_t* child = channel_open_shm(name);
+        int failed = (child == NULL);
+        for (size_t i = 0; i < COUNT && !failed; i++) {
+            typed_message_t received;
+            failed = channel_receive_value(child, &received) != SUCCESS || received.id != i || received.check != ~i;
+        }
+        failed = failed || channel_close(child) != SUCCESS || channel_destroy(child) != SUCCESS;
+        _exit(failed);
+    }
+    for (size_t i = 0; i < COUNT; i++) {
+        message.id = i;
+        message.check = ~i;
+        mu_assert("test_shm_channel: Send failed", channel_send_value(channel, &message) == SUCCESS);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    mu_assert("test_shm_channel: Child failed", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    mu_assert("test_shm_channel: Child should have closed the channel", channel_receive_value(channel, &message) == CLOSED_ERROR);
+    mu_assert("test_shm_channel: Destroy failed", channel_destroy(channel) == SUCCESS);
+    mu_assert("test_shm_channel: Last destroy should remove the channel", channel_open_shm(name) == NULL);
+
+    /* A process exiting without closing the channel closes it for the others */
+    channel = channel_create_shm(name, 1, sizeof(typed_message_t));
+    mu_assert("test_shm_channel: Send failed", channel_send_value(channel, &message) == SUCCESS);
+    pid = fork();
+    if (pid == 0) {
+        channel_open_shm(name);
+        _exit(0);
+    }
+    mu_assert("test_shm_channel: Send should see the channel closed", channel_send_value(channel, &message) == CLOSED_ERROR);
+    waitpid(pid, &status, 0);
+    mu_assert("test_shm_channel: Destroy failed", channel_destroy(channel) == SUCCESS);
+    mu_assert("test_shm_channel: Last destroy should remove the channel", channel_open_shm(name) == NULL);
+    return NULL;
+}
+
+bool fd_readable(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) == 1;
+}
+
+char* test_event_fd() {
+    print_test_details(__func__, "Testing channel readiness fds in epoll");
+
+    channel_t* channel = channel_create(2);
+    channel_t* other = channel_create(2);
+    int recv_fd = channel_event_fd(channel, RECV);
+    int send_fd = channel_event_fd(channel, SEND);
+    int other_fd = channel_event_fd(other, RECV);
+    mu_assert("test_event_fd: Creating the fds failed", recv_fd >= 0 && send_fd >= 0 && other_fd >= 0);
+    mu_assert("test_event_fd: Each direction should keep its fd", channel_event_fd(channel, RECV) == recv_fd);
+    mu_assert("test_event_fd: A new fd should start out readable", fd_readable(recv_fd, 0) && fd_readable(send_fd, 0));
+
+    /* An empty receive arms the fd, and only the channel that got a message wakes epoll */
+    void* data = NULL;
+    mu_assert("test_event_fd: Receive should find the channel empty", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    mu_assert("test_event_fd: Receive should find the channel empty", channel_non_blocking_receive(other, &data) == CHANNEL_EMPTY);
+    mu_assert("test_event_fd: Armed fd shouldn't be readable", fd_readable(recv_fd, 0) == false);
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event = {EPOLLIN, {.fd = recv_fd}};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, recv_fd, &event);
+    event.data.fd = other_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, other_fd, &event);
+
+    send_args send;
+    init_object_for_send_api(&send, other, "Message1", NULL);
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_send, &send);
+    struct epoll_event ready[2];
+    mu_assert("test_event_fd: epoll should report the channel with a message",
+              epoll_wait(epoll_fd, ready, 2, -1) == 1 && ready[0].data.fd == other_fd);
+    pthread_join(pid, NULL);
+    mu_assert("test_event_fd: Receive failed", channel_non_blocking_receive(other, &data) == SUCCESS && string_equal(data, "Message1"));
+    mu_assert("test_event_fd: Receive should find the channel empty", channel_non_blocking_receive(other, &data) == CHANNEL_EMPTY);
+    mu_assert("test_event_fd: Receive should drain the fd", epoll_wait(epoll_fd, ready, 2, 0) == 0);
+
+    /* An armed fd doesn't take the wake-up of a blocked receiver */
+    receive_args receive;
+    init_object_for_receive_api(&receive, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &receive);
+    usleep(10000);
+    mu_assert("test_event_fd: Receive isn't blocked as expected", receive.out == GENERIC_ERROR);
+    mu_assert("test_event_fd: Send failed", channel_non_blocking_send(channel, "Message2") == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_event_fd: Receive failed", receive.out == SUCCESS && string_equal(receive.data, "Message2"));
+    mu_assert("test_event_fd: Send should make the fd readable", fd_readable(recv_fd, 0));
+
+    /* A full send arms the send fd, which a receive makes readable */
+    mu_assert("test_event_fd: Send failed", channel_non_blocking_send(channel, "Message3") == SUCCESS);
+    mu_assert("test_event_fd: Send failed", channel_non_blocking_send(channel, "Message4") == SUCCESS);
+    mu_assert("test_event_fd: Send should find the channel full", channel_non_blocking_send(channel, "Message5") == CHANNEL_FULL);
+    mu_assert("test_event_fd: Armed fd shouldn't be readable", fd_readable(send_fd, 0) == false);
+    mu_assert("test_event_fd: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Message3"));
+    mu_assert("test_event_fd: Receive should make the send fd readable", fd_readable(send_fd, 0));
+
+    /* Closing the channel makes armed fds readable */
+    mu_assert("test_event_fd: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && string_equal(data, "Message4"));
+    mu_assert("test_event_fd: Receive should find the channel empty", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    mu_assert("test_event_fd: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_event_fd: Close should make the fd readable", epoll_wait(epoll_fd, ready, 2, -1) == 1 && ready[0].data.fd == recv_fd);
+    mu_assert("test_event_fd: Receive should see the channel closed", channel_non_blocking_receive(channel, &data) == CLOSED_ERROR);
+    close(epoll_fd);
+    channel_destroy(channel);
+    channel_close(other);
+    channel_destroy(other);
+
+    /* On an unbuffered channel a parked sender makes the receive fd readable */
+    channel = channel_create(0);
+    recv_fd = channel_event_fd(channel, RECV);
+    mu_assert("test_event_fd: Receive should find no sender", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    init_object_for_send_api(&send, channel, "Message6", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &send);
+    mu_assert("test_event_fd: Parked sender should make the fd readable", fd_readable(recv_fd, -1));
+    mu_assert("test_event_fd: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS && string_equal(data, "Message6"));
+    pthread_join(pid, NULL);
+    mu_assert("test_event_fd: Send failed", send.out == SUCCESS);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* Directions a channel can't be used in have no fd */
+    channel = channel_create_broadcast(2, 0);
+    mu_assert("test_event_fd: Broadcast channel can't be received from", channel_event_fd(channel, RECV) == -1);
+    mu_assert("test_event_fd: Creating the fd failed", channel_event_fd(channel, SEND) >= 0);
+    channel_close(channel);
+    channel_destroy(channel);
+    return NULL;
+}
+
+typedef struct {
+    channel_t* channel;
+    size_t producer;
+    size_t count;
+    enum channel_status out;
+} sharded_args;
+
+void* helper_sharded_producer(sharded_args* myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = 1; i <= myargs->count && myargs->out == SUCCESS; i++) {
+        myargs->out = channel_send(myargs->channel, (void*)((myargs->producer << 32) | i));
+    }
+    return NULL;
+}
+
+/* Runs producers threads of helper, each sending count messages tagged with its number, and receives them all on this
+   thread: nothing may be lost, and every producer's messages must arrive in the order it sent them */
+char* check_producer_order(channel_t* channel, void* (*helper)(sharded_args*), size_t producers, size_t count) {
+    pthread_t pids[producers];
+    sharded_args args[producers];
+    size_t last[producers];
+    for (size_t i = 0; i < producers; i++) {
+        args[i] = (sharded_args){channel, i, count, GENERIC_ERROR};
+        last[i] = 0;
+        pthread_create(&pids[i], NULL, (void *)helper, &args[i]);
+    }
+    void* data = NULL;
+    for (size_t i = 0; i < producers * count; i++) {
+        mu_assert("check_producer_order: Receive failed", channel_receive(channel, &data) == SUCCESS);
+        size_t producer = (size_t)data >> 32;
+        size_t sequence = (size_t)data & 0xffffffff;
+        mu_assert("check_producer_order: Message from an unknown producer", producer < producers);
+        mu_assert("check_producer_order: Messages of a producer out of order", sequence == last[producer] + 1);
+        last[producer] = sequence;
+    }
+    for (size_t i = 0; i < producers; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("check_producer_order: Send failed", args[i].out == SUCCESS);
+    }
+    return NULL;
+}
+
+char* test_sharded_channel() {
+    print_test_details(__func__, "Testing sharded channels with one ring per producer lane");
+
+    /* Without fifo a send spills into other lanes, so the whole capacity is usable from one thread */
+    void* data = NULL;
+    channel_t* channel = channel_create_sharded(4, 0, 2, false);
+    mu_assert("test_sharded_channel: Could not create channel", channel != NULL);
+    mu_assert("test_sharded_channel: Empty channel should not receive", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_sharded_channel: Non-blocking send failed", channel_non_blocking_send(channel, "Message") == SUCCESS);
+    }
+    mu_assert("test_sharded_channel: Full channel should not send", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_sharded_channel: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        mu_assert("test_sharded_channel: Received wrong message", string_equal(data, "Message"));
+    }
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* With fifo a thread only uses its own lane */
+    channel = channel_create_sharded(4, 0, 2, true);
+    for (size_t i = 0; i < 2; i++) {
+        mu_assert("test_sharded_channel: Non-blocking send failed", channel_non_blocking_send(channel, (void*)(i + 1)) == SUCCESS);
+    }
+    mu_assert("test_sharded_channel: Full lane should not send", channel_non_blocking_send(channel, "Message") == CHANNEL_FULL);
+    for (size_t i = 0; i < 2; i++) {
+        mu_assert("test_sharded_channel: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        mu_assert("test_sharded_channel: Messages out of order", (size_t)data == i + 1);
+    }
+
+    /* Every producer's messages arrive in order, even with more producers than lanes and one slot per lane */
+    size_t COUNT = 5000;
+    channel_close(channel);
+    channel_destroy(channel);
+    channel = channel_create_sharded(2, 0, 2, true);
+    char* failure = check_producer_order(channel, helper_sharded_producer, 4, COUNT);
+    if (failure) return failure;
+    channel_close(channel);
+    channel_destroy(channel);
+
+    /* Typed producers and consumers see every message exactly once */
+    channel = channel_create_sharded(8, sizeof(typed_message_t), 4, false);
+    pthread_t pids[4];
+    typed_args typed[4];
+    for (size_t i = 0; i < 2; i++) {
+        typed[i] = (typed_args){channel, i * COUNT, COUNT, 0, GENERIC_ERROR};
+        pthread_create(&pids[i], NULL, (void *)helper_typed_producer, &typed[i]);
+        typed[2 + i] = (typed_args){channel, 0, COUNT, 0, GENERIC_ERROR};
+        pthread_create(&pids[2 + i], NULL, (void *)helper_typed_consumer, &typed[2 + i]);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_sharded_channel: Send or receive failed", typed[i].out == SUCCESS);
+    }
+    mu_assert("test_sharded_channel: Messages were lost or duplicated", typed[2].sum + typed[3].sum == (2 * COUNT) * (2 * COUNT - 1) / 2);
+
+    /* A blocked select wakes up on a send, and a blocked receive on close */
+    typed_message_t received = {0, 0, ""};
+    select_t list[1] = {{channel, RECV, &received}};
+    select_args sel_args;
+    init_object_for_select_api(&sel_args, list, 1, NULL);
+    pthread_create(&pids[0], NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_sharded_channel: Select isn't blocked as expected", sel_args.out == GENERIC_ERROR);
+    typed_message_t message = {42, ~(size_t)42, "Message"};
+    mu_assert("test_sharded_channel: Send failed", channel_send_value(channel, &message) == SUCCESS);
+    pthread_join(pids[0], NULL);
+    mu_assert("test_sharded_channel: Select failed", sel_args.out == SUCCESS && received.id == 42);
+
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channel, NULL);
+    rec_args.data = &received;
+    pthread_create(&pids[0], NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_sharded_channel: Receive isn't blocked as expected", rec_args.out == GENERIC_ERROR);
+    mu_assert("test_sharded_channel: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pids[0], NULL);
+    mu_assert("test_sharded_channel: Receive should see close", rec_args.out == CLOSED_ERROR);
+    mu_assert("test_sharded_channel: Send on a closed channel should fail", channel_send_value(channel, &message) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+void* helper_priority_producer(sharded_args* myargs) {
+    myargs->out = SUCCESS;
+    for (size_t i = 1; i <= myargs->count && myargs->out == SUCCESS; i++) {
+        myargs->out = channel_send_prio(myargs->channel, (void*)((myargs->producer << 32) | i), (unsigned)myargs->producer);
+    }
+    return NULL;
+}
+
+char* test_priority_channel() {
+    print_test_details(__func__, "Testing priority channels");
+
+    /* Higher priorities are received first, priorities past the last level count as the last level, and equal
+       priorities come out in the order they were sent */
+    void* data = NULL;
+    channel_t* channel = channel_create_priority(4);
+    mu_assert("test_priority_channel: Could not create channel", channel != NULL);
+    mu_assert("test_priority_channel: Send failed", channel_send_prio(channel, "Low1", 0) == SUCCESS);
+    mu_assert("test_priority_channel: Send failed", channel_send(channel, "Low2") == SUCCESS);
+    mu_assert("test_priority_channel: Send failed", channel_send_prio(channel, "High", PRIORITY_LEVELS - 2) == SUCCESS);
+    mu_assert("test_priority_channel: Send failed", channel_send_prio(channel, "Top", PRIORITY_LEVELS + 10) == SUCCESS);
+    mu_assert("test_priority_channel: Full channel should not send", channel_non_blocking_send(channel, "Low3") == CHANNEL_FULL);
+    const char* order[4] = {"Top", "High", "Low1", "Low2"};
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_priority_channel: Receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        mu_assert("test_priority_channel: Messages out of priority order", string_equal(data, order[i]));
+    }
+    mu_assert("test_priority_channel: Empty channel should not receive", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+
+    /* A blocked select send keeps its priority and overtakes the messages that filled the channel */
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_priority_channel: Send failed", channel_send(channel, "Data") == SUCCESS);
+    }
+    select_t list[1] = {{channel, SEND, "Control", 3}};
+    select_args sel_args;
+    init_object_for_select_api(&sel_args, list, 1, NULL);
+    pthread_t pids[4];
+    pthread_create(&pids[0], NULL, (void *)helper_select, &sel_args);
+    usleep(10000);
+    mu_assert("test_priority_channel: Select isn't blocked as expected", sel_args.out == GENERIC_ERROR);
+    mu_assert("test_priority_channel: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Data"));
+    pthread_join(pids[0], NULL);
+    mu_assert("test_priority_channel: Select failed", sel_args.out == SUCCESS && sel_args.index == 0);
+    mu_assert("test_priority_channel: Receive failed", channel_receive(channel, &data) == SUCCESS);
+    mu_assert("test_priority_channel: Control message didn't overtake the data", string_equal(data, "Control"));
+    for (size_t i = 0; i < 3; i++) {
+        mu_assert("test_priority_channel: Receive failed", channel_receive(channel, &data) == SUCCESS && string_equal(data, "Data"));
+    }
+
+    /* Producers at different priorities: nothing is lost, and every producer's messages stay in order */
+    char* failure = check_producer_order(channel, helper_priority_producer, 4, 2000);
+    if (failure) return failure;
+
+    /* A blocked receive sees close, and so do later sends */
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channel, NULL);
+    pthread_create(&pids[0], NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+    mu_assert("test_priority_channel: Receive isn't blocked as expected", rec_args.out == GENERIC_ERROR);
+    mu_assert("test_priority_channel: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pids[0], NULL);
+    mu_assert("test_priority_channel: Receive should see close", rec_args.out == CLOSED_ERROR);
+    mu_assert("test_priority_channel: Send on a closed channel should fail", channel_send_prio(channel, "Late", 1) == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+char* test_elastic_channel() {
+    print_test_details(__func__, "Testing elastic channels that grow and shrink with the load");
+
+    /* Sends double a full ring up to the ceiling instead of failing, and messages keep their order across resizes */
+    void* data = NULL;
+    channel_t* channel = channel_create_elastic(2, 16);
+    mu_assert("test_elastic_channel: Could not create channel", channel != NULL);
+    mu_assert("test_elastic_channel: Wrong initial capacity", elastic_buffer_capacity(channel->elastic) == 2);
+    for (size_t i = 1; i <= 16; i++) {
+        mu_assert("test_elastic_channel: Non-blocking send failed", channel_non_blocking_send(channel, (void*)i) == SUCCESS);
+    }
+    mu_assert("test_elastic_channel: Ring didn't grow to its ceiling", elastic_buffer_capacity(channel->elastic) == 16);
+    mu_assert("test_elastic_channel: Full channel should not send", channel_non_blocking_send(channel, (void*)17) == CHANNEL_FULL);
+    for (size_t i = 1; i <= 16; i++) {
+        mu_assert("test_elastic_channel: Non-blocking receive failed", channel_non_blocking_receive(channel, &data) == SUCCESS);
+        mu_assert("test_elastic_channel: Messages out of order", (size_t)data == i);
+    }
+    mu_assert("test_elastic_channel: Empty channel should not receive", channel_non_blocking_receive(channel, &data) == CHANNEL_EMPTY);
+
+    /* Traffic that keeps the channel mostly empty shrinks it back to where it started */
+    for (size_t i = 0; i < 64; i++) {
+        mu_assert("test_elastic_channel: Send failed", channel_send(channel, (void*)i) == SUCCESS);
+        mu_assert("test_elastic_channel: Receive failed", channel_receive(channel, &data) == SUCCESS && (size_t)data == i);
+    }
+    mu_assert("test_elastic_channel: Ring didn't shrink back", elastic_buffer_capacity(channel->elastic) == 2);
+    mu_assert("test_elastic_channel: Messages were counted twice across resizes", elastic_buffer_added(channel->elastic) == 16 + 64);
+
+    /* Producers racing with the resizes one receiver's pace causes: nothing is lost, and every producer's messages
+       stay in order */
+    char* failure = check_producer_order(channel, helper_sharded_producer, 4, 5000);
+    if (failure) return failure;
+
+    /* A sender blocked at the ceiling sees close */
+    for (size_t i = 0; i < 16; i++) {
+        channel_non_blocking_send(channel, "Fill");
+    }
+    pthread_t pid;
+    send_args snd_args;
+    init_object_for_send_api(&snd_args, channel, "Late", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &snd_args);
+    usleep(10000);
+    mu_assert("test_elastic_channel: Send isn't blocked as expected", snd_args.out == GENERIC_ERROR);
+    mu_assert("test_elastic_channel: Can't close channel", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_elastic_channel: Send should see close", snd_args.out == CLOSED_ERROR);
+    channel_destroy(channel);
+    return NULL;
+}
+
+typedef struct {
+    select_t* select_list;
+    size_t list_size;
+    size_t indices[8];
+    size_t count;
+    enum channel_status out;
+} select_many_args;
+
+void* helper_select_many(select_many_args* myargs) {
+    myargs->out = channel_select_many(myargs->select_list, myargs->list_size, myargs->indices, 8, &myargs->count, NULL);
+    return NULL;
+}
+
+char* test_select_many() {
+    print_test_details(__func__, "Testing select that performs every possible operation at once");
+
+    const size_t CHANNELS = 5;
+    channel_t* channels[5];
+    select_t list[5];
+    size_t indices[8];
+    size_t count = 0;
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channels[i] = channel_create(2);
+        list[i] = (select_t){channels[i], RECV, NULL};
+    }
+
+    /* Every ready entry is performed in one call, each exactly once */
+    channel_send(channels[1], "One");
+    channel_send(channels[3], "Three");
+    channel_send(channels[4], "Four");
+    mu_assert("test_select_many: Select failed", channel_select_many(list, CHANNELS, indices, 8, &count, NULL) == SUCCESS);
+    mu_assert("test_select_many: Wrong number of operations", count == 3);
+    bool seen[5] = {false, false, false, false, false};
+    for (size_t i = 0; i < count; i++) {
+        mu_assert("test_select_many: Entry performed twice or wasn't ready", indices[i] < CHANNELS && !seen[indices[i]]);
+        seen[indices[i]] = true;
+    }
+    mu_assert("test_select_many: Wrong entries performed", seen[1] && seen[3] && seen[4]);
+    mu_assert("test_select_many: Wrong messages received", string_equal(list[1].data, "One") &&
+              string_equal(list[3].data, "Three") && string_equal(list[4].data, "Four"));
+
+    /* With every entry ready and room for one operation per call, successive calls with one cursor take turns, and
+       calls over another list of the same channels with their own cursor don't move those turns */
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel_send(channels[i], "Message");
+    }
+    select_t other[5];
+    memcpy(other, list, sizeof(list));
+    size_t cursor = 0;
+    size_t other_cursor = 0;
+    for (size_t i = 0; i < CHANNELS; i++) {
+        mu_assert("test_select_many: Select failed", channel_select_many(list, CHANNELS, indices, 1, &count, &cursor) == SUCCESS);
+        mu_assert("test_select_many: More operations than max", count == 1);
+        mu_assert("test_select_many: Calls didn't take turns", indices[0] == i && cursor == i + 1);
+        channel_send(channels[indices[0]], "Message");
+        mu_assert("test_select_many: Select failed", channel_select_many(other, CHANNELS, indices, 1, &count, &other_cursor) == SUCCESS);
+        mu_assert("test_select_many: Another list's calls moved the turns", count == 1 && indices[0] == i);
+        channel_send(channels[indices[0]], "Message");
+    }
+    for (size_t i = 0; i < CHANNELS; i++) {
+        void* data = NULL;
+        channel_receive(channels[i], &data);
+    }
+
+    /* Sends and receives mix, and an empty list of possible operations blocks until one is */
+    select_t mixed[2] = {{channels[0], RECV, NULL}, {channels[1], SEND, "Sent"}};
+    mu_assert("test_select_many: Select failed", channel_select_many(mixed, 2, indices, 8, &count, NULL) == SUCCESS);
+    mu_assert("test_select_many: Only the send should be possible", count == 1 && indices[0] == 1);
+    void* data = NULL;
+    mu_assert("test_select_many: Sent message missing", channel_receive(channels[1], &data) == SUCCESS && string_equal(data, "Sent"));
+
+    select_many_args args = {list, CHANNELS, {0}, 0, GENERIC_ERROR};
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_select_many, &args);
+    usleep(10000);
+    mu_assert("test_select_many: It isn't blocked as expected", args.out == GENERIC_ERROR);
+    channel_send(channels[2], "Two");
+    pthread_join(pid, NULL);
+    mu_assert("test_select_many: Blocked select failed", args.out == SUCCESS && args.count == 1 && args.indices[0] == 2);
+    mu_assert("test_select_many: Wrong message received", string_equal(list[2].data, "Two"));
+
+    /* A closed channel stops the pass and is reported last */
+    channel_send(channels[3], "Three");
+    channel_close(channels[0]);
+    mu_assert("test_select_many: Close not reported", channel_select_many(list, CHANNELS, indices, 8, &count, NULL) == CLOSED_ERROR);
+    mu_assert("test_select_many: Closed entry isn't the last index", count >= 1 && indices[count - 1] == 0);
+    mu_assert("test_select_many: A max of 0 should be an error", channel_select_many(list, CHANNELS, indices, 0, &count, NULL) == GENERIC_ERROR && count == 0);
+
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+    return NULL;
+}
+
+char* test_select_fair() {
+    print_test_details(__func__, "Testing fair select that rotates its starting entry");
+
+    const size_t CHANNELS = 4;
+    channel_t* channels[4];
+    select_t list[4];
+    size_t index = 0;
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channels[i] = channel_create(2);
+        list[i] = (select_t){channels[i], RECV, NULL};
+        channel_send(channels[i], "Message");
+    }
+
+    /* With every entry ready, channel_select always takes the first one and the fair select takes turns */
+    for (size_t i = 0; i < CHANNELS; i++) {
+        mu_assert("test_select_fair: Select failed", channel_select(list, CHANNELS, &index) == SUCCESS);
+        mu_assert("test_select_fair: Plain select should take the first ready entry", index == 0);
+        channel_send(channels[0], "Message");
+    }
+    size_t cursor = 0;
+    for (size_t i = 0; i < CHANNELS; i++) {
+        mu_assert("test_select_fair: Select failed", channel_select_fair(list, CHANNELS, &index, &cursor) == SUCCESS);
+        mu_assert("test_select_fair: Calls didn't take turns", index == i && cursor == i + 1);
+        channel_send(channels[index], "Message");
+    }
+
+    /* Fair selects and channel_select_many over the same list, interleaved, each follow their own cursor */
+    size_t fair_cursor = 2;
+    size_t many_cursor = 0;
+    size_t indices[1];
+    size_t count = 0;
+    for (size_t i = 0; i < 2 * CHANNELS; i++) {
+        mu_assert("test_select_fair: Select failed", channel_select_fair(list, CHANNELS, &index, &fair_cursor) == SUCCESS);
+        mu_assert("test_select_fair: Select many moved the fair select's turn", index == (i + 2) % CHANNELS);
+        channel_send(channels[index], "Message");
+        mu_assert("test_select_fair: Select many failed", channel_select_many(list, CHANNELS, indices, 1, &count, &many_cursor) == SUCCESS);
+        mu_assert("test_select_fair: The fair select moved select many's turn", count == 1 && indices[0] == i % CHANNELS);
+        channel_send(channels[indices[0]], "Message");
+    }
+    for (size_t i = 0; i < CHANNELS; i++) {
+        void* data = NULL;
+        channel_receive(channels[i], &data);
+    }
+
+    /* A fair select blocks and wakes up like any other */
+    select_args args;
+    init_object_for_select_api(&args, list, CHANNELS, NULL);
+    pthread_t pid;
+    pthread_create(&pid, NULL, (void *)helper_select_fair, &args);
+    usleep(10000);
+    mu_assert("test_select_fair: It isn't blocked as expected", args.out == GENERIC_ERROR);
+    channel_send(channels[2], "Two");
+    pthread_join(pid, NULL);
+    mu_assert("test_select_fair: Blocked select failed", args.out == SUCCESS && args.index == 2 && args.cursor == 1);
+    mu_assert("test_select_fair: Wrong message received", string_equal(list[2].data, "Two"));
+
+    channel_close(channels[3]);
+    mu_assert("test_select_fair: Close not reported", channel_select_fair(list, CHANNELS, &index, NULL) == CLOSED_ERROR && index == 3);
+    mu_assert("test_select_fair: An empty list should be an error", channel_select_fair(list, 0, &index, &cursor) == GENERIC_ERROR);
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel_close(channels[i]);
+        channel_destroy(channels[i]);
+    }
+    return NULL;
+}
+
+char* test_select_waiters() {
+    /* A select over more channels than fit on its stack, a receive queued behind it and a small select queued
+       behind it on some of the same channels: each must be unlinked from every queue without disturbing the others */
+    const size_t CHANNELS = CHANNEL_SELECT_STACK * 2 + 8;
+    channel_t* channels[CHANNELS];
+    select_t large_list[CHANNELS];
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channels[i] = channel_create(1);
+        large_list[i] = (select_t){channels[i], RECV, NULL};
+    }
+    select_args large_args;
+    init_object_for_select_api(&large_args, large_list, CHANNELS, NULL);
+    pthread_t large_pid;
+    pthread_create(&large_pid, NULL, (void *)helper_select, &large_args);
+    usleep(10000);
+
+    receive_args rec_args;
+    init_object_for_receive_api(&rec_args, channels[5], NULL);
+    pthread_t rec_pid;
+    pthread_create(&rec_pid, NULL, (void *)helper_receive, &rec_args);
+    usleep(10000);
+
+    select_t small_list[4] = {{channels[0], RECV, NULL}, {channels[1], RECV, NULL},
+                              {channels[2], RECV, NULL}, {channels[5], RECV, NULL}};
+    select_args small_args;
+    init_object_for_select_api(&small_args, small_list, 4, NULL);
+    pthread_t small_pid;
+    pthread_create(&small_pid, NULL, (void *)helper_select, &small_args);
+    usleep(10000);
+    mu_assert("test_select_waiters: Selects and receive aren't blocked as expected",
+              large_args.out == GENERIC_ERROR && rec_args.out == GENERIC_ERROR && small_args.out == GENERIC_ERROR);
+
+    mu_assert("test_select_waiters: Send failed", channel_send(channels[CHANNELS - 1], "Last") == SUCCESS);
+    pthread_join(large_pid, NULL);
+    mu_assert("test_select_waiters: Large select got the wrong channel", large_args.out == SUCCESS && large_args.index == CHANNELS - 1);
+    mu_assert("test_select_waiters: Large select got the wrong message", string_equal(large_list[CHANNELS - 1].data, "Last"));
+
+    mu_assert("test_select_waiters: Send failed", channel_send(channels[5], "Fifth") == SUCCESS);
+    pthread_join(rec_pid, NULL);
+    mu_assert("test_select_waiters: Receive queued first didn't get the message", rec_args.out == SUCCESS && string_equal(rec_args.data, "Fifth"));
+    mu_assert("test_select_waiters: Small select shouldn't have completed", small_args.out == GENERIC_ERROR);
+
+    mu_assert("test_select_waiters: Send failed", channel_send(channels[2], "Second") == SUCCESS);
+    pthread_join(small_pid, NULL);
+    mu_assert("test_select_waiters: Small select got the wrong channel", small_args.out == SUCCESS && small_args.index == 2);
+    mu_assert("test_select_waiters: Small select got the wrong message", string_equal(small_list[2].data, "Second"));
+
+    /* Selects of CHANNEL_SELECT_STACK entries keep their waiters on the stack and one more allocates them; either
+       way the select blocks and is woken by its last entry, an unbuffered send that pairs with a plain receive */
+    for (size_t size = CHANNEL_SELECT_STACK; size <= CHANNEL_SELECT_STACK + 1; size++) {
+        for (size_t i = 0; i < size - 1; i++) {
+            large_list[i] = (select_t){channels[i], RECV, NULL};
+        }
+        channel_t* unbuffered = channel_create(0);
+        large_list[size - 1] = (select_t){unbuffered, SEND, "Unbuffered"};
+        init_object_for_select_api(&large_args, large_list, size, NULL);
+        pthread_create(&large_pid, NULL, (void *)helper_select, &large_args);
+        usleep(10000);
+        mu_assert("test_select_waiters: Select isn't blocked", large_args.out == GENERIC_ERROR);
+        void* data = NULL;
+        mu_assert("test_select_waiters: Receive failed", channel_receive(unbuffered, &data) == SUCCESS);
+        mu_assert("test_select_waiters: Received the wrong message", string_equal(data, "Unbuffered"));
+        pthread_join(large_pid, NULL);
+        mu_assert("test_select_waiters: Select got the wrong channel", large_args.out == SUCCESS && large_args.index == size - 1);
+        mu_assert("test_select_waiters: Waiter left queued", unbuffered->send_list.head == NULL && unbuffered->recv_list.head == NULL);
+        channel_close(unbuffered);
+        channel_destroy(unbuffered);
+    }
+
+    for (size_t i = 0; i < CHANNELS; i++) {
+        mu_assert("test_select_waiters: Waiter left queued", channels[i]->send_list.head == NULL && channels[i]->recv_list.head == NULL);
+        mu_assert("test_select_waiters: Channel should be empty", channel_non_blocking_receive(channels[i], &rec_args.data) == CHANNEL_EMPTY);
+        channel_destroy(channels[i]);
+    }
+    return NULL;
+}
+
+char* test_list_destroy() {
+    print_test_details(__func__, "Testing that destroying a linked list frees every node");
+
+    /* list_destroy has to read each node's next pointer before freeing the node; valgrind catches it otherwise */
+    list_t* list = list_create();
+    list_destroy(list);
+
+    list = list_create();
+    for (size_t i = 1; i <= 100; i++) {
+        list_insert(list, (void*)i);
+    }
+    mu_assert("test_list_destroy: Wrong number of nodes", list_count(list) == 100);
+    list_remove(list, (void*)50);
+    mu_assert("test_list_destroy: Node wasn't removed", list_count(list) == 99 && list_find(list, (void*)50) == NULL);
+    size_t sum = 0;
+    for (list_node_t* node = list_head(list); node != NULL; node = list_next(node)) {
+        sum += (size_t)list_data(node);
+    }
+    mu_assert("test_list_destroy: Wrong nodes left in the list", sum == 100 * 101 / 2 - 50);
+    list_destroy(list);
+    return NULL;
+}
+
+char* test_stress_unbuffered() {
+    print_test_details(__func__, "Stress Testing the routers over unbuffered channels");
+    run_stress(0, 1, "topology.txt");
+    run_stress(0, 1, "connected_topology.txt");
+    run_stress(0, 1, "random_topology.txt");
+    run_stress(0, 0, "random_topology_1.txt");
+    run_stress(0, 0, "big_graph.txt");
+    return NULL;
+}
+
 typedef char* (*test_fn_t)();
 typedef struct {
     char* name;
@@ -1667,6 +3622,32 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_cpu_utilization_select", test_cpu_utilization_select},
                   {"test_cpu_utilization_overall", test_cpu_utilization_overall},
                   {"test_for_too_many_wakeups", test_for_too_many_wakeups},
+                  {"test_buffer_concurrent", test_buffer_concurrent},
+                  {"test_spsc_channel", test_spsc_channel},
+                  {"test_spsc_select_close", test_spsc_select_close},
+                  {"test_wakeups_per_message", test_wakeups_per_message},
+                  {"test_batch", test_batch},
+                  {"test_rendezvous", test_rendezvous},
+                  {"test_select_set", test_select_set},
+                  {"test_spin_budget", test_spin_budget},
+                  {"test_channel_stats", test_channel_stats},
+                  {"test_typed_channel", test_typed_channel},
+                  {"test_fibers", test_fibers},
+                  {"test_stress_fibers", test_stress_fibers},
+                  {"test_executor", test_executor},
+                  {"test_broadcast", test_broadcast},
+                  {"test_shm_channel", test_shm_channel},
+                  {"test_event_fd", test_event_fd},
+                  {"test_stress_delta", test_stress_delta},
+                  {"test_graph", test_graph},
+                  {"test_sharded_channel", test_sharded_channel},
+                  {"test_select_waiters", test_select_waiters},
+                  {"test_priority_channel", test_priority_channel},
+                  {"test_elastic_channel", test_elastic_channel},
+                  {"test_select_many", test_select_many},
+                  {"test_select_fair", test_select_fair},
+                  {"test_list_destroy", test_list_destroy},
+                  {"test_stress_unbuffered", test_stress_unbuffered},
 };
 
 size_t num_tests = sizeof(tests)/sizeof(tests[0]);